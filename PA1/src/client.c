@@ -1,4 +1,5 @@
 #include <arpa/inet.h>
+#include <getopt.h>
 #include <math.h>
 #include <netdb.h>
 #include <netinet/in.h>
@@ -8,24 +9,58 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "const.h"
 #include "log.h"
+#include "rtt.h"
+#include "wire.h"
 
-void init_request_packets(request_packet req_pkts[NUM_PACKETS], char payload[BUFFER_LEN]) {
-    for (int i = 0; i < NUM_PACKETS; i++) {
+/**
+ * Fill req_pkts with num_packets consecutive segments, each carrying the payload_len bytes of payload.
+*/
+void init_request_packets(request_packet *req_pkts, int num_packets, const char *payload, int payload_len) {
+    for (int i = 0; i < num_packets; i++) {
         req_pkts[i].start_id = START_ID;
         req_pkts[i].client_id = CLIENT_ID;
         req_pkts[i].data = DATA;
         req_pkts[i].end_id = END_ID;
         // The more specific details to differentiate each packet (seg-no, payload, length).
-        req_pkts[i].seg_num = i;
-        strncpy(req_pkts[i].payload, payload, LENGTH_MAX);  // used buffer to ensure message fit in the payload
-        req_pkts[i].length = sizeof(req_pkts[i].payload);
+        req_pkts[i].seg_num = (char)i;  // wraps around every 256 segments in window mode
+        memcpy(req_pkts[i].payload, payload, payload_len);
+        req_pkts[i].length = (char)payload_len;  // only these bytes go on the wire
     }
 }
 
+/**
+ * Encode req_pkt with its first payload_len payload bytes in the wire format (wire.h) and send it to server_addr.
+ * Return the number of bytes sent; -1 on error.
+*/
+static int send_request(int sock_fd, const request_packet *req_pkt, int payload_len, struct sockaddr_in *server_addr) {
+    unsigned char buf[WIRE_REQUEST_MAX_LEN];
+    int len = wire_encode_request(req_pkt, payload_len, buf, sizeof(buf));
+    return (int)sendto(sock_fd, buf, len, 0, (struct sockaddr *)server_addr, sizeof(struct sockaddr_in));
+}
+
+/**
+ * Receive one datagram from the socket and decode it into rsp_pkt.
+ * Return the number of bytes received; 0 if the datagram was empty or malformed (rsp_pkt is not filled); -1 on error.
+*/
+static int recv_response(int sock_fd, response_packet *rsp_pkt, struct sockaddr_in *server_addr) {
+    unsigned char buf[WIRE_RESPONSE_LEN];
+    socklen_t addrlen = sizeof(struct sockaddr_in);
+    int recv_bytes = (int)recvfrom(sock_fd, buf, sizeof(buf), 0, (struct sockaddr *)server_addr, &addrlen);
+    if (recv_bytes <= 0) {
+        return recv_bytes;
+    }
+    if (wire_decode_response(rsp_pkt, buf, recv_bytes) < 0) {
+        log_warn("Ignoring malformed response of %d bytes (want %d bytes, wire version %d).", recv_bytes, WIRE_RESPONSE_LEN, WIRE_VERSION);
+        return 0;
+    }
+    return recv_bytes;
+}
+
 void init_test_case(int test_number, request_packet req_pkts[NUM_PACKETS]) {
     // Fill the req_pkts according to the test_number given by user cli input
     request_packet tmp;
@@ -56,6 +91,10 @@ void init_test_case(int test_number, request_packet req_pkts[NUM_PACKETS]) {
             req_pkts[4] = req_pkts[3];  // duplicate packet 3
             break;
         }
+        case 5: {
+            log_info("Setting Test Case 5: Delayed Duplicate.");
+            break;  // the send loop replays packet DELAYED_DUP_PACKET once it is ACKed
+        }
         default: {
             log_info("Unrecognized Test Case Number. Stop.");
         }
@@ -81,20 +120,197 @@ void detect_print_error(response_packet *rsp_pkt, int index) {
     }
 }
 
+/**
+ * Selective-repeat sender: keep up to window segments in flight, each with its own retransmit timer.
+ * The server ACKs every segment it accepts, in or out of order, and the window slides past the
+ * oldest segment once it is ACKed. Timers run off the adaptive RTO in rtt, which backs off exponentially
+ * on every timeout. A segment that goes unanswered CLIENT_MAX_ATTEMPTS times aborts the transfer.
+ * Every segment carries payload_len bytes of payload.
+ * Return 0 if every segment was ACKed; -1 otherwise.
+*/
+static int send_windowed(int sock_fd, struct sockaddr_in *server_addr, request_packet *req_pkts, int num_packets, int payload_len, int window, rtt_estimator *rtt) {
+    char *acked = calloc(num_packets, sizeof(char));         // segment has been ACKed
+    long *sent_us = calloc(num_packets, sizeof(long));       // time of the segment's last transmission
+    int *attempts = calloc(num_packets, sizeof(int));        // transmissions of the segment so far
+    int base = 0;  // oldest segment not yet ACKed
+    int next = 0;  // next segment never sent
+    int ret = -1;
+    response_packet rsp_pkt;
+    struct pollfd client_timer_pollfd;
+    client_timer_pollfd.fd = sock_fd;
+    client_timer_pollfd.events = POLLIN;
+    long start_us = rtt_now_us();
+
+    if (!acked || !sent_us || !attempts) {
+        log_fatal("Could not allocate window state for %d packets.", num_packets);
+        goto done;
+    }
+
+    while (base < num_packets) {
+        // Fill the window with segments never sent.
+        while (next < num_packets && next < base + window) {
+            log_info("Client is sending Packet %d (seg_num %d) to Server. Attempt 1", next, (unsigned char)req_pkts[next].seg_num);
+            if (send_request(sock_fd, &req_pkts[next], payload_len, server_addr) < 0) {
+                log_error("Error: sendto() packet number %d", next);
+                goto done;
+            }
+            sent_us[next] = rtt_now_us();
+            attempts[next] = 1;
+            next++;
+        }
+
+        // Sleep until an ACK arrives or the earliest retransmit timer in the window fires.
+        long now = rtt_now_us();
+        long wait_us = -1;
+        for (int i = base; i < next; i++) {
+            if (!acked[i]) {
+                long left = sent_us[i] + rtt->rto_us - now;
+                if (wait_us < 0 || left < wait_us) {
+                    wait_us = left > 0 ? left : 0;
+                }
+            }
+        }
+        int poll_res = poll(&client_timer_pollfd, 1, wait_us < 0 ? -1 : (int)((wait_us + 999) / 1000));
+        if (poll_res < 0) {
+            log_error("Client Experienced Error in Polling. Stop.");
+            goto done;
+        }
+
+        if (poll_res > 0) {
+            int recv_bytes = recv_response(sock_fd, &rsp_pkt, server_addr);
+            if (recv_bytes < 0) {
+                log_fatal("Client Experienced Error in Receiving rsp_pkt from Server.");
+                goto done;
+            } else if (recv_bytes == 0) {
+                continue;
+            }
+            // Map the 8-bit seg_num back to the packet index inside the window.
+            int i = base + (unsigned char)(rsp_pkt.seg_num - (char)base);
+            if (i >= next) {
+                log_warn("Ignoring response for seg_num %d outside the window [%d, %d).", (unsigned char)rsp_pkt.seg_num, base, next);
+                continue;
+            }
+            if (rsp_pkt.type == (short)ACK) {
+                if (!acked[i]) {
+                    log_info("Received ACK for Packet %d from Server.", i);
+                    if (attempts[i] == 1) {  // Karn's algorithm: retransmitted segments give ambiguous samples
+                        rtt_sample(rtt, rtt_now_us() - sent_us[i]);
+                    }
+                }
+                acked[i] = TRUE;
+                while (base < num_packets && base < next && acked[base]) {
+                    base++;
+                }
+            } else if (rsp_pkt.type == (short)REJECT) {
+                log_warn("Received REJECT for Packet %d from Server.", i);
+                detect_print_error(&rsp_pkt, i);
+                goto done;
+            } else {
+                log_error("Unrecognized packet %d type: neither ACK or REJECT Packet. Quit.", i);
+                goto done;
+            }
+        }
+
+        // Retransmit every unACKed segment whose timer has fired, then back the RTO off once.
+        now = rtt_now_us();
+        long rto_us = rtt->rto_us;
+        int timed_out = FALSE;
+        for (int i = base; i < next; i++) {
+            if (acked[i] || now - sent_us[i] < rto_us) {
+                continue;
+            }
+            timed_out = TRUE;
+            if (attempts[i] >= CLIENT_MAX_ATTEMPTS) {
+                log_error("Retry timeout: Client attmpted to send packet %d %d times and failed to get any responses from server. Quit.", i, attempts[i]);
+                goto done;
+            }
+            attempts[i]++;
+            log_warn("No Response from Server for Packet %d. Attempt %d. Retransmitting...", i, attempts[i]);
+            if (send_request(sock_fd, &req_pkts[i], payload_len, server_addr) < 0) {
+                log_error("Error: Client experienced error in sending packet %d to Server.", i);
+                goto done;
+            }
+            sent_us[i] = now;
+        }
+        if (timed_out) {
+            rtt_backoff(rtt);
+        }
+    }
+
+    double elapsed_ms = (rtt_now_us() - start_us) / 1000.0;
+    log_info("Window %d: %d packets ACKed in %.1f ms (%.0f packets/s)", window, num_packets, elapsed_ms, elapsed_ms > 0 ? num_packets * 1000.0 / elapsed_ms : 0.0);
+    ret = 0;
+
+done:
+    free(acked);
+    free(sent_us);
+    free(attempts);
+    return ret;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--window N] [--count M] [--size S] <test_case_no> [port]\n", prog);
+    fprintf(stderr, "  -w, --window N  selective-repeat window of N segments in flight, 1..%d (default 1, stop-and-wait)\n", MAX_WINDOW_SIZE);
+    fprintf(stderr, "  -n, --count M   number of segments to send (default %d)\n", NUM_PACKETS);
+    fprintf(stderr, "  -s, --size S    payload bytes per segment, 0..%d (default %d)\n", LENGTH_MAX, DEFAULT_PAYLOAD_LEN);
+}
+
 int main(int argc, char **argv) {
-    // Handle CLI arguments: test_number and port
+    // Handle CLI arguments: options, then test_number and port
     int port = DEFAULT_SERVER_PORT;
-    if (argc < 2) {  // Ensuring that Arguments is available for Client to know which test case to run.
+    int window = 1;                 // segments in flight, 1 = stop-and-wait
+    int num_packets = NUM_PACKETS;  // segments to send
+    int payload_len = DEFAULT_PAYLOAD_LEN;  // payload bytes per segment
+    static const struct option long_opts[] = {
+        {"window", required_argument, NULL, 'w'},
+        {"count", required_argument, NULL, 'n'},
+        {"size", required_argument, NULL, 's'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "w:n:s:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'w':
+                window = atoi(optarg);
+                if (window < 1 || window > MAX_WINDOW_SIZE) {
+                    log_fatal("Invalid window size %s, must be 1..%d.", optarg, MAX_WINDOW_SIZE);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'n':
+                num_packets = atoi(optarg);
+                break;
+            case 's':
+                payload_len = atoi(optarg);
+                if (payload_len < 0 || payload_len > LENGTH_MAX) {
+                    log_fatal("Invalid payload size %s, must be 0..%d.", optarg, LENGTH_MAX);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                usage(argv[0]);
+                exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    // Stop-and-wait compares seg_num as a plain number, so it cannot go past the largest positive seg_num.
+    int max_packets = window > 1 ? 0x7FFFFFFF : 0x7F;
+    if (num_packets < NUM_PACKETS || num_packets > max_packets) {
+        log_fatal("Invalid packet count %d, must be %d..%d.", num_packets, NUM_PACKETS, max_packets);
+        exit(EXIT_FAILURE);
+    }
+    if (optind >= argc) {  // Ensuring that Arguments is available for Client to know which test case to run.
         log_fatal("ERROR: Missing Arguments for determining which Client Test to run.");
+        usage(argv[0]);
         exit(EXIT_FAILURE);
-    } else if (argc == 2) {
+    } else if (optind + 1 >= argc) {
         log_info("Send to default server port %d <port>", DEFAULT_SERVER_PORT);
     } else {
-        log_info("Send to port %s", argv[2]);
-        port = atoi(argv[2]);
+        log_info("Send to port %s", argv[optind + 1]);
+        port = atoi(argv[optind + 1]);
     }
-    int test_number = atoi(argv[1]);  // setting the test case being run.
-    if (test_number < 0 || test_number > 4) {
+    int test_number = atoi(argv[optind]);  // setting the test case being run.
+    if (test_number < 0 || test_number > 5) {
         log_error("Unrecognized test case number. Stop.");
         exit(EXIT_FAILURE);
     }
@@ -105,7 +321,7 @@ int main(int argc, char **argv) {
     int recv_bytes;                                  // received packet size in bytes, used as sanity check
     response_packet rsp_pkt;                         // struct for response packet from server
     int poll_res;                                    // return value for poll(), the number of fds which status changes been detected. Used as sanity check
-    static char payload_pad[BUFFER_LEN];             // padding that fakes the payload
+    char payload[LENGTH_MAX];                        // payload carried by every segment
 
 
     // Create Client UDP socket
@@ -137,38 +353,71 @@ int main(int argc, char **argv) {
     client_timer_pollfd.events = POLLIN;
 
     // Initialize request packets for testing
-    request_packet req_pkts[NUM_PACKETS];  // holds 5 request packets for testing
-    init_request_packets(req_pkts, payload_pad);
+    request_packet *req_pkts = malloc(sizeof(request_packet) * num_packets);  // holds the request packets for testing
+    if (!req_pkts) {
+        log_fatal("Could not allocate %d request packets.", num_packets);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < payload_len; i++) {
+        payload[i] = (char)('a' + i % 26);
+    }
+    init_request_packets(req_pkts, num_packets, payload, payload_len);
     init_test_case(test_number, req_pkts);
 
+    // Adaptive retransmission timeout, starting at CLIENT_INITIAL_RTO and capped at CLIENT_RECV_TIMEOUT.
+    rtt_estimator rtt;
+    rtt_init(&rtt, CLIENT_INITIAL_RTO, CLIENT_MIN_RTO, CLIENT_RECV_TIMEOUT);
+
+    if (window > 1) {
+        int ret = send_windowed(client_sock_fd, &server_addr, req_pkts, num_packets, payload_len, window, &rtt);
+        rtt_report(&rtt);
+        rtt_free(&rtt);
+        close(client_sock_fd);
+        free(req_pkts);
+        if (ret == 0) {
+            log_info("Sent all packets successfully. End.");
+        }
+        return ret;
+    }
+
     // Send all packets in req_pkts
-    for (int i = 0; i < NUM_PACKETS; i++) {
+    for (int i = 0; i < num_packets; i++) {
         request_packet req_pkt = req_pkts[i];  // Current packet
         unsigned int attempt_counter = 1;      // counter for each packet's send attempts
         attempt_counter = 1;                   // record number of attempts to send current req_pkt so far
+        long sent_us = rtt_now_us();           // time of the first transmission, for the RTT sample
         // Send the packe to the server via the set-up socket connections.
         log_info("Client is sending Packet %d to Server. Attempt %d", i, attempt_counter);
-        if (sendto(client_sock_fd, &req_pkt, sizeof(request_packet), 0, (struct sockaddr *)&server_addr, addrlen) < 0) {
+        if (send_request(client_sock_fd, &req_pkt, payload_len, &server_addr) < 0) {
             log_error("Error: Test case %d: sendto() packet number %d", test_number, i);
             return -1;
         }
 
         while (attempt_counter <= CLIENT_MAX_ATTEMPTS) {
-            poll_res = poll(&client_timer_pollfd, 1, CLIENT_RECV_TIMEOUT);
+            poll_res = poll(&client_timer_pollfd, 1, rtt_timeout_ms(&rtt));
             if (poll_res > 0) { // Normal case
-                recv_bytes = recvfrom(client_sock_fd, &rsp_pkt, sizeof(response_packet), 0, (struct sockaddr *)&server_addr, &addrlen);
+                recv_bytes = recv_response(client_sock_fd, &rsp_pkt, &server_addr);
                 log_info("Received %d bytes from server", recv_bytes);
                 if (recv_bytes < 0) {  // bad packet received. abort due to error in connection.
                     log_fatal("Client Experienced Error in Receiving rsp_pkt from Server.");
                     return -1;
                 } else if (recv_bytes == 0) {
-                    log_warn("Client receive zero bytes packet from server.");
+                    log_warn("Client received an empty or malformed packet from server. Waiting again.");
+                    continue;
+                }
+                // A late answer to an earlier packet, e.g. the REJECT for a duplicate retransmission, has another seg_num.
+                if (rsp_pkt.seg_num != req_pkt.seg_num) {
+                    log_warn("Ignoring response for seg_num %d while waiting for Packet %d.", rsp_pkt.seg_num, i);
+                    continue;
                 }
 
                 // Handling server response
                 if (rsp_pkt.type == (short)ACK) {
                     // Successfully received ACK, send next packet
                     log_info("Received ACK for Packet %d from Server.", i);
+                    if (attempt_counter == 1) {  // Karn's algorithm: retransmitted packets give ambiguous samples
+                        rtt_sample(&rtt, rtt_now_us() - sent_us);
+                    }
                     break;
                 } else if (rsp_pkt.type == (short)REJECT) {
                     log_warn("Received REJECT for Packet %d from Server.", i);
@@ -180,10 +429,11 @@ int main(int argc, char **argv) {
                 }
             } else if (poll_res == 0) {
                 attempt_counter++;
+                rtt_backoff(&rtt);  // exponential backoff: double the RTO for the next wait
                 // Retry
                 if (attempt_counter <= CLIENT_MAX_ATTEMPTS) {
-                    log_warn("No Response from Server to Client. Attempt %d. Retransmitting...", attempt_counter);
-                    if (sendto(client_sock_fd, &req_pkt, sizeof(request_packet), 0, (struct sockaddr *)&server_addr, addrlen) < 0) {
+                    log_warn("No Response from Server to Client. Attempt %d, RTO %d ms. Retransmitting...", attempt_counter, rtt_timeout_ms(&rtt));
+                    if (send_request(client_sock_fd, &req_pkt, payload_len, &server_addr) < 0) {
                         log_error("Error: Client experienced error in sending packet %d to Server.", i);
                         return -1;
                     }
@@ -198,12 +448,26 @@ int main(int argc, char **argv) {
         // Then we need to quit sending packets and exit.
         if (attempt_counter > CLIENT_MAX_ATTEMPTS) {
             log_error("Retry timeout: Client attmpted to send packet %d three times and failed to get any responses from server. Quit.", i);
+            rtt_report(&rtt);
             close(client_sock_fd);
             return -1;
         }
+
+        // Test Case 5: send the ACKed packet again, as a retransmission delayed past its ACK would arrive.
+        // The server REJECTs it as a duplicate while the next packet is in flight.
+        if (test_number == 5 && i == DELAYED_DUP_PACKET) {
+            log_info("Client is replaying Packet %d to Server as a delayed duplicate.", i);
+            if (send_request(client_sock_fd, &req_pkt, payload_len, &server_addr) < 0) {
+                log_error("Error: Test case %d: sendto() packet number %d", test_number, i);
+                return -1;
+            }
+        }
     }
 
+    rtt_report(&rtt);
+    rtt_free(&rtt);
     close(client_sock_fd);
+    free(req_pkts);
     log_info("Sent all packets successfully. End.");
     return 0;
 }
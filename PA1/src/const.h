@@ -1,3 +1,6 @@
+#ifndef CONST_H
+#define CONST_H
+
 #ifndef TRUE
 #define TRUE 1
 #endif
@@ -69,6 +72,12 @@
 #define BUFFER_LEN 2048
 #endif
 
+// Payload bytes per segment sent by the client unless --size says otherwise.
+// Only the header and these bytes go on the wire, see wire.h.
+#ifndef DEFAULT_PAYLOAD_LEN
+#define DEFAULT_PAYLOAD_LEN 32
+#endif
+
 // client ID
 #ifndef CLIENT_ID
 #define CLIENT_ID 0x00
@@ -79,6 +88,11 @@
 #define NUM_PACKETS 5
 #endif
 
+// Packet that Test Case 5 sends again after its ACK, as a delayed duplicate.
+#ifndef DELAYED_DUP_PACKET
+#define DELAYED_DUP_PACKET 2
+#endif
+
 // Number of packets the client will send the server.
 #ifndef CLIENT_MAX_ATTEMPTS
 #define CLIENT_MAX_ATTEMPTS 3
@@ -89,11 +103,36 @@
 #define SERVER_WAIT_TIMEOUT 2000
 #endif
 
-// Timeout for client to receive next ACK packet from the server
+// Longest the client waits for the next ACK packet from the server: upper bound of the adaptive RTO (see rtt.h)
 #ifndef CLIENT_RECV_TIMEOUT
 #define CLIENT_RECV_TIMEOUT 3000
 #endif
 
+// Largest selective-repeat window. Sequence numbers are 8 bits wide and selective repeat needs
+// the window to be at most half the sequence space; the server's reorder bitmap is 64 bits.
+#ifndef MAX_WINDOW_SIZE
+#define MAX_WINDOW_SIZE 64
+#endif
+
+// Default number of datagrams the server pulls per recvmmsg() and flushes per sendmmsg().
+#ifndef DEFAULT_BATCH_SIZE
+#define DEFAULT_BATCH_SIZE 64
+#endif
+
+#ifndef MAX_BATCH_SIZE
+#define MAX_BATCH_SIZE 1024
+#endif
+
+// Seconds between two reports of the average batch fill.
+#ifndef BATCH_REPORT_INTERVAL
+#define BATCH_REPORT_INTERVAL 10
+#endif
+
+// Unix socket that answers every connection with the outcome counters and service times (see metrics.h).
+#ifndef STATS_SOCKET_NAME
+#define STATS_SOCKET_NAME "pa1_stats.sock"
+#endif
+
 // Client packet struct
 typedef struct request_packet {
     short start_id;
@@ -115,3 +154,5 @@ typedef struct response_packet {
     char seg_num;
     short end_id;
 } response_packet;
+
+#endif
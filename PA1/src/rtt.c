@@ -0,0 +1,127 @@
+#include "rtt.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "log.h"
+
+#define RTT_INIT_SAMPLES 1024
+
+long rtt_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000L;
+}
+
+static long clamp_rto(const rtt_estimator *est, long rto_us) {
+    if (rto_us < est->min_rto_us) {
+        return est->min_rto_us;
+    }
+    if (rto_us > est->max_rto_us) {
+        return est->max_rto_us;
+    }
+    return rto_us;
+}
+
+void rtt_init(rtt_estimator *est, long initial_rto_ms, long min_rto_ms, long max_rto_ms) {
+    est->srtt_us = 0;
+    est->rttvar_us = 0;
+    est->min_rto_us = min_rto_ms * 1000L;
+    est->max_rto_us = max_rto_ms * 1000L;
+    est->rto_us = clamp_rto(est, initial_rto_ms * 1000L);
+    est->has_sample = 0;
+    est->num_retransmits = 0;
+    est->samples_us = NULL;
+    est->num_samples = 0;
+    est->cap_samples = 0;
+}
+
+void rtt_sample(rtt_estimator *est, long rtt_us) {
+    if (rtt_us < 0) {
+        rtt_us = 0;
+    }
+    if (!est->has_sample) {
+        // First measurement: SRTT = R, RTTVAR = R/2
+        est->srtt_us = rtt_us;
+        est->rttvar_us = rtt_us / 2;
+        est->has_sample = 1;
+    } else {
+        // RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, then SRTT = 7/8 SRTT + 1/8 R
+        long err = est->srtt_us - rtt_us;
+        if (err < 0) {
+            err = -err;
+        }
+        est->rttvar_us += (err - est->rttvar_us) / 4;
+        est->srtt_us += (rtt_us - est->srtt_us) / 8;
+    }
+    // RTO = SRTT + 4 RTTVAR
+    est->rto_us = clamp_rto(est, est->srtt_us + 4 * est->rttvar_us);
+
+    if (est->num_samples == est->cap_samples) {
+        size_t cap = est->cap_samples ? est->cap_samples * 2 : RTT_INIT_SAMPLES;
+        long *samples = realloc(est->samples_us, cap * sizeof(long));
+        if (!samples) {
+            return;  // keep estimating, the report just misses the newest samples
+        }
+        est->samples_us = samples;
+        est->cap_samples = cap;
+    }
+    est->samples_us[est->num_samples++] = rtt_us;
+}
+
+void rtt_backoff(rtt_estimator *est) {
+    est->rto_us = clamp_rto(est, est->rto_us * 2);
+    est->num_retransmits++;
+}
+
+int rtt_timeout_ms(const rtt_estimator *est) {
+    return (int)((est->rto_us + 999) / 1000);
+}
+
+static int cmp_long(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Nearest-rank percentile p (0..100) of the sorted samples.
+*/
+static long percentile(const long *sorted, size_t n, double p) {
+    size_t rank = (size_t)(p / 100.0 * n + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > n) {
+        rank = n;
+    }
+    return sorted[rank - 1];
+}
+
+void rtt_report(const rtt_estimator *est) {
+    if (est->num_samples == 0) {
+        log_info("RTT: no samples, %ld retransmits", est->num_retransmits);
+        return;
+    }
+    long *sorted = malloc(est->num_samples * sizeof(long));
+    if (!sorted) {
+        return;
+    }
+    for (size_t i = 0; i < est->num_samples; i++) {
+        sorted[i] = est->samples_us[i];
+    }
+    qsort(sorted, est->num_samples, sizeof(long), cmp_long);
+    size_t n = est->num_samples;
+    log_info("RTT over %zu samples (us): p50 %ld, p90 %ld, p99 %ld, p99.9 %ld, max %ld",
+             n, percentile(sorted, n, 50), percentile(sorted, n, 90), percentile(sorted, n, 99),
+             percentile(sorted, n, 99.9), sorted[n - 1]);
+    log_info("RTT final SRTT %ld us, RTTVAR %ld us, RTO %ld us, %ld retransmits",
+             est->srtt_us, est->rttvar_us, est->rto_us, est->num_retransmits);
+    free(sorted);
+}
+
+void rtt_free(rtt_estimator *est) {
+    free(est->samples_us);
+    est->samples_us = NULL;
+    est->num_samples = 0;
+    est->cap_samples = 0;
+}
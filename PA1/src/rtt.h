@@ -0,0 +1,63 @@
+#ifndef RTT_H
+#define RTT_H
+
+#include <stddef.h>
+
+// Smallest and initial retransmission timeout in milliseconds. The largest one is CLIENT_RECV_TIMEOUT.
+#ifndef CLIENT_MIN_RTO
+#define CLIENT_MIN_RTO 10
+#endif
+
+#ifndef CLIENT_INITIAL_RTO
+#define CLIENT_INITIAL_RTO 250
+#endif
+
+// Retransmission timeout estimator (Jacobson/Karels, as specified in RFC 6298), in microseconds.
+// Every RTT sample is also kept so that percentiles can be reported at the end of a run.
+typedef struct rtt_estimator {
+    long srtt_us;          // smoothed round trip time
+    long rttvar_us;        // round trip time variation
+    long rto_us;           // current retransmission timeout, including backoff
+    long min_rto_us;
+    long max_rto_us;
+    int has_sample;        // FALSE until the first RTT sample
+    long num_retransmits;  // timeouts seen, i.e. calls to rtt_backoff()
+    long *samples_us;      // every RTT sample, for the percentile report
+    size_t num_samples;
+    size_t cap_samples;
+} rtt_estimator;
+
+/**
+ * Monotonic clock in microseconds, for timestamping transmissions.
+*/
+long rtt_now_us(void);
+
+/**
+ * Start with RTO = initial_rto_ms, bounded to [min_rto_ms, max_rto_ms].
+*/
+void rtt_init(rtt_estimator *est, long initial_rto_ms, long min_rto_ms, long max_rto_ms);
+
+/**
+ * Fold one RTT measurement into SRTT/RTTVAR and recompute the RTO, clearing any backoff.
+ * Per Karn's algorithm, only feed samples from packets that were never retransmitted.
+*/
+void rtt_sample(rtt_estimator *est, long rtt_us);
+
+/**
+ * A retransmission timer fired: double the RTO (exponential backoff), up to the maximum.
+*/
+void rtt_backoff(rtt_estimator *est);
+
+/**
+ * Current RTO in milliseconds, rounded up, for use as a poll() timeout.
+*/
+int rtt_timeout_ms(const rtt_estimator *est);
+
+/**
+ * Log the RTT percentiles (p50/p90/p99/p99.9/max), the final SRTT/RTTVAR/RTO and the retransmit count.
+*/
+void rtt_report(const rtt_estimator *est);
+
+void rtt_free(rtt_estimator *est);
+
+#endif
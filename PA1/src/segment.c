@@ -0,0 +1,144 @@
+#include "segment.h"
+
+#include <arpa/inet.h>
+
+#include "log.h"
+#include "metrics.h"
+#include "trace.h"
+#include "wire.h"
+
+const char *const segment_outcome_names[SEGMENT_NUM_OUTCOMES] = {
+    "ACK", "REJECT_OUT_OF_SEQUENCE", "REJECT_LENGTH_MISMATCH", "REJECT_PACKET_MISSING", "REJECT_DUP_PACKET", "REJECT", "MALFORMED",
+};
+
+/**
+ * Outcome of the response rsp_pkt, see SEGMENT_OUTCOME_ACK.
+*/
+static inline int segment_outcome(const response_packet *rsp_pkt) {
+    if (rsp_pkt->type == (short)ACK) {
+        return SEGMENT_OUTCOME_ACK;
+    }
+    switch ((unsigned short)rsp_pkt->rej_sub) {
+        case REJECT_OUT_OF_SEQUENCE:
+            return 1;
+        case REJECT_LENGTH_MISMATCH:
+            return 2;
+        case REJECT_PACKET_MISSING:
+            return 3;
+        case REJECT_DUP_PACKET:
+            return 4;
+        default:
+            return SEGMENT_OUTCOME_REJECT;
+    }
+}
+
+void init_resp_packet(response_packet *rsp_pkt, request_packet *req_pkt) {
+    // Whether ACK or REJECT, the return packets have similar values
+    rsp_pkt->start_id = START_ID;
+    rsp_pkt->end_id = END_ID;
+    rsp_pkt->type = REJECT; // less code to set default REJECT
+    rsp_pkt->client_id = req_pkt->client_id;
+    rsp_pkt->seg_num = req_pkt->seg_num;
+}
+
+void handle_cases(response_packet *rsp_pkt, request_packet *req_pkt, int payload_len, int *packet_counter) {
+    // Detect and Handle any errors
+    if (req_pkt->seg_num > *packet_counter) { // out-of-sequence would have at least one packet seg no. greater than expected
+        log_warn("ERROR: REJECT Sub-Code 1. Out-of-Sequence Packets. Expected seg_num=%d, Got seg_num=%d.", *packet_counter, req_pkt->seg_num);
+        rsp_pkt->rej_sub = REJECT_OUT_OF_SEQUENCE;
+    } else if ((unsigned char)req_pkt->length != payload_len) {
+        log_warn("ERROR: REJECT Sub-Code 2. Length Mis-Match in Packet %d. Expected length: %d, actual length: %d", req_pkt->seg_num, (unsigned char)req_pkt->length, payload_len);
+        rsp_pkt->rej_sub = REJECT_LENGTH_MISMATCH;
+    } else if (req_pkt->end_id != (short)END_ID) {
+        log_warn("ERROR: REJECT Sub-Code 3. Invalid End-of-Packet ID: %d, on Packet %d.", req_pkt->end_id, req_pkt->seg_num);
+        rsp_pkt->rej_sub = REJECT_PACKET_MISSING;
+    } else if (req_pkt->seg_num < *packet_counter) { // seg no. would have at least one packet seg no. less than expected
+        log_warn("ERROR: REJECT Sub-Code 4. Duplicate Packets. Expected seg_num=%d, Got Duplicate seg_num=%d.", *packet_counter, req_pkt->seg_num);
+        rsp_pkt->rej_sub = REJECT_DUP_PACKET;
+    } else {
+        // No Errors in the incoming Data Packet
+        log_warn("Acknowledged Packet %d. Sending ACK to Client...", req_pkt->seg_num);
+        rsp_pkt->type = ACK;
+        rsp_pkt->rej_sub = NO_ERROR;
+        (*packet_counter)++;
+    }
+}
+
+void handle_window_cases(response_packet *rsp_pkt, request_packet *req_pkt, int payload_len, session *sess, int window) {
+    unsigned char offset = (unsigned char)(req_pkt->seg_num - (char)sess->window_base);
+    if ((unsigned char)req_pkt->length != payload_len) {
+        log_warn("ERROR: REJECT Sub-Code 2. Length Mis-Match in Packet %d. Expected length: %d, actual length: %d", req_pkt->seg_num, (unsigned char)req_pkt->length, payload_len);
+        rsp_pkt->rej_sub = REJECT_LENGTH_MISMATCH;
+    } else if (req_pkt->end_id != (short)END_ID) {
+        log_warn("ERROR: REJECT Sub-Code 3. Invalid End-of-Packet ID: %d, on Packet %d.", req_pkt->end_id, req_pkt->seg_num);
+        rsp_pkt->rej_sub = REJECT_PACKET_MISSING;
+    } else if (offset < window) {
+        if (sess->window_received & (1ULL << offset)) {
+            log_info("Duplicate Packet %d inside the window. Sending ACK again...", (unsigned char)req_pkt->seg_num);
+        } else if (offset > 0) {
+            log_info("Buffered out-of-order Packet %d, waiting for Packet %d.", (unsigned char)req_pkt->seg_num, sess->window_base);
+        } else {
+            log_info("Acknowledged Packet %d. Sending ACK to Client...", (unsigned char)req_pkt->seg_num);
+        }
+        sess->window_received |= 1ULL << offset;
+        // Slide the window past every segment that is now in order.
+        while (sess->window_received & 1ULL) {
+            sess->window_received >>= 1;
+            sess->window_base++;
+            sess->packet_counter++;
+        }
+        rsp_pkt->type = ACK;
+        rsp_pkt->rej_sub = NO_ERROR;
+    } else if (offset >= 256 - window) {
+        log_info("Packet %d was already acknowledged. Sending ACK again...", (unsigned char)req_pkt->seg_num);
+        rsp_pkt->type = ACK;
+        rsp_pkt->rej_sub = NO_ERROR;
+    } else {
+        log_warn("ERROR: REJECT Sub-Code 1. Out-of-Sequence Packets. Window starts at seg_num=%d, Got seg_num=%d.", sess->window_base, (unsigned char)req_pkt->seg_num);
+        rsp_pkt->rej_sub = REJECT_OUT_OF_SEQUENCE;
+    }
+}
+
+int segment_handle(session_table *sessions, int window, const unsigned char *buf, int recv_bytes, const struct sockaddr_in *client_addr, long recv_ms, unsigned char *rsp) {
+    request_packet req_pkt; // header fields of the request, payload left in the ring
+    response_packet rsp_pkt; // response to it
+    const unsigned char *payload; // payload of the request, inside its ring slot
+    TRACE_START(addr_start);
+    char * client_ip = inet_ntoa(client_addr->sin_addr);
+    TRACE_END(TRACE_ADDR, addr_start);
+    // Sanity check: packet has content
+    if (recv_bytes == 0) {
+        log_warn("Received zero bytes at recvmmsg(), client ip = %s", client_ip); // datagram sockets might permit zero length packets
+    } else {
+        log_info("Message received from client ip = %s", client_ip);
+    }
+    // The length field is checked against the payload bytes that actually arrived, see handle_cases().
+    TRACE_START(decode_start);
+    int payload_len = wire_view_request(&req_pkt, buf, recv_bytes, &payload);
+    TRACE_END(TRACE_DECODE, decode_start);
+    if (payload_len < 0) {
+        log_warn("Dropped malformed datagram of %d bytes from client ip = %s (want %d..%d bytes, wire version %d).", recv_bytes, client_ip, WIRE_REQUEST_MIN_LEN, WIRE_REQUEST_MAX_LEN, WIRE_VERSION);
+        metrics_count(SEGMENT_OUTCOME_MALFORMED);
+        return -1;
+    }
+
+    // Look up (or start) this client's session, which also refreshes its activity timestamp
+    // so the timer wheel keeps it alive while the client is still sending.
+    TRACE_START(check_start);
+    session *sess = session_get(sessions, client_addr, req_pkt.client_id, recv_ms);
+    init_resp_packet(&rsp_pkt, &req_pkt);
+    if (!sess) {
+        log_error("Server Error: Out of memory for session of client ip = %s.", client_ip);
+        rsp_pkt.rej_sub = NO_ERROR; // rejected without a sub-code, client may retry
+    } else if (window > 1) {
+        handle_window_cases(&rsp_pkt, &req_pkt, payload_len, sess, window);
+    } else {
+        handle_cases(&rsp_pkt, &req_pkt, payload_len, &sess->packet_counter);
+    }
+    metrics_count(segment_outcome(&rsp_pkt));
+    TRACE_END(TRACE_CHECK, check_start);
+    TRACE_START(encode_start);
+    int rsp_len = wire_encode_response(&rsp_pkt, rsp, WIRE_RESPONSE_LEN);
+    TRACE_END(TRACE_ENCODE, encode_start);
+    return rsp_len;
+}
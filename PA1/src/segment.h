@@ -0,0 +1,47 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <netinet/in.h>
+
+#include "const.h"
+#include "session.h"
+
+// Segment ingest: the checks the server runs on every request against its client's session,
+// shared by the PA1 server and by multi-protocol servers that host PA1-style ports.
+
+// Outcomes counted on the calling thread's metrics shard (metrics.h): an ACK, the four REJECT sub-codes
+// in order (REJECT_OUT_OF_SEQUENCE .. REJECT_DUP_PACKET), a REJECT without a sub-code, a dropped datagram.
+#define SEGMENT_OUTCOME_ACK 0
+#define SEGMENT_OUTCOME_REJECT 5
+#define SEGMENT_OUTCOME_MALFORMED 6
+#define SEGMENT_NUM_OUTCOMES 7
+
+extern const char *const segment_outcome_names[SEGMENT_NUM_OUTCOMES];
+
+void init_resp_packet(response_packet *rsp_pkt, request_packet *req_pkt);
+
+/**
+ * Check req_pkt, which carried payload_len bytes of payload, against the client's expected seg_num
+ * and fill in rsp_pkt with an ACK or a REJECT sub-code.
+*/
+void handle_cases(response_packet *rsp_pkt, request_packet *req_pkt, int payload_len, int *packet_counter);
+
+/**
+ * Selective-repeat variant of handle_cases(), used when the server runs with a window larger than 1.
+ * Any segment inside [window_base, window_base + window) is accepted and ACKed, out-of-order ones are
+ * recorded in the session's reorder bitmap until the gap before them is filled. Segments just behind
+ * the window were already accepted, so they are ACKed again (the client lost the first ACK).
+ * seg_num is compared modulo 256, so a transfer may run past 255 segments.
+*/
+void handle_window_cases(response_packet *rsp_pkt, request_packet *req_pkt, int payload_len, session *sess, int window);
+
+/**
+ * Handle the request datagram buf[0..recv_bytes) from client_addr, received at recv_ms: check it against the
+ * client's session in sessions (with handle_window_cases() if window > 1, else handle_cases()) and encode
+ * the ACK or REJECT into rsp, which holds WIRE_RESPONSE_LEN bytes. Only the header fields of the request
+ * are decoded (WIRE_REQUEST_FIELDS_LEN bytes), the payload stays in buf.
+ * Return the length of the response; -1 if the datagram was dropped.
+*/
+int segment_handle(session_table *sessions, int window, const unsigned char *buf, int recv_bytes, const struct sockaddr_in *client_addr, long recv_ms, unsigned char *rsp);
+
+#endif
@@ -1,147 +1,454 @@
+#define _GNU_SOURCE
 #include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
 #include <math.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <poll.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "const.h"
+#include "dgram_ring.h"
 #include "log.h"
+#include "metrics.h"
+#include "segment.h"
+#include "session.h"
+#include "trace.h"
+#include "uring.h"
+#include "wire.h"
 
-void init_resp_packet(response_packet *rsp_pkt, request_packet *req_pkt) {
-    // Whether ACK or REJECT, the return packets have similar values
-    rsp_pkt->start_id = START_ID;
-    rsp_pkt->end_id = END_ID;
-    rsp_pkt->type = REJECT; // less code to set default REJECT
-    rsp_pkt->client_id = req_pkt->client_id;
-    rsp_pkt->seg_num = req_pkt->seg_num;
-}
+// user_data of the multishot receive on the io_uring backend; a send carries the slot it answers.
+#define URING_RECV_DATA UINT64_MAX
+
+// Server loop state, shared by both I/O backends.
+typedef struct server_state {
+    int server_fd; // socket file descriptor
+    session_table sessions; // sequence state of each client, keyed by (client address, client_id)
+    int batch_size; // max datagrams per recvmmsg()/sendmmsg()
+    int window; // selective-repeat window, 1 = every segment must arrive in order
+    unsigned long num_batches; // recvmmsg() calls (or io_uring_enter() calls) that returned data since the last report
+    unsigned long num_datagrams; // datagrams received over those calls
+    unsigned long bytes_copied; // request bytes copied out of the ring over those datagrams
+    unsigned long num_syscalls; // poll, receive and send system calls over those datagrams
+    double cpu_at_report; // process CPU time at the last report, in seconds
+    time_t last_report;
+} server_state;
 
-void handle_cases(response_packet *rsp_pkt, request_packet *req_pkt, int *packet_counter) {
-    // Detect and Handle any errors
-    if (req_pkt->seg_num > *packet_counter) { // out-of-sequence would have at least one packet seg no. greater than expected
-        log_warn("ERROR: REJECT Sub-Code 1. Out-of-Sequence Packets. Expected seg_num=%d, Got seg_num=%d.", *packet_counter, req_pkt->seg_num);
-        rsp_pkt->rej_sub = REJECT_OUT_OF_SEQUENCE;
-    } else if ((char)sizeof(req_pkt->payload) != req_pkt->length) {
-        log_warn("ERROR: REJECT Sub-Code 2. Length Mis-Match in Packet %d. Expected length: %d, actual length: %d", req_pkt->seg_num, req_pkt->length, (char)sizeof(req_pkt->payload));
-        rsp_pkt->rej_sub = REJECT_LENGTH_MISMATCH;
-    } else if (req_pkt->end_id != (short)END_ID) {
-        log_warn("ERROR: REJECT Sub-Code 3. Invalid End-of-Packet ID: %d, on Packet %d.", req_pkt->end_id, req_pkt->seg_num);
-        rsp_pkt->rej_sub = REJECT_PACKET_MISSING;
-    } else if (req_pkt->seg_num < *packet_counter) { // seg no. would have at least one packet seg no. less than expected
-        log_warn("ERROR: REJECT Sub-Code 4. Duplicate Packets. Expected seg_num=%d, Got Duplicate seg_num=%d.", *packet_counter, req_pkt->seg_num);
-        rsp_pkt->rej_sub = REJECT_DUP_PACKET;
+/**
+ * Monotonic clock in milliseconds, used for session activity and the timer wheel.
+*/
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void log_lock(bool lock, void *udata) {
+    if (lock) {
+        pthread_mutex_lock(udata);
     } else {
-        // No Errors in the incoming Data Packet
-        log_warn("Acknowledged Packet %d. Sending ACK to Client...", req_pkt->seg_num);
-        rsp_pkt->type = ACK;
-        rsp_pkt->rej_sub = NO_ERROR;
-        (*packet_counter)++;
+        pthread_mutex_unlock(udata);
+    }
+}
+
+static long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+static double cpu_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Every BATCH_REPORT_INTERVAL seconds, log the average batch fill and the bytes copied, system calls and
+ * CPU time per datagram, then reset the counters.
+*/
+static void maybe_report(server_state *st) {
+    if (time(NULL) - st->last_report < BATCH_REPORT_INTERVAL) {
+        return;
+    }
+    double cpu = cpu_seconds();
+    if (st->num_batches > 0 && st->num_datagrams > 0) {
+        log_info("%lu datagrams in %lu batches, average batch fill %.2f / %d, %.2f bytes copied, %.3f syscalls, %.2f us CPU per datagram",
+                 st->num_datagrams, st->num_batches, (double)st->num_datagrams / st->num_batches, st->batch_size,
+                 (double)st->bytes_copied / st->num_datagrams, (double)st->num_syscalls / st->num_datagrams,
+                 (cpu - st->cpu_at_report) * 1e6 / st->num_datagrams);
+    }
+    st->num_batches = 0;
+    st->num_datagrams = 0;
+    st->bytes_copied = 0;
+    st->num_syscalls = 0;
+    st->cpu_at_report = cpu;
+    st->last_report = time(NULL);
+}
+
+/**
+ * Handle one request datagram with the server's sessions and window, see segment_handle().
+*/
+static int handle_datagram(server_state *st, const unsigned char *buf, int recv_bytes, const struct sockaddr_in *client_addr, long recv_ms, unsigned char *rsp) {
+    int rsp_len = segment_handle(&st->sessions, st->window, buf, recv_bytes, client_addr, recv_ms, rsp);
+    if (rsp_len >= 0) {
+        st->bytes_copied += WIRE_REQUEST_FIELDS_LEN;
+    }
+    return rsp_len;
+}
+
+/**
+ * Classic backend: poll() with the timeout set to the next timer wheel tick, so that idle sessions expire
+ * on time even when no packets arrive, then one recvmmsg() and one sendmmsg() per batch. Runs forever.
+ * Return -1 on a fatal error.
+*/
+static int serve_classic(server_state *st) {
+    struct pollfd server_timer_pollfd;
+    server_timer_pollfd.fd = st->server_fd;
+    server_timer_pollfd.events = POLLIN; // notes anything coming in on the socket.
+
+    // Batched I/O: one recvmmsg() fills up to batch_size slots of a preallocated, cache-line aligned ring
+    // (dgram_ring.h), one sendmmsg() flushes the responses, which are encoded into the slot next to each request.
+    // Requests are read in place: only their header fields are decoded, the payload is never copied.
+    dgram_ring ring;
+    if (dgram_ring_init(&ring, st->batch_size, WIRE_REQUEST_MAX_LEN, WIRE_RESPONSE_LEN) < 0) {
+        log_fatal("Could not allocate the datagram ring.");
+        exit(EXIT_FAILURE);
+    }
+
+    // since we're using UDP protocol, no need to call accept()
+    while (TRUE) {
+        TRACE_START(wait_start);
+        int poll_ret = poll(&server_timer_pollfd, 1, session_table_next_timeout(&st->sessions, now_ms()));
+        TRACE_END(TRACE_WAIT, wait_start);
+        st->num_syscalls++;
+        if (poll_ret < 0) { // handle error polling
+            log_error("Error at poll(). Stop.");
+            break;
+        }
+        TRACE_START(expire_start);
+        session_table_expire(&st->sessions, now_ms());
+        TRACE_END(TRACE_EXPIRE, expire_start);
+        if (poll_ret == 0) { // no state mutated after poll returns, can only be timeout
+            continue;
+        }
+
+        // The socket is readable: take every data packet that is queued, up to batch_size
+        dgram_ring_rearm(&ring, st->batch_size);
+        TRACE_START(recv_start);
+        int num_msgs = recvmmsg(st->server_fd, ring.in_msgs, st->batch_size, MSG_WAITFORONE, NULL);
+        TRACE_END_ARG(TRACE_RECV, recv_start, num_msgs);
+        st->num_syscalls++;
+        if (num_msgs < 0) {
+            log_error("Error at recvmmsg()");
+            break;
+        }
+        st->num_batches++;
+        st->num_datagrams += num_msgs;
+        long recv_ms = now_ms();
+        uint64_t recv_ns = metrics_now_ns();
+        TRACE_START(batch_start);
+
+        int num_out = 0;
+        for (int i = 0; i < num_msgs; i++) {
+            unsigned char *rsp = dgram_ring_rsp(&ring, i);
+            TRACE_START(datagram_start);
+            int rsp_len = handle_datagram(st, dgram_ring_req(&ring, i), ring.in_msgs[i].msg_len, dgram_ring_addr(&ring, i), recv_ms, rsp);
+            TRACE_END(TRACE_DATAGRAM, datagram_start);
+            if (rsp_len >= 0) {
+                dgram_ring_respond(&ring, num_out, i, rsp, rsp_len);
+                num_out++;
+            }
+        }
+
+        // Send return packets to the Clients via the socket. sendmmsg() may stop early, so keep going from where it stopped.
+        TRACE_START(send_start);
+        int sent = 0;
+        while (sent < num_out) {
+            int ret = sendmmsg(st->server_fd, ring.out_msgs + sent, num_out - sent, 0);
+            st->num_syscalls++;
+            if (ret < 0) {
+                log_error("Server Error: Failed to Send Packet to Client ip = %s.", inet_ntoa(((struct sockaddr_in *)ring.out_msgs[sent].msg_hdr.msg_name)->sin_addr));
+                // doesn't return -1 on this failure: Server continues to operate in case issue was on Client's end
+                sent++;
+            } else {
+                sent += ret;
+            }
+        }
+        TRACE_END_ARG(TRACE_SEND, send_start, num_out);
+        TRACE_END_ARG(TRACE_BATCH, batch_start, num_msgs);
+        metrics_record_latency(metrics_now_ns() - recv_ns, num_msgs);
+        maybe_report(st);
+    }
+    dgram_ring_free(&ring);
+    return -1;
+}
+
+/**
+ * io_uring backend: one multishot recvmsg fills the slots of the datagram ring (as provided buffers), each
+ * response is encoded into the slot next to its request and sent with a sendmsg SQE, and the slot goes back
+ * to the kernel when the send completes. One io_uring_enter() submits the sends of the last pass and waits
+ * for the next completions, with the next timer wheel tick as its timeout, so receives, sends and session
+ * timeouts share one loop. Runs forever.
+ * Return 1 if io_uring cannot be set up (nothing was served); -1 on a fatal error.
+*/
+static int serve_uring(server_state *st) {
+    // Room for a full batch of responses in flight while the next batch arrives.
+    int num_slots = 1;
+    while (num_slots < 2 * st->batch_size) {
+        num_slots <<= 1;
+    }
+    dgram_ring ring;
+    if (dgram_ring_init(&ring, num_slots, sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + WIRE_REQUEST_MAX_LEN, WIRE_RESPONSE_LEN) < 0) {
+        return 1;
     }
+    uring u;
+    if (uring_init(&u, (unsigned)num_slots, st->server_fd) < 0) {
+        log_warn("io_uring is not available (%s), falling back to poll() and recvmmsg().", strerror(errno));
+        dgram_ring_free(&ring);
+        return 1;
+    }
+    if (uring_provide_buffers(&u, &ring) < 0) {
+        log_warn("Falling back to poll() and recvmmsg().");
+        uring_free(&u);
+        dgram_ring_free(&ring);
+        return 1;
+    }
+    struct msghdr recv_msg; // layout of every provided buffer: io_uring_recvmsg_out, address, datagram
+    memset(&recv_msg, 0, sizeof(recv_msg));
+    recv_msg.msg_namelen = sizeof(struct sockaddr_in);
+    int recv_armed = FALSE; // the multishot receive is still active
+    int slots_free = num_slots; // slots owned by the kernel, waiting for a datagram
+    unsigned long received = 0; // datagrams of the last pass, answered once the next io_uring_enter() submits their sends
+    uint64_t pass_ns = 0; // when the last pass started
+    log_info("Serving with io_uring, %d slots", num_slots);
+
+    while (TRUE) {
+        // The receive stops when it runs out of buffers (or on an error); re-arm it once sends freed some.
+        if (!recv_armed && slots_free > 0) {
+            if (uring_queue_recvmsg(&u, &recv_msg, URING_RECV_DATA) < 0) {
+                log_error("Could not queue the io_uring receive.");
+                break;
+            }
+            recv_armed = TRUE;
+        }
+        metrics_record_latency(metrics_now_ns() - pass_ns, received);
+        TRACE_START(wait_start);
+        if (uring_enter(&u, 1, session_table_next_timeout(&st->sessions, now_ms())) < 0) {
+            break;
+        }
+        TRACE_END(TRACE_WAIT, wait_start);
+        long recv_ms = now_ms();
+        pass_ns = metrics_now_ns();
+        TRACE_START(batch_start);
+        TRACE_START(expire_start);
+        session_table_expire(&st->sessions, recv_ms);
+        TRACE_END(TRACE_EXPIRE, expire_start);
+
+        received = 0;
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(&u)) != NULL) {
+            if (cqe->user_data != URING_RECV_DATA) { // a response went out, its slot can take the next datagram
+                int slot = (int)cqe->user_data;
+                if (cqe->res < 0) {
+                    log_error("Server Error: Failed to Send Packet to Client ip = %s.", inet_ntoa(((struct sockaddr_in *)ring.out_msgs[slot].msg_hdr.msg_name)->sin_addr));
+                }
+                uring_recycle_buffer(&u, &ring, slot);
+                slots_free++;
+                uring_cqe_seen(&u);
+                continue;
+            }
+
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                recv_armed = FALSE;
+            }
+            if (cqe->res < 0 || !(cqe->flags & IORING_CQE_F_BUFFER)) {
+                if (cqe->res != -ENOBUFS) {
+                    log_error("Error at io_uring recvmsg: %s", strerror(-cqe->res));
+                }
+                uring_cqe_seen(&u);
+                continue;
+            }
+            int slot = (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            slots_free--;
+            received++;
+            unsigned char *req;
+            struct sockaddr_in *client_addr;
+            int recv_bytes = uring_recvmsg_datagram(cqe, &recv_msg, &ring, slot, &req, &client_addr);
+            uring_cqe_seen(&u);
+            unsigned char *rsp = dgram_ring_rsp(&ring, slot);
+            TRACE_START(datagram_start);
+            int rsp_len = recv_bytes < 0 ? -1 : handle_datagram(st, req, recv_bytes, client_addr, recv_ms, rsp);
+            TRACE_END(TRACE_DATAGRAM, datagram_start);
+            if (rsp_len < 0) {
+                uring_recycle_buffer(&u, &ring, slot);
+                slots_free++;
+                continue;
+            }
+            // The client address stays in the slot until the send completes.
+            struct msghdr *msg = &ring.out_msgs[slot].msg_hdr;
+            ring.out_iovs[slot].iov_base = rsp;
+            ring.out_iovs[slot].iov_len = rsp_len;
+            msg->msg_name = client_addr;
+            msg->msg_namelen = sizeof(struct sockaddr_in);
+            if (uring_queue_sendmsg(&u, msg, (uint64_t)slot) < 0) {
+                log_error("Server Error: Failed to Send Packet to Client ip = %s.", inet_ntoa(client_addr->sin_addr));
+                uring_recycle_buffer(&u, &ring, slot);
+                slots_free++;
+            }
+        }
+        if (received > 0) {
+            st->num_batches++;
+            st->num_datagrams += received;
+        }
+        TRACE_END_ARG(TRACE_BATCH, batch_start, received);
+        st->num_syscalls += u.num_enters;
+        u.num_enters = 0;
+        maybe_report(st);
+    }
+    uring_free(&u);
+    dgram_ring_free(&ring);
+    return -1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--batch N] [--window N] [--io MODE] [--async-log] [--stats PATH] [port]\n", prog);
+    fprintf(stderr, "  -b, --batch N  datagrams per recvmmsg()/sendmmsg(), 1..%d (default %d)\n", MAX_BATCH_SIZE, DEFAULT_BATCH_SIZE);
+    fprintf(stderr, "  -w, --window N  accept and buffer out-of-order segments inside a selective-repeat window of N, 1..%d (default 1, strict order)\n", MAX_WINDOW_SIZE);
+    fprintf(stderr, "  -i, --io MODE  socket I/O: classic (poll() and recvmmsg()/sendmmsg(), default) or uring (io_uring, falls back to classic)\n");
+    fprintf(stderr, "  -a, --async-log  format and write log lines on a background thread, dropping them when it falls behind\n");
+    fprintf(stderr, "  -s, --stats PATH  serve outcome counters and service times on Unix socket PATH (default %s)\n", STATS_SOCKET_NAME);
 }
 
 int main(int argc, char **argv) {
-    struct sockaddr_in server_addr, client_addr; // sock addresses for client and server.
-    int server_fd; // socket file descriptor
+    struct sockaddr_in server_addr; // sock address for server.
     int port = DEFAULT_SERVER_PORT;
-    socklen_t addrlen = sizeof(struct sockaddr_in); // length of a sockaddr_in to be used in bind() and recvfrom(), sendto()
-    int recv_bytes; // received packet size in bytes, used as sanity check
-    request_packet req_pkt; // struct to hold data from recv()
-    response_packet rsp_pkt; // struct for response packet from server
-    int poll_ret; // return value for poll(), the number of fds which status changes been detected. Used as sanity check
-    int packet_counter = 0; // packet-segment-num expected
-    int is_connect_alive = FALSE; // flag for determining if a connection is still alive
+    socklen_t addrlen = sizeof(struct sockaddr_in); // length of a sockaddr_in to be used in bind()
+    server_state st; // socket, sessions and counters of the server loop
+    memset(&st, 0, sizeof(st));
+    st.batch_size = DEFAULT_BATCH_SIZE;
+    st.window = 1;
+    int use_uring = FALSE; // serve with io_uring (uring.h) instead of poll() and recvmmsg()/sendmmsg()
+    const char *stats_path = STATS_SOCKET_NAME;
     log_info("test");
 
+    static const struct option long_opts[] = {
+        {"batch", required_argument, NULL, 'b'},
+        {"window", required_argument, NULL, 'w'},
+        {"io", required_argument, NULL, 'i'},
+        {"async-log", no_argument, NULL, 'a'},
+        {"stats", required_argument, NULL, 's'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "b:w:i:as:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'b':
+                st.batch_size = atoi(optarg);
+                if (st.batch_size < 1 || st.batch_size > MAX_BATCH_SIZE) {
+                    log_fatal("Invalid batch size %s, must be 1..%d.", optarg, MAX_BATCH_SIZE);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'w':
+                st.window = atoi(optarg);
+                if (st.window < 1 || st.window > MAX_WINDOW_SIZE) {
+                    log_fatal("Invalid window size %s, must be 1..%d.", optarg, MAX_WINDOW_SIZE);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'i':
+                if (strcmp(optarg, "uring") == 0) {
+                    use_uring = TRUE;
+                } else if (strcmp(optarg, "classic") == 0) {
+                    use_uring = FALSE;
+                } else {
+                    log_fatal("Invalid I/O mode %s, must be classic or uring.", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'a':
+                if (log_async_start(LOG_ASYNC_DEFAULT_CAPACITY) < 0) {
+                    log_fatal("Could not start the asynchronous logger.");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 's':
+                stats_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+
     // Set port from command line argument
-    if (argc < 2) {
+    if (optind >= argc) {
         log_info("Using default port %d <port>", DEFAULT_SERVER_PORT);
     } else {
-        log_info("Using port %s", argv[1]);
-        port = atoi(argv[1]);
+        log_info("Using port %s", argv[optind]);
+        port = atoi(argv[optind]);
     }
 
     // Create UDP socket
-    if ((server_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+    if ((st.server_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
         log_fatal("Socket creation failed.");
         exit(EXIT_FAILURE);
     }
 
     // Setup the Server Sock Addr
     memset((char *)&server_addr, 0, addrlen);
-    memset((char *)&client_addr, 0, addrlen);
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = htonl(INADDR_ANY); // accepts traffic from all IPv4 addresses on the local machine
     server_addr.sin_port = htons(port);
 
     // Bind to the Socket and the Selected Port
-    if (bind(server_fd, (struct sockaddr *)&server_addr, addrlen) < 0) {
+    if (bind(st.server_fd, (struct sockaddr *)&server_addr, addrlen) < 0) {
         log_fatal("Binding Failed.");
         exit(EXIT_FAILURE);
     }
 
-    // Use poll() to detect timeout
-    // Unlike the Timer used in the Client (which wait for ACK/REJECT from Server)
-    // This Timer is used to determine if the Server needs to drop connection to a Client
-    // and instead ready itself for a new client to connect.
-    struct pollfd server_timer_pollfd;
-    server_timer_pollfd.fd = server_fd;
-    server_timer_pollfd.events = POLLIN; // notes anything coming in on the socket.
-
-    log_info("PA1 Server: Listening for incoming connection on port %d", port);
+    // Every client gets its own session with its own expected seg_num.
+    // A client that sends nothing for SERVER_WAIT_TIMEOUT ms is assumed to be done, and its session
+    // is dropped by the timer wheel, so the next packet from it starts over at seg_num 0.
+    if (session_table_init(&st.sessions, SERVER_WAIT_TIMEOUT, now_ms()) < 0) {
+        log_fatal("Could not create session table.");
+        exit(EXIT_FAILURE);
+    }
 
-    // ======================== SERVER LOOP ========================
-    // since we're using UDP protocol, no need to call accept()
-    while (TRUE) {
-        if (is_connect_alive) {
-            // Detect if socket status has been changed. If changed, then proceed to get data using recvfrom
-            // Otherwise, if poll returns, The Server will wait 2 seconds between each received packet.
-            // If the Server receives no packets from Client in 2 sec, Server will assume Client has
-            // no more packets to send and will reset itself, waiting for next Client.
-            poll_ret = poll(&server_timer_pollfd, 1, SERVER_WAIT_TIMEOUT);
-            if (poll_ret == 0) { // no state mutated after poll returns, can only be timeout
-                // we time-out and reset to wait for a new client.
-                log_info("Current client connection time out. Waiting for new client");
-                packet_counter = 0; // resetting the expected packet counter.
-            } else if (poll_ret < 0) { // handle error polling
-                log_error("Error at poll(). Stop.");
-                return -1;
-            }
-        }
+    // Outcome counters and service times, counted by the server loop without locks and read on demand
+    // from the stats socket.
+    metrics metrics;
+    if (metrics_init(&metrics, 1, segment_outcome_names, SEGMENT_NUM_OUTCOMES) < 0) {
+        log_fatal("Could not allocate the metrics.");
+        exit(EXIT_FAILURE);
+    }
+    metrics_bind(&metrics, 0);
+    TRACE_THREAD_START("server");
+    log_set_lock(log_lock, &log_mutex);  // the stats thread logs next to the server loop
+    if (metrics_serve(&metrics, stats_path) < 0) {
+        log_warn("Stats are disabled.");
+    }
 
-        // We wait on the socket to get a data packet from the Client
-        recv_bytes = recvfrom(server_fd, &req_pkt, sizeof(request_packet), 0, (struct sockaddr *)&client_addr, &addrlen);
-        char * client_ip = inet_ntoa(client_addr.sin_addr);
-        // Sanity check: packet has content
-        if (recv_bytes < 0) {
-            log_error("Error at recvfrom(), client ip = %s", client_ip);
-            return -1;
-        } else if (recv_bytes == 0) {
-            log_warn("Received zero bytes at recvfrom(), client ip = %s", client_ip); // datagram sockets might permit zero length packets
-        } else {
-            log_info("Message received from client ip = %s", client_ip);
-        }
+    log_info("PA1 Server: Listening for incoming connection on port %d, batch size %d, window %d", port, st.batch_size, st.window);
+    st.cpu_at_report = cpu_seconds();
+    st.last_report = time(NULL);
 
-        // Ensures that since we've got an active connection to the client
-        // that when Server waits on next packet, it uses the timer
-        // just in case the Client stops sending and the Server needs to wait
-        // for a new client.
-        is_connect_alive = TRUE;
-        init_resp_packet(&rsp_pkt, &req_pkt);
-        handle_cases(&rsp_pkt, &req_pkt, &packet_counter);
-
-        // Send return packet to the Client via the socket.
-        if (sendto(server_fd, &rsp_pkt, sizeof(response_packet), 0, (struct sockaddr *)&client_addr, addrlen) < 0) {
-            log_error("Server Error: Failed to Send Packet to Client ip = %s.", client_ip);
-            // doesn't return -1 on this failure: Server continues to operate in case issue was on Client's end
-        }
-    }  // No exit for the Server - it will always wait for Clients. Force-kill Server via CLI (ctrl-C).
+    // ======================== SERVER LOOP ========================
+    // No exit for the Server - it will always wait for Clients. Force-kill Server via CLI (ctrl-C).
+    int ret = use_uring ? serve_uring(&st) : 1;
+    if (ret > 0) {
+        ret = serve_classic(&st);
+    }
 
-    close(server_fd);
-    return 0;
+    close(st.server_fd);
+    session_table_free(&st.sessions);
+    metrics_free(&metrics);
+    TRACE_THREAD_STOP();
+    return ret;
 }
@@ -0,0 +1,175 @@
+#include "session.h"
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "log.h"
+
+#define SESSION_INIT_BUCKETS 1024
+
+static inline unsigned long session_hash(const struct sockaddr_in *addr, char client_id) {
+    uint64_t h = ((uint64_t)addr->sin_addr.s_addr << 24) ^ ((uint64_t)addr->sin_port << 8) ^ (unsigned char)client_id;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (unsigned long)h;
+}
+
+static inline int session_matches(const session *s, const struct sockaddr_in *addr, char client_id) {
+    return s->addr.sin_addr.s_addr == addr->sin_addr.s_addr && s->addr.sin_port == addr->sin_port && s->client_id == client_id;
+}
+
+static inline long expiry_tick(const session_table *t, const session *s) {
+    return (s->last_active_ms + t->timeout_ms + SESSION_WHEEL_TICK_MS - 1) / SESSION_WHEEL_TICK_MS;
+}
+
+/**
+ * File s in the wheel slot of its expiry tick (never a tick that has already been processed).
+*/
+static void wheel_insert(session_table *t, session *s) {
+    long tick = expiry_tick(t, s);
+    if (tick <= t->wheel_tick) {
+        tick = t->wheel_tick + 1;
+    }
+    session **slot = &t->wheel[tick % SESSION_WHEEL_SLOTS];
+    s->wheel_next = *slot;
+    *slot = s;
+}
+
+/**
+ * Unlink s from the hash table. The caller has already detached it from the wheel.
+*/
+static void hash_remove(session_table *t, session *s) {
+    session **pp = &t->buckets[session_hash(&s->addr, s->client_id) & t->mask];
+    while (*pp != s) {
+        pp = &(*pp)->hash_next;
+    }
+    *pp = s->hash_next;
+    t->count--;
+}
+
+/**
+ * Double the number of hash buckets and rehash every session.
+ * Return 0 on success; -1 if out of memory (the table keeps working, just with longer chains).
+*/
+static int hash_grow(session_table *t) {
+    unsigned long new_mask = t->mask * 2 + 1;
+    session **buckets = calloc(new_mask + 1, sizeof(session *));
+    if (!buckets) {
+        return -1;
+    }
+    for (unsigned long i = 0; i <= t->mask; i++) {
+        session *s = t->buckets[i];
+        while (s) {
+            session *next = s->hash_next;
+            unsigned long b = session_hash(&s->addr, s->client_id) & new_mask;
+            s->hash_next = buckets[b];
+            buckets[b] = s;
+            s = next;
+        }
+    }
+    free(t->buckets);
+    t->buckets = buckets;
+    t->mask = new_mask;
+    return 0;
+}
+
+int session_table_init(session_table *t, long timeout_ms, long now_ms) {
+    if (timeout_ms >= (long)SESSION_WHEEL_SLOTS * SESSION_WHEEL_TICK_MS) {
+        log_error("Session timeout %ld ms does not fit in a %d x %d ms timer wheel.", timeout_ms, SESSION_WHEEL_SLOTS, SESSION_WHEEL_TICK_MS);
+        return -1;
+    }
+    t->buckets = calloc(SESSION_INIT_BUCKETS, sizeof(session *));
+    if (!t->buckets) {
+        return -1;
+    }
+    t->mask = SESSION_INIT_BUCKETS - 1;
+    t->count = 0;
+    t->timeout_ms = timeout_ms;
+    t->wheel_tick = now_ms / SESSION_WHEEL_TICK_MS;
+    for (int i = 0; i < SESSION_WHEEL_SLOTS; i++) {
+        t->wheel[i] = NULL;
+    }
+    return 0;
+}
+
+session *session_get(session_table *t, const struct sockaddr_in *addr, char client_id, long now_ms) {
+    unsigned long b = session_hash(addr, client_id) & t->mask;
+    for (session *s = t->buckets[b]; s; s = s->hash_next) {
+        if (session_matches(s, addr, client_id)) {
+            s->last_active_ms = now_ms;  // re-filed lazily when its current wheel slot comes due
+            return s;
+        }
+    }
+
+    session *s = malloc(sizeof(session));
+    if (!s) {
+        return NULL;
+    }
+    s->addr = *addr;
+    s->client_id = client_id;
+    s->packet_counter = 0;
+    s->window_base = 0;
+    s->window_received = 0;
+    s->last_active_ms = now_ms;
+    s->hash_next = t->buckets[b];
+    t->buckets[b] = s;
+    t->count++;
+    wheel_insert(t, s);
+    if ((unsigned long)t->count > t->mask + 1) {
+        hash_grow(t);
+    }
+    return s;
+}
+
+int session_table_expire(session_table *t, long now_ms) {
+    long now_tick = now_ms / SESSION_WHEEL_TICK_MS;
+    int expired = 0;
+    // After a long stall every slot only needs to be visited once.
+    if (now_tick - t->wheel_tick > SESSION_WHEEL_SLOTS) {
+        t->wheel_tick = now_tick - SESSION_WHEEL_SLOTS;
+    }
+    while (t->wheel_tick < now_tick) {
+        t->wheel_tick++;
+        session *s = t->wheel[t->wheel_tick % SESSION_WHEEL_SLOTS];
+        t->wheel[t->wheel_tick % SESSION_WHEEL_SLOTS] = NULL;
+        while (s) {
+            session *next = s->wheel_next;
+            if (now_ms - s->last_active_ms >= t->timeout_ms) {
+                char client_ip[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &s->addr.sin_addr, client_ip, sizeof(client_ip));
+                log_info("Client %s:%d (id %d) connection time out after seg_num=%d.", client_ip, ntohs(s->addr.sin_port), s->client_id, s->packet_counter);
+                hash_remove(t, s);
+                free(s);
+                expired++;
+            } else {
+                wheel_insert(t, s);  // active since it was filed, move it to its new expiry tick
+            }
+            s = next;
+        }
+    }
+    return expired;
+}
+
+int session_table_next_timeout(const session_table *t, long now_ms) {
+    if (t->count == 0) {
+        return -1;
+    }
+    long wait = (t->wheel_tick + 1) * SESSION_WHEEL_TICK_MS - now_ms;
+    return wait > 0 ? (int)wait : 0;
+}
+
+void session_table_free(session_table *t) {
+    for (unsigned long i = 0; i <= t->mask; i++) {
+        session *s = t->buckets[i];
+        while (s) {
+            session *next = s->hash_next;
+            free(s);
+            s = next;
+        }
+    }
+    free(t->buckets);
+    t->buckets = NULL;
+    t->count = 0;
+}
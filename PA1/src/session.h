@@ -0,0 +1,69 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+
+// Width of one timer wheel tick and number of ticks in the wheel.
+// The wheel must span more than the session timeout, see session_table_init().
+#ifndef SESSION_WHEEL_TICK_MS
+#define SESSION_WHEEL_TICK_MS 100
+#endif
+
+#ifndef SESSION_WHEEL_SLOTS
+#define SESSION_WHEEL_SLOTS 64
+#endif
+
+// Sequence state of one client, keyed by (client address, client_id).
+typedef struct session {
+    struct sockaddr_in addr;      // client ip and port
+    char client_id;               // client_id carried in the client's packets
+    int packet_counter;           // packet-segment-num expected next from this client
+    unsigned char window_base;    // window mode: 8-bit seg_num of the oldest segment not yet received
+    uint64_t window_received;     // window mode: bit i set if seg_num window_base + i arrived out of order
+    long last_active_ms;          // time of the last packet from this client
+    struct session *hash_next;    // next session in the same hash bucket
+    struct session *wheel_next;   // next session in the same timer wheel slot
+} session;
+
+// Hash table of live sessions plus a timer wheel that expires idle ones.
+// A session is filed in the wheel slot of its expiry tick when it is created. Packets only refresh
+// last_active_ms; when the slot comes due, sessions that were active since are simply re-filed
+// under their new expiry tick, so the per-packet cost stays O(1) without touching the wheel.
+typedef struct session_table {
+    session **buckets;                      // hash buckets, count is a power of two
+    unsigned long mask;                     // num buckets - 1
+    int count;                              // number of live sessions
+    long timeout_ms;                        // idle time after which a session expires
+    long wheel_tick;                        // last tick processed by session_table_expire()
+    session *wheel[SESSION_WHEEL_SLOTS];    // sessions by expiry tick modulo SESSION_WHEEL_SLOTS
+} session_table;
+
+/**
+ * Initialize an empty table whose sessions expire after timeout_ms without traffic.
+ * Return 0 on success; -1 on error.
+*/
+int session_table_init(session_table *t, long timeout_ms, long now_ms);
+
+/**
+ * Find the session of (addr, client_id), creating it with packet_counter = 0 if it does not exist,
+ * and mark it active at now_ms.
+ * Return the session; NULL if out of memory.
+*/
+session *session_get(session_table *t, const struct sockaddr_in *addr, char client_id, long now_ms);
+
+/**
+ * Expire every session idle for timeout_ms or more at now_ms.
+ * Return the number of sessions expired.
+*/
+int session_table_expire(session_table *t, long now_ms);
+
+/**
+ * Milliseconds until the next wheel tick is due, for use as a poll() timeout.
+ * Return -1 (wait forever) when there are no sessions.
+*/
+int session_table_next_timeout(const session_table *t, long now_ms);
+
+void session_table_free(session_table *t);
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Hot-path tracing: per-stage spans of the server loop, for finding where a latency spike went without perf.
+// Build with CFLAGS="-Wall -DSERVER_TRACE=1" to turn it on; by default every TRACE_* macro below compiles
+// to nothing. A traced thread writes its spans into its own trace file, trace.<pid>.<tid>.bin, mapped into
+// memory: recording a span is two timestamp reads and one 24-byte store, with no system call, and the file
+// is complete even if the server is killed. The file is a ring that keeps the last TRACE_BUFFER_EVENTS
+// spans. bench/build/tracejson turns trace files into Chrome trace JSON (chrome://tracing, Perfetto).
+#ifndef SERVER_TRACE
+#define SERVER_TRACE 0
+#endif
+
+#ifndef TRACE_BUFFER_EVENTS
+#define TRACE_BUFFER_EVENTS (1 << 18)  // per thread, a power of two
+#endif
+
+// Stages of the server loops. A span may contain others (a datagram contains its lookup and logging).
+enum {
+    TRACE_WAIT,      // blocked in poll() or io_uring_enter() until datagrams arrive
+    TRACE_RECV,      // recvmmsg(), including the wait when it blocks
+    TRACE_BATCH,     // one batch, from its receive to its last send
+    TRACE_DATAGRAM,  // one request, decoded, checked and answered
+    TRACE_ADDR,      // client address to text (inet_ntoa, inet_ntop)
+    TRACE_DECODE,    // reading the request's fields off the wire
+    TRACE_LOOKUP,    // subscriber index lookup
+    TRACE_CHECK,     // session lookup and segment checks
+    TRACE_ENCODE,    // writing the response
+    TRACE_LOG,       // one log call
+    TRACE_SEND,      // sendmmsg()
+    TRACE_EXPIRE,    // idle session expiry
+    TRACE_NUM_STAGES
+};
+
+#define TRACE_MAGIC "SRVTRACE"
+#define TRACE_VERSION 1
+#define TRACE_NAME_LEN 16
+
+// Trace file layout: this header, then `capacity` trace_events. Span i lives at events[i % capacity].
+typedef struct trace_header {
+    char magic[8];                 // TRACE_MAGIC, without the terminating zero
+    uint32_t version;              // TRACE_VERSION
+    uint32_t capacity;             // number of event slots
+    uint32_t pid;
+    uint32_t tid;
+    double ticks_per_us;           // rate of the timestamps below
+    uint64_t base_ticks;           // timestamp when the thread started tracing
+    atomic_ulong head;             // spans written so far; the newest is head - 1
+    char thread_name[TRACE_NAME_LEN];
+    char stage_names[TRACE_NUM_STAGES][TRACE_NAME_LEN];
+} __attribute__((aligned(64))) trace_header;
+
+typedef struct trace_event {
+    uint64_t start;     // timestamp at the start of the span
+    uint64_t duration;  // in timestamp ticks
+    uint32_t stage;     // TRACE_* stage
+    uint32_t arg;       // stage-specific, e.g. datagrams in a batch
+} trace_event;
+
+#if SERVER_TRACE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+// Trace file of the calling thread; hdr is NULL if the thread is not traced.
+typedef struct trace_buffer {
+    trace_header *hdr;
+    trace_event *events;
+    uint64_t mask;  // capacity - 1
+} trace_buffer;
+
+extern _Thread_local trace_buffer trace_local;
+
+/**
+ * Timestamp counter: the TSC on x86 (constant rate on any CPU from the last decade), the monotonic clock
+ * in nanoseconds elsewhere.
+*/
+static inline uint64_t trace_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * Record a span of stage that started at start and ends now. Only the owning thread writes its file.
+*/
+static inline void trace_record(int stage, uint64_t start, uint32_t arg) {
+    if (trace_local.hdr) {
+        uint64_t end = trace_ticks();
+        unsigned long i = atomic_load_explicit(&trace_local.hdr->head, memory_order_relaxed);
+        trace_event *e = &trace_local.events[i & trace_local.mask];
+        e->start = start;
+        e->duration = end - start;
+        e->stage = (uint32_t)stage;
+        e->arg = arg;
+        atomic_store_explicit(&trace_local.hdr->head, i + 1, memory_order_release);
+    }
+}
+
+/**
+ * Create the calling thread's trace file in the working directory and start recording its spans under
+ * thread name name. On error, logs a warning and the thread is not traced.
+*/
+void trace_thread_start(const char *name);
+
+/**
+ * Stop recording the calling thread's spans and unmap its trace file.
+*/
+void trace_thread_stop(void);
+
+#define TRACE_THREAD_START(name) trace_thread_start(name)
+#define TRACE_THREAD_STOP() trace_thread_stop()
+#define TRACE_START(var) uint64_t var = trace_ticks()
+#define TRACE_END(stage, var) trace_record(stage, var, 0)
+#define TRACE_END_ARG(stage, var, arg) trace_record(stage, var, (uint32_t)(arg))
+
+#else
+
+#define TRACE_THREAD_START(name) ((void)0)
+#define TRACE_THREAD_STOP() ((void)0)
+#define TRACE_START(var) ((void)0)
+#define TRACE_END(stage, var) ((void)0)
+#define TRACE_END_ARG(stage, var, arg) ((void)0)
+
+#endif
+
+#endif
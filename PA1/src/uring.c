@@ -0,0 +1,253 @@
+#define _GNU_SOURCE
+#include "uring.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+int uring_init(uring *u, unsigned entries, int sock_fd) {
+    memset(u, 0, sizeof(*u));
+    u->ring_fd = -1;
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    // Completions are only reaped by the thread that submits, so the kernel need not interrupt it for them.
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    p.cq_entries = entries * 4;  // a multishot receive can complete many times per SQE
+    u->ring_fd = sys_io_uring_setup(entries, &p);
+    if (u->ring_fd < 0 && errno == EINVAL) {
+        p.flags = IORING_SETUP_CQSIZE;  // kernels before 6.0 lack the last two flags
+        u->ring_fd = sys_io_uring_setup(entries, &p);
+    }
+    if (u->ring_fd < 0) {
+        return -1;
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) {
+        errno = ENOSYS;
+        goto fail;
+    }
+
+    u->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (cq_len > u->sq_map_len) {
+        u->sq_map_len = cq_len;  // one mapping holds both rings
+    }
+    u->sq_map = mmap(NULL, u->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQ_RING);
+    if (u->sq_map == MAP_FAILED) {
+        u->sq_map = NULL;
+        goto fail;
+    }
+    u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        goto fail;
+    }
+    char *sq = u->sq_map;
+    u->sq_head = (unsigned *)(sq + p.sq_off.head);
+    u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    u->sq_array = (unsigned *)(sq + p.sq_off.array);
+    u->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    u->sq_entries = p.sq_entries;
+    u->cq_head = (unsigned *)(sq + p.cq_off.head);
+    u->cq_tail = (unsigned *)(sq + p.cq_off.tail);
+    u->cq_mask = *(unsigned *)(sq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(sq + p.cq_off.cqes);
+    // SQE i always sits at index i of the array, so preparing an SQE only has to bump the tail.
+    for (unsigned i = 0; i < p.sq_entries; i++) {
+        u->sq_array[i] = i;
+    }
+
+    if (sys_io_uring_register(u->ring_fd, IORING_REGISTER_FILES, &sock_fd, 1) < 0) {
+        goto fail;
+    }
+    // A registered ring fd spares io_uring_enter() the fd table lookup; optional (Linux 5.18).
+    u->enter_fd = u->ring_fd;
+    struct io_uring_rsrc_update update = {.offset = -1U, .data = (uint64_t)u->ring_fd};
+    if (sys_io_uring_register(u->ring_fd, IORING_REGISTER_RING_FDS, &update, 1) == 1) {
+        u->enter_fd = (int)update.offset;
+        u->enter_flags = IORING_ENTER_REGISTERED_RING;
+    }
+    return 0;
+
+fail:
+    {
+        int err = errno;
+        uring_free(u);
+        errno = err;
+    }
+    return -1;
+}
+
+int uring_provide_buffers(uring *u, const dgram_ring *ring) {
+    unsigned n = (unsigned)ring->num_slots;
+    if (n == 0 || (n & (n - 1)) != 0 || n > 32768) {
+        log_error("io_uring Error: %u provided buffers, want a power of two up to 32768.", n);
+        return -1;
+    }
+    u->buf_ring_len = n * sizeof(struct io_uring_buf);
+    u->buf_ring = mmap(NULL, u->buf_ring_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (u->buf_ring == MAP_FAILED) {
+        u->buf_ring = NULL;
+        log_error("io_uring Error: Could not map the provided buffer ring.");
+        return -1;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)u->buf_ring;
+    reg.ring_entries = n;
+    reg.bgid = URING_BUF_GROUP;
+    if (sys_io_uring_register(u->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        log_error("io_uring Error: Could not register the provided buffer ring.");
+        munmap(u->buf_ring, u->buf_ring_len);
+        u->buf_ring = NULL;
+        return -1;
+    }
+    u->buf_mask = n - 1;
+    u->buf_tail = 0;
+    for (unsigned i = 0; i < n; i++) {
+        uring_recycle_buffer(u, ring, (int)i);
+    }
+    return 0;
+}
+
+void uring_recycle_buffer(uring *u, const dgram_ring *ring, int slot) {
+    struct io_uring_buf *buf = &u->buf_ring->bufs[u->buf_tail & u->buf_mask];
+    buf->addr = (uint64_t)(uintptr_t)dgram_ring_req(ring, slot);
+    buf->len = (uint32_t)ring->req_len;
+    buf->bid = (uint16_t)slot;
+    u->buf_tail++;
+    __atomic_store_n(&u->buf_ring->tail, u->buf_tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * Next free SQE, cleared; submits the queued ones first if the SQ is full.
+ * Return NULL if there is still no room.
+*/
+static struct io_uring_sqe *get_sqe(uring *u) {
+    unsigned tail = *u->sq_tail + u->sq_pending;
+    if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries) {
+        if (uring_enter(u, 0, 0) < 0) {
+            return NULL;
+        }
+        tail = *u->sq_tail + u->sq_pending;
+        if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries) {
+            return NULL;
+        }
+    }
+    struct io_uring_sqe *sqe = &u->sqes[tail & u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_pending++;
+    return sqe;
+}
+
+int uring_queue_recvmsg(uring *u, struct msghdr *msg, uint64_t user_data) {
+    struct io_uring_sqe *sqe = get_sqe(u);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = 0;  // fixed file 0
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->addr = (uint64_t)(uintptr_t)msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+int uring_queue_sendmsg(uring *u, const struct msghdr *msg, uint64_t user_data) {
+    struct io_uring_sqe *sqe = get_sqe(u);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = 0;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = (uint64_t)(uintptr_t)msg;
+    sqe->len = 1;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+int uring_enter(uring *u, unsigned wait_nr, int timeout_ms) {
+    unsigned to_submit = u->sq_pending;
+    __atomic_store_n(u->sq_tail, *u->sq_tail + to_submit, __ATOMIC_RELEASE);
+    u->sq_pending = 0;
+
+    unsigned flags = u->enter_flags;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    void *argp = NULL;
+    size_t argsz = 0;
+    if (wait_nr > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+            memset(&arg, 0, sizeof(arg));
+            arg.sigmask_sz = _NSIG / 8;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argsz = sizeof(arg);
+        }
+    }
+    u->num_enters++;
+    if (sys_io_uring_enter(u->enter_fd, to_submit, wait_nr, flags, argp, argsz) < 0) {
+        if (errno == ETIME || errno == EINTR) {
+            return 0;
+        }
+        log_error("io_uring Error: io_uring_enter() failed: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int uring_recvmsg_datagram(const struct io_uring_cqe *cqe, const struct msghdr *msg, const dgram_ring *ring, int slot,
+                           unsigned char **payload, struct sockaddr_in **addr) {
+    unsigned char *buf = dgram_ring_req(ring, slot);
+    struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *)buf;
+    if ((size_t)cqe->res < sizeof(*out) + msg->msg_namelen + msg->msg_controllen || (out->flags & MSG_TRUNC) ||
+        out->namelen > msg->msg_namelen) {
+        return -1;
+    }
+    *addr = (struct sockaddr_in *)(buf + sizeof(*out));
+    *payload = buf + sizeof(*out) + msg->msg_namelen + msg->msg_controllen;
+    return (int)out->payloadlen;
+}
+
+void uring_free(uring *u) {
+    if (u->buf_ring) {
+        munmap(u->buf_ring, u->buf_ring_len);
+    }
+    if (u->sqes) {
+        munmap(u->sqes, u->sqes_len);
+    }
+    if (u->sq_map) {
+        munmap(u->sq_map, u->sq_map_len);
+    }
+    if (u->ring_fd >= 0) {
+        close(u->ring_fd);
+    }
+    memset(u, 0, sizeof(*u));
+    u->ring_fd = -1;
+}
@@ -0,0 +1,82 @@
+#include "wire.h"
+
+#include <stdint.h>
+#include <string.h>
+
+static inline unsigned char *put_u16(unsigned char *p, uint16_t v) {
+    p[0] = (unsigned char)(v >> 8);
+    p[1] = (unsigned char)v;
+    return p + 2;
+}
+
+static inline uint16_t get_u16(const unsigned char *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+int wire_encode_request(const request_packet *pkt, int payload_len, unsigned char *buf, size_t buf_len) {
+    if (payload_len < 0 || payload_len > LENGTH_MAX || buf_len < (size_t)(WIRE_REQUEST_MIN_LEN + payload_len)) {
+        return -1;
+    }
+    unsigned char *p = buf;
+    *p++ = WIRE_VERSION;
+    p = put_u16(p, (uint16_t)pkt->start_id);
+    *p++ = (unsigned char)pkt->client_id;
+    p = put_u16(p, (uint16_t)pkt->data);
+    *p++ = (unsigned char)pkt->seg_num;
+    *p++ = (unsigned char)pkt->length;
+    memcpy(p, pkt->payload, payload_len);
+    p += payload_len;
+    p = put_u16(p, (uint16_t)pkt->end_id);
+    return (int)(p - buf);
+}
+
+int wire_view_request(request_packet *pkt, const unsigned char *buf, size_t len, const unsigned char **payload) {
+    if (len < WIRE_REQUEST_MIN_LEN || len > WIRE_REQUEST_MAX_LEN || buf[0] != WIRE_VERSION) {
+        return -1;
+    }
+    pkt->start_id = (short)get_u16(buf + 1);
+    pkt->client_id = (char)buf[3];
+    pkt->data = (short)get_u16(buf + 4);
+    pkt->seg_num = (char)buf[6];
+    pkt->length = (char)buf[7];
+    pkt->end_id = (short)get_u16(buf + len - WIRE_REQUEST_TRAILER_LEN);
+    *payload = buf + WIRE_REQUEST_HEADER_LEN;
+    return (int)(len - WIRE_REQUEST_MIN_LEN);
+}
+
+int wire_decode_request(request_packet *pkt, const unsigned char *buf, size_t len) {
+    const unsigned char *payload;
+    int payload_len = wire_view_request(pkt, buf, len, &payload);
+    if (payload_len > 0) {
+        memcpy(pkt->payload, payload, payload_len);
+    }
+    return payload_len;
+}
+
+int wire_encode_response(const response_packet *pkt, unsigned char *buf, size_t buf_len) {
+    if (buf_len < WIRE_RESPONSE_LEN) {
+        return -1;
+    }
+    unsigned char *p = buf;
+    *p++ = WIRE_VERSION;
+    p = put_u16(p, (uint16_t)pkt->start_id);
+    *p++ = (unsigned char)pkt->client_id;
+    p = put_u16(p, (uint16_t)pkt->type);
+    p = put_u16(p, (uint16_t)pkt->rej_sub);
+    *p++ = (unsigned char)pkt->seg_num;
+    p = put_u16(p, (uint16_t)pkt->end_id);
+    return (int)(p - buf);
+}
+
+int wire_decode_response(response_packet *pkt, const unsigned char *buf, size_t len) {
+    if (len < WIRE_RESPONSE_LEN || buf[0] != WIRE_VERSION) {
+        return -1;
+    }
+    pkt->start_id = (short)get_u16(buf + 1);
+    pkt->client_id = (char)buf[3];
+    pkt->type = (short)get_u16(buf + 4);
+    pkt->rej_sub = (short)get_u16(buf + 6);
+    pkt->seg_num = (char)buf[8];
+    pkt->end_id = (short)get_u16(buf + 9);
+    return 0;
+}
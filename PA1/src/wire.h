@@ -0,0 +1,62 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stddef.h>
+
+#include "const.h"
+
+// On-the-wire encoding of request_packet and response_packet.
+// Fields are packed back to back with no padding, multi-byte fields in network byte order,
+// and every datagram starts with a version byte, so peers built for any ABI or byte order agree:
+//   request   version(1) start_id(2) client_id(1) data(2) seg_num(1) length(1) payload(0..LENGTH_MAX) end_id(2)
+//   response  version(1) start_id(2) client_id(1) type(2) rej_sub(2) seg_num(1) end_id(2)
+// A request only carries the payload bytes that are actually sent, and end_id is always the last two bytes
+// of the datagram, so the receiver learns the real payload size from the datagram size and can check the
+// length field against it.
+// Bump WIRE_VERSION whenever the layout changes.
+#define WIRE_VERSION 2
+
+#define WIRE_REQUEST_HEADER_LEN 8
+#define WIRE_REQUEST_TRAILER_LEN 2
+#define WIRE_REQUEST_MIN_LEN (WIRE_REQUEST_HEADER_LEN + WIRE_REQUEST_TRAILER_LEN)
+#define WIRE_REQUEST_MAX_LEN (WIRE_REQUEST_MIN_LEN + LENGTH_MAX)
+#define WIRE_RESPONSE_LEN 11
+
+/**
+ * Encode pkt into buf, which holds buf_len bytes, carrying the first payload_len bytes of pkt->payload.
+ * The length field is copied from pkt->length as is; normally it equals payload_len.
+ * Return the number of bytes written; -1 if payload_len exceeds LENGTH_MAX or buf is too small.
+*/
+int wire_encode_request(const request_packet *pkt, int payload_len, unsigned char *buf, size_t buf_len);
+
+/**
+ * Decode the datagram buf[0..len) into pkt.
+ * Return the number of payload bytes the datagram carried; -1 if it is truncated, too long,
+ * or has another wire version.
+*/
+int wire_decode_request(request_packet *pkt, const unsigned char *buf, size_t len);
+
+// Header and trailer fields that wire_view_request() decodes, in bytes.
+#define WIRE_REQUEST_FIELDS_LEN (WIRE_REQUEST_MIN_LEN - 1)
+
+/**
+ * Decode the header and trailer fields of the datagram buf[0..len) into pkt, like wire_decode_request(), but
+ * leave the payload where it is: *payload points at it inside buf, and pkt->payload is not written.
+ * Return the number of payload bytes the datagram carried; -1 if it is truncated, too long,
+ * or has another wire version.
+*/
+int wire_view_request(request_packet *pkt, const unsigned char *buf, size_t len, const unsigned char **payload);
+
+/**
+ * Encode pkt into buf, which holds buf_len bytes.
+ * Return the number of bytes written; -1 if buf is too small.
+*/
+int wire_encode_response(const response_packet *pkt, unsigned char *buf, size_t buf_len);
+
+/**
+ * Decode the datagram buf[0..len) into pkt.
+ * Return 0 on success; -1 if the datagram is truncated or has another wire version.
+*/
+int wire_decode_response(response_packet *pkt, const unsigned char *buf, size_t len);
+
+#endif
@@ -0,0 +1,196 @@
+#define _GNU_SOURCE
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "sub_layout.h"
+
+// Verification lookups (index probe, then technology and paid of the row) against a table in the
+// SUB_LAYOUT layout, with hardware cache counters around each pass. The Makefile builds one binary per
+// layout (bench_layout_soa, bench_layout_aos, bench_layout_hybrid); run them on the same table size.
+#define DEFAULT_ROWS 16000000
+#define BENCH_LOOKUPS 4000000
+
+// Counters read around each pass, all in one perf group so they cover the same interval.
+#define NUM_COUNTERS 3
+static const char *counter_names[NUM_COUNTERS] = {"L1D misses", "LLC misses", "dTLB misses"};
+static const struct {
+    unsigned int type;
+    unsigned long long config;
+} counter_events[NUM_COUNTERS] = {
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16},
+};
+
+static int counter_fds[NUM_COUNTERS] = {-1, -1, -1};
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned long next_rand(unsigned long *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+/**
+ * Open the counter group for this thread (user space only).
+ * Return 0 on success; -1 if perf events are not available (e.g. perf_event_paranoid, or a VM without a PMU).
+*/
+static int counters_open(void) {
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counter_events[i].type;
+        attr.config = counter_events[i].config;
+        attr.disabled = i == 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        counter_fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : counter_fds[0], 0);
+        if (counter_fds[i] < 0) {
+            log_warn("perf_event_open(%s) failed, reporting times only.", counter_names[i]);
+            for (int j = 0; j < i; j++) {
+                close(counter_fds[j]);
+                counter_fds[j] = -1;
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void counters_start(void) {
+    if (counter_fds[0] >= 0) {
+        ioctl(counter_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(counter_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+/**
+ * Stop the group and store its values in out. Return 0 on success; -1 if there are no counters.
+*/
+static int counters_stop(unsigned long long *out) {
+    if (counter_fds[0] < 0) {
+        return -1;
+    }
+    ioctl(counter_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    unsigned long long buf[1 + NUM_COUNTERS];  // nr, then one value per counter
+    if (read(counter_fds[0], buf, sizeof(buf)) != (ssize_t)sizeof(buf)) {
+        return -1;
+    }
+    memcpy(out, buf + 1, sizeof(unsigned long long) * NUM_COUNTERS);
+    return 0;
+}
+
+/**
+ * Verify every query against the table. With dependent set, each lookup waits for the outcome of the
+ * previous one (latency); otherwise the CPU overlaps independent lookups (throughput).
+ * Return ns per lookup and print the counters per lookup.
+*/
+static double run_pass(const char *name, const sub_index *idx, const sub_table *table, const unsigned long *queries, int dependent) {
+    unsigned long outcome = 0;
+    unsigned long long counts[NUM_COUNTERS];
+    counters_start();
+    double t0 = now_ns();
+    for (int i = 0; i < BENCH_LOOKUPS; i++) {
+        // outcome never reaches 0xFFFF, but the compiler cannot know, so the next key depends on it.
+        unsigned long key = queries[i] + (dependent && outcome == 0xFFFF);
+        int row = sub_table_find(idx, table, key);
+        if (row >= 0) {
+            outcome += (unsigned long)(unsigned char)sub_table_tech(table, row) * 2 + (unsigned char)sub_table_paid(table, row);
+        }
+    }
+    double ns = (now_ns() - t0) / BENCH_LOOKUPS;
+    printf("  %-6s %-11s %7.1f ns/lookup", sub_table_layout_name(), name, ns);
+    if (counters_stop(counts) == 0) {
+        for (int c = 0; c < NUM_COUNTERS; c++) {
+            printf(" | %s %5.2f", counter_names[c], (double)counts[c] / BENCH_LOOKUPS);
+        }
+        printf(" per lookup");
+    }
+    printf(" (checksum %lu)\n", outcome);
+    return ns;
+}
+
+int main(int argc, char **argv) {
+    // Usage: bench_layout [num_rows]
+    int len = argc > 1 ? atoi(argv[1]) : DEFAULT_ROWS;
+    if (len <= 0) {
+        log_error("Invalid table size %s. Stop.", argv[1]);
+        return -1;
+    }
+
+    // Same table as bench_lookup: even numbers 408xxxxxxx in random order, odd numbers are misses.
+    unsigned long state = 0x9E3779B97F4A7C15ULL;
+    sub_db db = {0};
+    db.sub_nums = malloc(sizeof(unsigned long) * len);
+    db.sub_techs = malloc(len);
+    db.sub_paid_arr = malloc(len);
+    unsigned long *queries = malloc(sizeof(unsigned long) * BENCH_LOOKUPS);
+    if (!db.sub_nums || !db.sub_techs || !db.sub_paid_arr || !queries) {
+        log_error("Bench Error: Could not allocate %d rows.", len);
+        return -1;
+    }
+    for (int i = 0; i < len; i++) {
+        db.sub_nums[i] = 4080000000UL + 2UL * (unsigned long)i;
+        db.sub_techs[i] = (char)(2 + i % 4);
+        db.sub_paid_arr[i] = i % 8 != 0;
+    }
+    for (int i = len - 1; i > 0; i--) {
+        int j = (int)(next_rand(&state) % (unsigned long)(i + 1));
+        unsigned long tmp = db.sub_nums[i];
+        db.sub_nums[i] = db.sub_nums[j];
+        db.sub_nums[j] = tmp;
+    }
+    db.len = db.cap = len;
+
+    sub_table table;
+    sub_index idx;
+    if (sub_table_build(&table, &db) < 0 || sub_index_build(&idx, db.sub_nums, len) < 0) {
+        return -1;
+    }
+    // The database columns are not touched again, so only the table's lines are counted.
+    free(db.sub_nums);
+    free(db.sub_techs);
+    free(db.sub_paid_arr);
+
+    int have_counters = counters_open() == 0;
+    printf("%s layout, %d rows, %d lookups per pass%s\n", sub_table_layout_name(), len, BENCH_LOOKUPS,
+           have_counters ? "" : " (no perf counters)");
+
+    // Hits only: every lookup reads the key and both attributes of a random row.
+    for (int i = 0; i < BENCH_LOOKUPS; i++) {
+        unsigned long r = next_rand(&state);
+        queries[i] = 4080000000UL + 2UL * (r % (unsigned long)len);
+    }
+    run_pass("hits", &idx, &table, queries, 0);
+    run_pass("hits (dep)", &idx, &table, queries, 1);
+    // Misses only: stopped by the Bloom filter, so the layout should not matter.
+    for (int i = 0; i < BENCH_LOOKUPS; i++) {
+        queries[i] |= 1;
+    }
+    run_pass("misses", &idx, &table, queries, 0);
+
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        if (counter_fds[i] >= 0) {
+            close(counter_fds[i]);
+        }
+    }
+    sub_index_free(&idx);
+    sub_table_free(&table);
+    free(queries);
+    return 0;
+}
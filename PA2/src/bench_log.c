@@ -0,0 +1,148 @@
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "const.h"
+#include "log.h"
+#include "sub_index.h"
+#include "verify.h"
+#include "wire.h"
+
+// Runs the server's per-packet work (format the client address, log the arrival, verify the datagram
+// in its receive slot against the database, which logs the outcome) over synthetic requests, once per
+// runtime log level.
+// Log output goes to /dev/null so the cost measured is formatting and locking, not the terminal.
+// Build with -DLOG_MIN_LEVEL=3 (the bench_log_min target) to see log_info compiled out.
+#define BENCH_ROWS 100000
+#define BENCH_PACKETS 1000000
+#define BENCH_ROUNDS 3
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned long next_rand(unsigned long *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Same lock as the multi-threaded server installs, taken for every event that is written.
+static void log_lock(bool lock, void *udata) {
+    if (lock) {
+        pthread_mutex_lock(udata);
+    } else {
+        pthread_mutex_unlock(udata);
+    }
+}
+
+/**
+ * Process every encoded request the way the server loop does, BENCH_ROUNDS times: copy it into a receive
+ * slot (as recvmmsg() would) and answer it there with verify_datagram(). Return the best ns per packet.
+*/
+static double run_packets(const sub_db *db, const sub_index *idx, const unsigned char (*reqs)[WIRE_MESSAGE_LEN], int num_reqs) {
+    struct sockaddr_in client_addr;
+    client_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    char client_ip[INET_ADDRSTRLEN];
+    unsigned char slot[WIRE_MESSAGE_LEN];
+    unsigned char rsp[WIRE_BATCH_RESPONSE_MAX_LEN];
+    unsigned char *out;
+    unsigned long copied = 0;
+    unsigned long accepted = 0;
+
+    double best = 0;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        double t0 = now_ns();
+        for (int i = 0; i < num_reqs; i++) {
+            inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
+            log_info("Message received from client ip = %s", client_ip);
+            memcpy(slot, reqs[i], WIRE_MESSAGE_LEN);
+            int out_len = verify_datagram(db, idx, slot, WIRE_MESSAGE_LEN, rsp, &out, &copied);
+            accepted += out_len > 0 && wire_peek_type(out, out_len) == ACC_OK;
+        }
+        double ns = (now_ns() - t0) / num_reqs;
+        if (round == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    if (accepted == 0) {
+        printf("(no request accepted)\n");  // keeps the loop from being optimized away
+    }
+    return best;
+}
+
+int main(void) {
+    unsigned long state = 0x9E3779B97F4A7C15ULL;
+
+    // Subscriber rows 408xxxxxxx with even numbers, every 8th one unpaid, techs 2..5.
+    sub_db db = {0};
+    db.sub_nums = malloc(sizeof(unsigned long) * BENCH_ROWS);
+    db.sub_techs = malloc(BENCH_ROWS);
+    db.sub_paid_arr = malloc(BENCH_ROWS);
+    unsigned char (*reqs)[WIRE_MESSAGE_LEN] = malloc(sizeof(*reqs) * BENCH_PACKETS);
+    if (!db.sub_nums || !db.sub_techs || !db.sub_paid_arr || !reqs) {
+        log_error("Bench Error: Could not allocate the synthetic database.");
+        return -1;
+    }
+    for (int i = 0; i < BENCH_ROWS; i++) {
+        db.sub_nums[i] = 4080000000UL + 2UL * (unsigned long)i;
+        db.sub_techs[i] = (char)(2 + i % 4);
+        db.sub_paid_arr[i] = i % 8 != 0;
+    }
+    db.len = db.cap = BENCH_ROWS;
+    sub_index idx;
+    if (sub_index_build(&idx, db.sub_nums, db.len) < 0) {
+        return -1;
+    }
+
+    // Mostly valid requests, with some unknown subscribers (odd numbers) and wrong technologies.
+    for (int i = 0; i < BENCH_PACKETS; i++) {
+        int row = (int)(next_rand(&state) % BENCH_ROWS);
+        message_packet req;
+        req.start_id = START_ID;
+        req.client_id = CLIENT_ID;
+        req.type = ACC_PER;
+        req.seg_num = (char)i;
+        req.length = WIRE_MESSAGE_PAYLOAD_LEN;
+        req.sub_num = db.sub_nums[row] + (i % 10 == 0);
+        req.technology = i % 10 == 1 ? (char)6 : db.sub_techs[row];
+        req.end_id = END_ID;
+        wire_encode_message(&req, reqs[i], WIRE_MESSAGE_LEN);
+    }
+
+    if (!freopen("/dev/null", "w", stderr)) {
+        log_error("Bench Error: Could not redirect stderr.");
+        return -1;
+    }
+    log_set_lock(log_lock, &log_mutex);
+
+    printf("log_info %s (LOG_MIN_LEVEL %d), best of %d x %d packets per level\n",
+           LOG_MIN_LEVEL > LOG_INFO ? "compiled out" : "compiled in", LOG_MIN_LEVEL, BENCH_ROUNDS, BENCH_PACKETS);
+    run_packets(&db, &idx, reqs, BENCH_PACKETS / 10);  // warm up the index and the page cache
+    static const int levels[] = {LOG_TRACE, LOG_INFO, LOG_WARN, LOG_ERROR, LOG_FATAL};
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+        log_set_level(levels[i]);
+        printf("  level %-5s  sync  %8.1f ns/packet\n", log_level_string(levels[i]), run_packets(&db, &idx, reqs, BENCH_PACKETS));
+    }
+    log_set_level(LOG_TRACE);
+    if (log_async_start(LOG_ASYNC_DEFAULT_CAPACITY) == 0) {
+        double ns = run_packets(&db, &idx, reqs, BENCH_PACKETS);
+        log_async_stop();
+        printf("  level %-5s  async %8.1f ns/packet (%lu messages dropped)\n", log_level_string(LOG_TRACE), ns, log_async_dropped());
+    }
+
+    sub_index_free(&idx);
+    free(reqs);
+    free(db.sub_nums);
+    free(db.sub_techs);
+    free(db.sub_paid_arr);
+    return 0;
+}
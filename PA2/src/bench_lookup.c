@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "log.h"
+#include "sub_index.h"
+
+// Table sizes measured when no sizes are given on the command line.
+static const int default_sizes[] = {1000, 1000000, 50000000};
+
+// Upper bound on the number of subscriber numbers compared by find() per table size,
+// so that the linear scan at 50M entries still finishes in a few seconds.
+#define LINEAR_SCAN_BUDGET 2000000000ULL
+#define INDEX_LOOKUPS 4000000
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * xorshift64* PRNG, good enough to scatter lookups across the table.
+*/
+static unsigned long next_rand(unsigned long *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+/**
+ * Fill sub_nums with distinct 10-digit subscriber numbers 408xxxxxxx in random order.
+ * Even numbers are present in the table, odd numbers are used as misses.
+*/
+static void fill_table(unsigned long *sub_nums, int len, unsigned long *state) {
+    for (int i = 0; i < len; i++) {
+        sub_nums[i] = 4080000000UL + 2UL * (unsigned long)i;
+    }
+    for (int i = len - 1; i > 0; i--) {
+        int j = (int)(next_rand(state) % (unsigned long)(i + 1));
+        unsigned long tmp = sub_nums[i];
+        sub_nums[i] = sub_nums[j];
+        sub_nums[j] = tmp;
+    }
+}
+
+/**
+ * Build the query list: half hits drawn from the table, half misses.
+*/
+static void fill_queries(unsigned long *queries, int num_queries, const unsigned long *sub_nums, int len, unsigned long *state) {
+    for (int i = 0; i < num_queries; i++) {
+        unsigned long r = next_rand(state);
+        queries[i] = sub_nums[r % (unsigned long)len] + (i & 1);
+    }
+}
+
+static void bench_size(int len) {
+    unsigned long state = 0x9E3779B97F4A7C15ULL ^ (unsigned long)len;
+    unsigned long *sub_nums = malloc(sizeof(unsigned long) * len);
+    unsigned long *queries = malloc(sizeof(unsigned long) * INDEX_LOOKUPS);
+    if (!sub_nums || !queries) {
+        log_error("Bench Error: Could not allocate %d entries.", len);
+        exit(EXIT_FAILURE);
+    }
+    fill_table(sub_nums, len, &state);
+    fill_queries(queries, INDEX_LOOKUPS, sub_nums, len, &state);
+
+    // Build the index once, timed separately from the lookups.
+    sub_index idx;
+    double t0 = now_ns();
+    if (sub_index_build(&idx, sub_nums, len) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    double build_ns = now_ns() - t0;
+
+    // find(): limit the number of queries so the total work stays within the scan budget.
+    unsigned long linear_lookups = LINEAR_SCAN_BUDGET / (unsigned long)len;
+    if (linear_lookups > INDEX_LOOKUPS) {
+        linear_lookups = INDEX_LOOKUPS;
+    } else if (linear_lookups < 8) {
+        linear_lookups = 8;
+    }
+    long linear_hits = 0;
+    t0 = now_ns();
+    for (unsigned long i = 0; i < linear_lookups; i++) {
+        linear_hits += find(sub_nums, len, queries[i]) >= 0;
+    }
+    double linear_ns = (now_ns() - t0) / linear_lookups;
+
+    long index_hits = 0;
+    t0 = now_ns();
+    for (int i = 0; i < INDEX_LOOKUPS; i++) {
+        index_hits += sub_index_find(&idx, sub_nums, queries[i]) >= 0;
+    }
+    double index_ns = (now_ns() - t0) / INDEX_LOOKUPS;
+
+    // Misses only (the odd queries), answered with the Bloom filter, then with the filter switched off.
+    double miss_ns[2];
+    sub_bloom bloom = idx.bloom;
+    for (int pass = 0; pass < 2; pass++) {
+        idx.bloom.words = pass == 0 ? bloom.words : NULL;
+        t0 = now_ns();
+        for (int i = 1; i < INDEX_LOOKUPS; i += 2) {
+            index_hits += sub_index_find(&idx, sub_nums, queries[i]) >= 0;
+        }
+        miss_ns[pass] = (now_ns() - t0) / (INDEX_LOOKUPS / 2);
+    }
+    idx.bloom = bloom;
+    sub_index_stats st;
+    sub_index_stats_take(&st);
+
+    printf("%10d entries | build %8.1f ms | find() %12.1f ns/lookup (%lu lookups, %ld hits) | "
+           "index %6.1f ns/lookup (%d lookups, %ld hits) | speedup %.0fx | "
+           "misses %5.1f ns with filter, %5.1f ns without (%.2f%% false positives)\n",
+           len, build_ns / 1e6, linear_ns, linear_lookups, linear_hits,
+           index_ns, INDEX_LOOKUPS, index_hits, linear_ns / index_ns,
+           miss_ns[0], miss_ns[1], st.bloom_rejects + st.false_positives > 0 ? 100.0 * st.false_positives / (st.bloom_rejects + st.false_positives) : 0.0);
+
+    sub_index_free(&idx);
+    free(queries);
+    free(sub_nums);
+}
+
+int main(int argc, char **argv) {
+    // Usage: bench_lookup [num_entries ...]
+    if (argc < 2) {
+        for (size_t i = 0; i < sizeof(default_sizes) / sizeof(default_sizes[0]); i++) {
+            bench_size(default_sizes[i]);
+        }
+    } else {
+        for (int i = 1; i < argc; i++) {
+            int len = atoi(argv[i]);
+            if (len <= 0) {
+                log_error("Invalid table size %s. Stop.", argv[i]);
+                return -1;
+            }
+            bench_size(len);
+        }
+    }
+    return 0;
+}
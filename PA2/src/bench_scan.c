@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "log.h"
+#include "sub_scan.h"
+
+// Full-table scans at every kernel level this CPU supports: find() over the subscriber numbers
+// (worst case, a miss), and filtered count/select queries over the technology and paid columns.
+#define DEFAULT_ROWS 10000000
+#define BENCH_ROUNDS 5
+#define SELECT_CHUNK 4096
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned long next_rand(unsigned long *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+/**
+ * Select every matching row, SELECT_CHUNK rows at a time. Return the number of rows.
+*/
+static long select_all(const sub_db *db, const sub_filter *filter, int *rows) {
+    long total = 0;
+    int from = 0;
+    while (from < db->len) {
+        total += sub_scan_select(db, filter, from, rows, SELECT_CHUNK, &from);
+    }
+    return total;
+}
+
+int main(int argc, char **argv) {
+    // Usage: bench_scan [num_rows]
+    int len = argc > 1 ? atoi(argv[1]) : DEFAULT_ROWS;
+    if (len <= 0) {
+        log_error("Invalid table size %s. Stop.", argv[1]);
+        return -1;
+    }
+
+    // Techs 2..5 at random, one in 8 unpaid, one in 100 deleted (INVALID_TECHNOLOGY).
+    unsigned long state = 0x9E3779B97F4A7C15ULL;
+    sub_db db = {0};
+    db.sub_nums = malloc(sizeof(unsigned long) * len);
+    db.sub_techs = malloc(len);
+    db.sub_paid_arr = malloc(len);
+    int *rows = malloc(sizeof(int) * SELECT_CHUNK);
+    if (!db.sub_nums || !db.sub_techs || !db.sub_paid_arr || !rows) {
+        log_error("Bench Error: Could not allocate %d rows.", len);
+        return -1;
+    }
+    for (int i = 0; i < len; i++) {
+        unsigned long r = next_rand(&state);
+        db.sub_nums[i] = 4080000000UL + 2UL * (unsigned long)i;
+        db.sub_techs[i] = r % 100 == 0 ? 0 : (char)(2 + (r >> 8) % 4);
+        db.sub_paid_arr[i] = (r >> 16) % 8 != 0;
+    }
+    db.len = db.cap = len;
+
+    static const struct {
+        const char *name;
+        sub_filter filter;
+    } queries[] = {
+        {"live", {SUB_SCAN_ANY, SUB_SCAN_ANY}},
+        {"unpaid", {SUB_SCAN_ANY, 0}},
+        {"4G", {4, SUB_SCAN_ANY}},
+        {"unpaid 4G", {4, 0}},
+    };
+    int num_queries = sizeof(queries) / sizeof(queries[0]);
+
+    printf("%d rows, best of %d scans per kernel\n", len, BENCH_ROUNDS);
+    long expected[sizeof(queries) / sizeof(queries[0])];
+    for (int level = SUB_SCAN_SCALAR; level <= SUB_SCAN_AVX2; level++) {
+        if (sub_scan_use(level) < 0) {
+            printf("  %-6s not supported by this CPU\n", sub_scan_level_name(level));
+            continue;
+        }
+        // find() of a subscriber number that is not in the table reads the whole column.
+        double best = 0;
+        for (int round = 0; round < BENCH_ROUNDS; round++) {
+            double t0 = now_ns();
+            int hit = sub_scan_find(db.sub_nums, len, 1UL);
+            double ns = now_ns() - t0;
+            if (hit >= 0) {
+                printf("(unexpected hit)\n");
+            }
+            if (round == 0 || ns < best) {
+                best = ns;
+            }
+        }
+        printf("  %-6s find   %8.2f ms  %6.2f GB/s\n", sub_scan_level_name(level), best / 1e6, len * sizeof(unsigned long) / best);
+
+        for (int q = 0; q < num_queries; q++) {
+            double best_count = 0, best_select = 0;
+            long count = 0, selected = 0;
+            for (int round = 0; round < BENCH_ROUNDS; round++) {
+                double t0 = now_ns();
+                count = sub_scan_count(&db, &queries[q].filter);
+                double ns = now_ns() - t0;
+                best_count = round == 0 || ns < best_count ? ns : best_count;
+                t0 = now_ns();
+                selected = select_all(&db, &queries[q].filter, rows);
+                ns = now_ns() - t0;
+                best_select = round == 0 || ns < best_select ? ns : best_select;
+            }
+            if (level == SUB_SCAN_SCALAR) {
+                expected[q] = count;
+            }
+            // Bytes read: the technology column, plus the paid column when it is filtered on.
+            double bytes = (double)len * (queries[q].filter.paid == SUB_SCAN_ANY ? 1 : 2);
+            printf("  %-6s %-10s count %6.2f ms %6.2f GB/s | select %6.2f ms %6.2f GB/s | %ld rows%s\n",
+                   sub_scan_level_name(level), queries[q].name, best_count / 1e6, bytes / best_count,
+                   best_select / 1e6, bytes / best_select, count,
+                   count != expected[q] || selected != count ? " MISMATCH" : "");
+        }
+    }
+
+    free(rows);
+    free(db.sub_nums);
+    free(db.sub_techs);
+    free(db.sub_paid_arr);
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "const.h"
+#include "wire.h"
+
+// Cost of encoding and decoding message_packet in the wire format, against the memcpy of the raw
+// struct that used to be sent, plus the bytes each puts on the wire.
+#define WIRE_ROUNDS 10000000
+#define WIRE_RING 256  // packets cycled through, so the compiler cannot hoist the work out of the loop
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void) {
+    static message_packet pkts[WIRE_RING];
+    static unsigned char bufs[WIRE_RING][sizeof(message_packet) > WIRE_MESSAGE_LEN ? sizeof(message_packet) : WIRE_MESSAGE_LEN];
+    for (int i = 0; i < WIRE_RING; i++) {
+        pkts[i].start_id = START_ID;
+        pkts[i].client_id = CLIENT_ID;
+        pkts[i].type = ACC_PER;
+        pkts[i].seg_num = (char)i;
+        pkts[i].length = WIRE_MESSAGE_PAYLOAD_LEN;
+        pkts[i].technology = (char)(2 + i % 4);
+        pkts[i].sub_num = 4085546805UL + (unsigned long)i;
+        pkts[i].end_id = END_ID;
+    }
+
+    unsigned long check = 0;
+    double t0 = now_ns();
+    for (int i = 0; i < WIRE_ROUNDS; i++) {
+        memcpy(bufs[i % WIRE_RING], &pkts[i % WIRE_RING], sizeof(message_packet));
+        check += bufs[i % WIRE_RING][i & 7];
+    }
+    double raw_ns = (now_ns() - t0) / WIRE_ROUNDS;
+
+    t0 = now_ns();
+    for (int i = 0; i < WIRE_ROUNDS; i++) {
+        check += wire_encode_message(&pkts[i % WIRE_RING], bufs[i % WIRE_RING], sizeof(bufs[0]));
+    }
+    double encode_ns = (now_ns() - t0) / WIRE_ROUNDS;
+
+    message_packet out;
+    t0 = now_ns();
+    for (int i = 0; i < WIRE_ROUNDS; i++) {
+        wire_decode_message(&out, bufs[i % WIRE_RING], WIRE_MESSAGE_LEN);
+        check += out.sub_num;
+    }
+    double decode_ns = (now_ns() - t0) / WIRE_ROUNDS;
+
+    if (out.sub_num != pkts[(WIRE_ROUNDS - 1) % WIRE_RING].sub_num || out.technology != pkts[(WIRE_ROUNDS - 1) % WIRE_RING].technology) {
+        printf("round trip mismatch\n");
+        return -1;
+    }
+    printf("message_packet: struct %zu bytes, wire %d bytes (%.0f%% smaller)\n",
+           sizeof(message_packet), WIRE_MESSAGE_LEN, 100.0 * (1.0 - (double)WIRE_MESSAGE_LEN / sizeof(message_packet)));
+    printf("  raw memcpy %6.2f ns/packet | encode %6.2f ns/packet | decode %6.2f ns/packet (check %lu)\n",
+           raw_ns, encode_ns, decode_ns, check & 0xFF);
+    return 0;
+}
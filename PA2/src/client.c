@@ -1,4 +1,5 @@
 #include <arpa/inet.h>
+#include <getopt.h>
 #include <math.h>
 #include <netdb.h>
 #include <netinet/in.h>
@@ -11,72 +12,239 @@
 #include <unistd.h>
 
 #include "const.h"
+#include "load.h"
 #include "log.h"
+#include "rtt.h"
+#include "sub_db.h"
+#include "wire.h"
+
+/**
+ * Encode pkt in the wire format (wire.h) and send it to server_addr.
+ * Return the number of bytes sent; -1 on error.
+*/
+static int send_message(int sock_fd, const message_packet *pkt, struct sockaddr_in *server_addr) {
+    unsigned char buf[WIRE_MESSAGE_LEN];
+    int len = wire_encode_message(pkt, buf, sizeof(buf));
+    return (int)sendto(sock_fd, buf, len, 0, (struct sockaddr *)server_addr, sizeof(struct sockaddr_in));
+}
+
+/**
+ * Receive one datagram from the socket and decode it into pkt.
+ * Return the number of bytes received; 0 if the datagram was empty or malformed (pkt is not filled); -1 on error.
+*/
+static int recv_message(int sock_fd, message_packet *pkt, struct sockaddr_in *server_addr) {
+    unsigned char buf[WIRE_MESSAGE_LEN];
+    socklen_t addr_len = sizeof(struct sockaddr_in);
+    int recv_len = (int)recvfrom(sock_fd, buf, sizeof(buf), 0, (struct sockaddr *)server_addr, &addr_len);
+    if (recv_len <= 0) {
+        return recv_len;
+    }
+    if (wire_decode_message(pkt, buf, recv_len) < 0) {
+        log_warn("Ignoring malformed response of %d bytes (want %d bytes, wire version %d).", recv_len, WIRE_MESSAGE_LEN, WIRE_VERSION);
+        return 0;
+    }
+    return recv_len;
+}
+
+/**
+ * Log the number of subscribers verified per second since start_us.
+*/
+static void report_throughput(const char *mode, int num_queries, int num_datagrams, long start_us) {
+    double elapsed_ms = (rtt_now_us() - start_us) / 1000.0;
+    log_info("%s: verified %d subscribers in %d datagrams in %.1f ms (%.0f subscribers/s)",
+             mode, num_queries, num_datagrams, elapsed_ms, elapsed_ms > 0 ? num_queries * 1000.0 / elapsed_ms : 0.0);
+}
+
+/**
+ * Verify the num_pkts queries of dp_arr batch_size at a time with ACC_PER_BATCH requests, stop-and-wait per batch
+ * with the same adaptive retransmission as the single-query loop.
+ * Return 0 if every batch was answered; -1 otherwise.
+*/
+static int verify_batched(int sock_fd, struct sockaddr_in *server_addr, const message_packet *dp_arr, int num_pkts, int batch_size, rtt_estimator *rtt) {
+    static const char *result_names[] = {"ACCESS OKAY", "NOT_PAID", "NOT_EXIST", "NOT_EXIST (incorrect technology)"};
+    unsigned char out_buf[WIRE_BATCH_REQUEST_MAX_LEN];
+    unsigned char in_buf[WIRE_BATCH_RESPONSE_MAX_LEN];
+    batch_packet req, rsp;
+    int num_results[4] = {0};
+    int num_batches = 0;
+    struct pollfd client_timer_pollfd;
+    client_timer_pollfd.fd = sock_fd;
+    client_timer_pollfd.events = POLLIN;
+    long start_us = rtt_now_us();
+
+    for (int first = 0; first < num_pkts; first += batch_size, num_batches++) {
+        req.start_id = START_ID;
+        req.client_id = CLIENT_ID;
+        req.type = ACC_PER_BATCH;
+        req.seg_num = (char)num_batches;
+        req.count = num_pkts - first < batch_size ? num_pkts - first : batch_size;
+        req.end_id = END_ID;
+        for (int i = 0; i < req.count; i++) {
+            req.technology[i] = dp_arr[first + i].technology;
+            req.sub_num[i] = dp_arr[first + i].sub_num;
+        }
+        int out_len = wire_encode_batch_request(&req, out_buf, sizeof(out_buf));
+
+        int attempt_counter = 1;
+        long sent_us = rtt_now_us();
+        if (sendto(sock_fd, out_buf, out_len, 0, (struct sockaddr *)server_addr, sizeof(struct sockaddr_in)) < 0) {
+            log_error("Error: sendto() batch %d", num_batches);
+            return -1;
+        }
+        while (TRUE) {
+            int poll_res = poll(&client_timer_pollfd, 1, rtt_timeout_ms(rtt));
+            if (poll_res < 0) {
+                log_error("Client Experienced Error in Polling. Stop.");
+                return -1;
+            } else if (poll_res == 0) {
+                rtt_backoff(rtt);
+                if (++attempt_counter > CLIENT_MAX_ATTEMPTS) {
+                    log_error("Retry timeout: Client attmpted to send batch %d %d times and failed to get any responses from server. Quit.", num_batches, CLIENT_MAX_ATTEMPTS);
+                    return -1;
+                }
+                log_info("No Response from Server for batch %d. Attempt %d, RTO %d ms. Retransmitting...", num_batches, attempt_counter, rtt_timeout_ms(rtt));
+                if (sendto(sock_fd, out_buf, out_len, 0, (struct sockaddr *)server_addr, sizeof(struct sockaddr_in)) < 0) {
+                    log_error("Client experienced error in sending batch %d to Server.", num_batches);
+                    return -1;
+                }
+                continue;
+            }
+            socklen_t addr_len = sizeof(struct sockaddr_in);
+            int recv_len = (int)recvfrom(sock_fd, in_buf, sizeof(in_buf), 0, (struct sockaddr *)server_addr, &addr_len);
+            if (recv_len < 0) {
+                log_error("Client Experienced Error in Receiving batch response from Server.");
+                return -1;
+            }
+            // A late answer to an earlier transmission has another seg_num: skip it and keep waiting.
+            if (wire_peek_type(in_buf, recv_len) != ACC_RESULTS || wire_decode_batch_response(&rsp, in_buf, recv_len) < 0 ||
+                rsp.seg_num != req.seg_num || rsp.count != req.count) {
+                log_warn("Ignoring unexpected response of %d bytes while waiting for batch %d.", recv_len, num_batches);
+                continue;
+            }
+            if (attempt_counter == 1) {  // Karn's algorithm: retransmitted batches give ambiguous samples
+                rtt_sample(rtt, rtt_now_us() - sent_us);
+            }
+            break;
+        }
+
+        for (int i = 0; i < rsp.count; i++) {
+            num_results[rsp.result[i]]++;
+            log_debug("Packet %d (sub#: %lu): %s", first + i, req.sub_num[i], result_names[rsp.result[i]]);
+        }
+    }
+
+    log_info("Batched results: %d ACCESS OKAY, %d NOT_PAID, %d NOT_EXIST, %d incorrect technology",
+             num_results[VERIFY_OK], num_results[VERIFY_NOT_PAID], num_results[VERIFY_NOT_EXIST], num_results[VERIFY_WRONG_TECH]);
+    char mode[32];
+    snprintf(mode, sizeof(mode), "Batch %d", batch_size);
+    report_throughput(mode, num_pkts, num_batches, start_us);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--batch N] [port]\n", prog);
+    fprintf(stderr, "       %s --load M [--depth N] [--duration S] [--mix HIT,MISS,UNPAID] [--zipf S] [port]\n", prog);
+    fprintf(stderr, "  -b, --batch N     verify N subscribers per ACC_PER_BATCH datagram, 1..%d (default: one ACC_PER per datagram)\n", MAX_VERIFY_BATCH);
+    fprintf(stderr, "  -l, --load M      instead of the test cases, load the server from M threads, each with its own socket and client_id\n");
+    fprintf(stderr, "  -D, --depth N     requests each load thread keeps outstanding, 1..%d (default: 1)\n", LOAD_MAX_DEPTH);
+    fprintf(stderr, "  -d, --duration S  seconds of load (default: %d)\n", LOAD_DEFAULT_DURATION_S);
+    fprintf(stderr, "  -m, --mix H,M,U   relative weights of paid, unknown and unpaid subscribers (default: 80,10,10)\n");
+    fprintf(stderr, "  -z, --zipf S      Zipf exponent of subscriber popularity (default: 0, uniform)\n");
+}
 
 int main(int argc, char **argv) {
     // ======================== CLI ARGS PARSING ========================
     int port = DEFAULT_SERVER_PORT;
+    int batch_size = 0;  // subscribers per batched request, 0 = one ACC_PER request per subscriber
+    load_opts load = {.num_workers = 0, .depth = 1, .duration_s = LOAD_DEFAULT_DURATION_S, .mix = {80, 10, 10}, .zipf = 0};
+    static const struct option long_opts[] = {
+        {"batch", required_argument, NULL, 'b'},
+        {"load", required_argument, NULL, 'l'},
+        {"depth", required_argument, NULL, 'D'},
+        {"duration", required_argument, NULL, 'd'},
+        {"mix", required_argument, NULL, 'm'},
+        {"zipf", required_argument, NULL, 'z'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "b:l:D:d:m:z:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'b':
+                batch_size = atoi(optarg);
+                if (batch_size < 1 || batch_size > MAX_VERIFY_BATCH) {
+                    log_fatal("Invalid batch size %s, must be 1..%d.", optarg, MAX_VERIFY_BATCH);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'l':
+                load.num_workers = atoi(optarg);
+                if (load.num_workers < 1 || load.num_workers > MAX_ID + 1) {
+                    log_fatal("Invalid number of load threads %s, must be 1..%d.", optarg, MAX_ID + 1);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'D':
+                load.depth = atoi(optarg);
+                if (load.depth < 1 || load.depth > LOAD_MAX_DEPTH) {
+                    log_fatal("Invalid depth %s, must be 1..%d.", optarg, LOAD_MAX_DEPTH);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'd':
+                load.duration_s = atoi(optarg);
+                if (load.duration_s < 1) {
+                    log_fatal("Invalid duration %s, must be at least 1 second.", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'm':
+                if (load_parse_mix(optarg, load.mix) < 0) {
+                    log_fatal("Invalid mix %s, must be three weights HIT,MISS,UNPAID, not all 0.", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'z':
+                load.zipf = atof(optarg);
+                if (load.zipf < 0) {
+                    log_fatal("Invalid Zipf exponent %s, must be at least 0.", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                usage(argv[0]);
+                exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
     // Set port from command line argument
-    if (argc < 2) {
+    if (optind >= argc) {
         log_info("Using default port %d <port>", DEFAULT_SERVER_PORT);
     } else {
-        log_info("Using port %s", argv[1]);
-        port = atoi(argv[1]);
+        log_info("Using port %s", argv[optind]);
+        port = atoi(argv[optind]);
     }
 
     // ======================== DB FILE PARSING ========================
-    char buffer[128] = {0};  // a buffer to store intermediary string for parsing
-    int db_len;              // Number of entries in db
-    char wc_command[50];
-    strcpy(wc_command, "wc -l ");
-    FILE *db_wc = popen(strcat(wc_command, DB_FILE_NAME), "r");
-    if (!db_wc) {
-        log_error("DB Error: Could not get num entries in DB. Quit.");
-        return -1;
-    }
-    fscanf(db_wc, "%s", buffer);
-    db_len = atoi(buffer);
-    pclose(db_wc);
-
-    // parse the following field arrays from database file
-    unsigned long sub_nums[db_len];  // all subscriber numbers in the database
-    char sub_techs[db_len];          // technology which each subscribers is using
-    char sub_paid_arr[db_len];       // subscribers payment status (1 = paid, 0 = not paid).
-
-    // The following are just variables for getting the data out.
-    size_t len = 0;
-    ssize_t read;
-    char *line = NULL;
-    char *token = NULL;
-    int idx = 0;
-    char *end_ptr;
-
-    FILE *input_dbfile = fopen(DB_FILE_NAME, "r");
-    if (!input_dbfile) {
-        log_error("DB Error: Could not open %s. Quit.", DB_FILE_NAME);
+    sub_db db;  // all subscriber numbers, technologies and payment status in the database
+    if (sub_db_load_text(&db, DB_FILE_NAME) < 0) {
+        log_error("DB Error: Could not load %s. Quit.", DB_FILE_NAME);
         return -1;
     }
-    while ((read = getline(&line, &len, input_dbfile)) != -1) {
-        token = strtok(line, " ");  // this grabs the subscriber-number and puts it into "token"
-        // Skip any non-numeric characters in the subscriber numer, example '-' or '.'
-        int j = 0;
-        for (int k = 0; k < strlen(token); k++) {
-            if (token[k] >= '0' && token[k] <= '9') {
-                buffer[j++] = token[k];
-            }
-        }
-        buffer[j] = '\0';
-        sub_nums[idx] = strtoul(buffer, &end_ptr, 10);      // Parse substriber number and save to an unsigned long (4bytes)
-        sub_techs[idx] = (char)atoi(strtok(NULL, " "));     // Parse technology field
-        sub_paid_arr[idx] = (char)atoi(strtok(NULL, " "));  // Parse paid field
-        idx++;
+
+    // ======================== LOAD MODE ========================
+    if (load.num_workers > 0) {
+        struct sockaddr_in load_addr;
+        memset(&load_addr, 0, sizeof(load_addr));
+        load_addr.sin_family = AF_INET;
+        load_addr.sin_port = htons(port);
+        int ret = load_run(&db, &load_addr, &load);
+        sub_db_free(&db);
+        return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
     }
-    fclose(input_dbfile);  // done with the data-base file. We can close it now.
 
     // ======================== INIT VARIABLES AND SOCKETS ========================
     struct sockaddr_in client_addr, server_addr;  // sock addresses for client and server.
     int sock_fd;                                  // fd for socket
-    socklen_t addr_len = sizeof(client_addr);     // length of a sockaddr_in
     int recv_len;                                 // variable to hold length of received message packet
     message_packet server_pkt;                    // struct to hold return packet from server
     message_packet client_pkt;                    // struct for data packet being sent to server
@@ -113,45 +281,83 @@ int main(int argc, char **argv) {
     client_timer_pollfd.events = POLLIN;  // notes anything coming in on the socket
 
     // Here, we fill out an array of data-packets containing the Test Cases we want to send the Server
-    message_packet dp_arr[db_len + 1];
+    int db_len = db.len;  // Number of entries in db
+    if (db_len < 3) {
+        log_error("DB Error: The test cases need at least 3 subscribers in %s. Quit.", DB_FILE_NAME);
+        return -1;
+    }
+    message_packet *dp_arr = malloc(sizeof(message_packet) * (db_len + 1));
+    if (!dp_arr) {
+        log_fatal("Could not allocate %d test packets.", db_len + 1);
+        exit(EXIT_FAILURE);
+    }
     for (int i = 0; i < db_len; i++) {
         dp_arr[i].start_id = START_ID;
         dp_arr[i].client_id = CLIENT_ID;
         dp_arr[i].type = ACC_PER;
         dp_arr[i].end_id = END_ID;
         dp_arr[i].seg_num = i;
-        dp_arr[i].technology = sub_techs[i];
-        dp_arr[i].sub_num = sub_nums[i];
-        dp_arr[i].length = sizeof(dp_arr[i].technology) + sizeof(dp_arr[i].sub_num);
+        dp_arr[i].technology = db.sub_techs[i];
+        dp_arr[i].sub_num = db.sub_nums[i];
+        dp_arr[i].length = WIRE_MESSAGE_PAYLOAD_LEN;
     }
     // Adding the Modifications for Testing Cases 3 and 5.
     // Test Case 3
     dp_arr[2].technology = 0x06;  // There is no 6G network, so this shouldn't pass.
-    dp_arr[2].length = sizeof(dp_arr[2].technology) + sizeof(dp_arr[2].sub_num);
+    dp_arr[2].length = WIRE_MESSAGE_PAYLOAD_LEN;
     // Test Case 5
     dp_arr[db_len] = dp_arr[db_len - 1];  // just copy the previous packet, but give a bad subscriber number.
-    dp_arr[db_len].sub_num = strtoul("4084400332", &end_ptr, 10);
-    dp_arr[db_len].length = sizeof(dp_arr[db_len].technology) + sizeof(dp_arr[db_len].sub_num);
+    dp_arr[db_len].sub_num = strtoul("4084400332", NULL, 10);
+    dp_arr[db_len].length = WIRE_MESSAGE_PAYLOAD_LEN;
+
+    // Adaptive retransmission timeout, starting at CLIENT_INITIAL_RTO and capped at CLIENT_RECV_TIMEOUT.
+    rtt_estimator rtt;
+    rtt_init(&rtt, CLIENT_INITIAL_RTO, CLIENT_MIN_RTO, CLIENT_RECV_TIMEOUT);
+
+    if (batch_size > 0) {
+        int ret = verify_batched(sock_fd, &server_addr, dp_arr, db_len + 1, batch_size, &rtt);
+        rtt_report(&rtt);
+        rtt_free(&rtt);
+        close(sock_fd);
+        free(dp_arr);
+        sub_db_free(&db);
+        if (ret == 0) {
+            log_info("Sent all packets successfully. End.");
+        }
+        return ret;
+    }
 
     // Start Sending Packets for Verification.
+    long start_us = rtt_now_us();
     for (int packet_num = 0; packet_num < (db_len + 1); packet_num++) {
         client_pkt = dp_arr[packet_num];  // specify which packet in the array we're sending
         attempt_counter = 1;              // initialize the attempt number (we try thrice).
+        long sent_us = rtt_now_us();      // time of the first transmission, for the RTT sample
 
         // Send the packet to the server via the set-up socket connections.
         log_info("Client is sending Packet %d (sub#: %lu) to Server. Attempt %d\n", packet_num, client_pkt.sub_num, attempt_counter);
-        if (sendto(sock_fd, &client_pkt, sizeof(message_packet), 0, (struct sockaddr *)&server_addr, addr_len) < 0) {
+        if (send_message(sock_fd, &client_pkt, &server_addr) < 0) {
             log_error("Error: Test case %d: sendto() packet number %d", packet_num);
             return -1;
         }
 
         while (attempt_counter <= 3) {
-            poll_res = poll(&client_timer_pollfd, 1, CLIENT_RECV_TIMEOUT);  // The timer waits for three seconds to get an ACK
+            poll_res = poll(&client_timer_pollfd, 1, rtt_timeout_ms(&rtt));  // The timer waits one RTO to get an ACK
             if (poll_res > 0) {
-                recv_len = recvfrom(sock_fd, &server_pkt, sizeof(message_packet), 0, (struct sockaddr *)&server_addr, &addr_len);
+                recv_len = recv_message(sock_fd, &server_pkt, &server_addr);
                 if (recv_len == -1) {  // bad packet received. abort due to error in connection.
                     fprintf(stderr, "Client Experienced Error in Receiving server_pkt from Server.\n");
                     return -1;
+                } else if (recv_len == 0) {  // empty or malformed datagram, keep waiting for the real response
+                    continue;
+                }
+                // A late answer to an earlier packet, e.g. to a retransmission, has another seg_num or sub_num.
+                if (server_pkt.seg_num != client_pkt.seg_num || server_pkt.sub_num != client_pkt.sub_num) {
+                    log_warn("Ignoring response for seg_num %d (sub#: %lu) while waiting for Packet %d.", server_pkt.seg_num, server_pkt.sub_num, packet_num);
+                    continue;
+                }
+                if (attempt_counter == 1) {  // Karn's algorithm: retransmitted packets give ambiguous samples
+                    rtt_sample(&rtt, rtt_now_us() - sent_us);
                 }
                 // Handling server response
                 if (server_pkt.type == (short)ACC_OK) {
@@ -173,10 +379,11 @@ int main(int argc, char **argv) {
                 }
             } else if (poll_res == 0) {
                 attempt_counter++;
+                rtt_backoff(&rtt);  // exponential backoff: double the RTO for the next wait
                 // Retry
                 if (attempt_counter <= 3) {
-                    log_info("No Response from Server to Client. Attempt %d. Retransmitting...\n", attempt_counter);
-                    if (sendto(sock_fd, &client_pkt, sizeof(message_packet), 0, (struct sockaddr *)&server_addr, addr_len) < 0) {
+                    log_info("No Response from Server to Client. Attempt %d, RTO %d ms. Retransmitting...\n", attempt_counter, rtt_timeout_ms(&rtt));
+                    if (send_message(sock_fd, &client_pkt, &server_addr) < 0) {
                         log_error("Client experienced error in sending packet %d to Server.", packet_num);
                         return -1;
                     }
@@ -191,11 +398,27 @@ int main(int argc, char **argv) {
         // Then we need to quit sending packets and exit.
         if (attempt_counter > CLIENT_MAX_ATTEMPTS) {
             log_error("Retry timeout: Client attmpted to send packet %d with sub num: %lu three times and failed to get any responses from server. Quit.", packet_num, client_pkt.sub_num);
+            rtt_report(&rtt);
             return -1;
         }
+
+        // Test Case 6: send the answered packet again, as a retransmission delayed past its answer would arrive.
+        // Its answer comes back while the next packet is in flight and must not be taken for that packet's verdict.
+        if (packet_num == DELAYED_DUP_PACKET) {
+            log_info("Client is replaying Packet %d (sub#: %lu) to Server as a delayed duplicate.", packet_num, client_pkt.sub_num);
+            if (send_message(sock_fd, &client_pkt, &server_addr) < 0) {
+                log_error("Client experienced error in sending packet %d to Server.", packet_num);
+                return -1;
+            }
+        }
     }
 
+    report_throughput("Single", db_len + 1, db_len + 1, start_us);
+    rtt_report(&rtt);
+    rtt_free(&rtt);
     close(sock_fd);
+    free(dp_arr);
+    sub_db_free(&db);
     log_info("Sent all packets successfully. End.");
     return 0;
 }
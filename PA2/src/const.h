@@ -1,3 +1,6 @@
+#ifndef CONST_H
+#define CONST_H
+
 #ifndef TRUE
 #define TRUE 1
 #endif
@@ -14,6 +17,55 @@
 #define DB_FILE_NAME "Verification_Database.txt"
 #endif
 
+// Binary snapshot compiled from DB_FILE_NAME by dbcompile, preferred by the server when fresh.
+#ifndef DB_SNAPSHOT_NAME
+#define DB_SNAPSHOT_NAME "Verification_Database.snap"
+#endif
+
+// Live reload of DB_FILE_NAME (see live_db.h): quiet period after the last change before reloading,
+// and the nice value of the thread that parses the new file when SCHED_IDLE is not available.
+#ifndef LIVE_DB_DEBOUNCE_MS
+#define LIVE_DB_DEBOUNCE_MS 100
+#endif
+
+#ifndef LIVE_DB_RELOAD_NICE
+#define LIVE_DB_RELOAD_NICE 10
+#endif
+
+// Delta records (see delta.h) applied on top of DB_FILE_NAME, replayed at startup.
+#ifndef DB_DELTA_LOG_NAME
+#define DB_DELTA_LOG_NAME "Verification_Database.delta"
+#endif
+
+// The delta log is compacted at startup, at every reload, and once it holds twice the records it kept at
+// the last compaction plus this many.
+#ifndef LIVE_DB_COMPACT_MIN_RECORDS
+#define LIVE_DB_COMPACT_MIN_RECORDS 4096
+#endif
+
+// Unix socket that takes delta records (see control.h), records applied per batch at most,
+// and how long the server waits for the next line before it drops a control connection.
+#ifndef CONTROL_SOCKET_NAME
+#define CONTROL_SOCKET_NAME "pa2_control.sock"
+#endif
+
+#ifndef CONTROL_MAX_BATCH
+#define CONTROL_MAX_BATCH 4096
+#endif
+
+#ifndef CONTROL_RECV_TIMEOUT_S
+#define CONTROL_RECV_TIMEOUT_S 10
+#endif
+
+// Row layout of a sub_table (see sub_layout.h), chosen at build time with -DSUB_LAYOUT=n.
+#define SUB_LAYOUT_SOA 0     // three columns: subscriber number, technology, paid
+#define SUB_LAYOUT_AOS 1     // one 16-byte struct per row
+#define SUB_LAYOUT_HYBRID 2  // subscriber number column + 16-bit technology/paid column
+
+#ifndef SUB_LAYOUT
+#define SUB_LAYOUT SUB_LAYOUT_SOA
+#endif
+
 #ifndef START_ID
 #define START_ID 0xFFFF
 #endif
@@ -46,6 +98,26 @@
 #define ACC_OK 0xFFFB
 #endif
 
+// Batched verification: one ACC_PER_BATCH request carries up to MAX_VERIFY_BATCH (sub_num, technology)
+// tuples, and the ACC_RESULTS response carries one VERIFY_* result code per tuple.
+#ifndef ACC_PER_BATCH
+#define ACC_PER_BATCH 0xFFFC
+#endif
+
+#ifndef ACC_RESULTS
+#define ACC_RESULTS 0xFFFD
+#endif
+
+// Keeps a full batch request (9 bytes per tuple) inside a 1500-byte Ethernet MTU.
+#ifndef MAX_VERIFY_BATCH
+#define MAX_VERIFY_BATCH 128
+#endif
+
+#define VERIFY_OK 0          // access granted (ACC_OK)
+#define VERIFY_NOT_PAID 1    // subscriber has not paid (NOT_PAID)
+#define VERIFY_NOT_EXIST 2   // subscriber is not in the database (NOT_EXIST)
+#define VERIFY_WRONG_TECH 3  // subscriber asked for the wrong technology (NOT_EXIST, technology INVALID_TECHNOLOGY)
+
 // User-made Definitions for hard-coded values.
 // hard-coded the port number (picked it randomly, and it was available).
 #ifndef DEFAULT_SERVER_PORT
@@ -62,16 +134,40 @@
 #define NUM_PACKETS 5
 #endif
 
+// Packet that Test Case 6 sends again after its answer, as a delayed duplicate.
+#ifndef DELAYED_DUP_PACKET
+#define DELAYED_DUP_PACKET 0
+#endif
+
 // Number of packets the client will send the server.
 #ifndef CLIENT_MAX_ATTEMPTS
 #define CLIENT_MAX_ATTEMPTS 3
 #endif
 
-// Timeout for client to receive next ACK packet from the server
+// Longest the client waits for the next ACK packet from the server: upper bound of the adaptive RTO (see rtt.h)
 #ifndef CLIENT_RECV_TIMEOUT
 #define CLIENT_RECV_TIMEOUT 3000
 #endif
 
+// Default number of datagrams the server pulls per recvmmsg() and flushes per sendmmsg().
+#ifndef DEFAULT_BATCH_SIZE
+#define DEFAULT_BATCH_SIZE 64
+#endif
+
+#ifndef MAX_BATCH_SIZE
+#define MAX_BATCH_SIZE 1024
+#endif
+
+// Seconds between two reports of the average batch fill.
+#ifndef BATCH_REPORT_INTERVAL
+#define BATCH_REPORT_INTERVAL 10
+#endif
+
+// Unix socket that answers every connection with the outcome counters and service times (see metrics.h).
+#ifndef STATS_SOCKET_NAME
+#define STATS_SOCKET_NAME "pa2_stats.sock"
+#endif
+
 //Data structure for sending and receiving data with the Client.
 typedef struct message_packet {
     short start_id;
@@ -83,3 +179,18 @@ typedef struct message_packet {
     unsigned long sub_num;
     short end_id;
 } message_packet;
+
+// Batched verification request (type ACC_PER_BATCH) and its response (type ACC_RESULTS).
+typedef struct batch_packet {
+    short start_id;
+    char client_id;
+    short type;
+    char seg_num;
+    int count;                                // number of tuples, 1..MAX_VERIFY_BATCH
+    char technology[MAX_VERIFY_BATCH];        // request: technology asked for by each tuple
+    unsigned long sub_num[MAX_VERIFY_BATCH];  // request: subscriber number of each tuple
+    unsigned char result[MAX_VERIFY_BATCH];   // response: VERIFY_* code of each tuple
+    short end_id;
+} batch_packet;
+
+#endif
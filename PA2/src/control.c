@@ -0,0 +1,131 @@
+#define _GNU_SOURCE
+#include "control.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "const.h"
+#include "log.h"
+#include "unix_sock.h"
+
+/**
+ * Send one reply line. The peer may be gone already, which must not raise SIGPIPE.
+*/
+static void reply(int fd, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void reply(int fd, const char *fmt, ...) {
+    char buf[128];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (len > 0) {
+        send(fd, buf, (size_t)len < sizeof(buf) ? (size_t)len : sizeof(buf) - 1, MSG_NOSIGNAL);
+    }
+}
+
+/**
+ * Apply the num_recs records collected so far, or reject them if line bad_line was malformed, and answer.
+*/
+static void finish_batch(control_server *cs, int fd, int num_recs, int bad_line) {
+    if (bad_line > 0) {
+        reply(fd, "ERR line %d: malformed record\n", bad_line);
+    } else if (num_recs > 0) {
+        if (live_db_update(cs->ldb, cs->batch, num_recs) < 0) {
+            reply(fd, "ERR could not apply %d records\n", num_recs);
+        } else {
+            log_info("Control: applied %d delta records", num_recs);
+            reply(fd, "OK %d\n", num_recs);
+        }
+    }
+}
+
+static void serve_connection(control_server *cs, int fd) {
+    struct timeval timeout = {CONTROL_RECV_TIMEOUT_S, 0};  // a stuck client must not hold up every other update
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    FILE *in = fdopen(fd, "r");
+    if (!in) {
+        close(fd);
+        return;
+    }
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    int line_no = 0;
+    int num_recs = 0;
+    int bad_line = 0;  // first malformed line of the current batch, 0 if none
+    while ((len = getline(&line, &line_cap, in)) >= 0) {
+        line_no++;
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len == 0) {
+            finish_batch(cs, fd, num_recs, bad_line);
+            num_recs = 0;
+            bad_line = 0;
+        } else if (bad_line > 0) {
+            continue;  // the rest of a rejected batch
+        } else if (delta_parse(line, &cs->batch[num_recs]) < 0) {
+            bad_line = line_no;
+        } else if (++num_recs == CONTROL_MAX_BATCH) {
+            finish_batch(cs, fd, num_recs, 0);
+            num_recs = 0;
+        }
+    }
+    finish_batch(cs, fd, num_recs, bad_line);
+    free(line);
+    fclose(in);
+}
+
+static void *control_loop(void *arg) {
+    control_server *cs = arg;
+    while (TRUE) {
+        int fd = accept4(cs->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            log_error("Control Error: accept() failed, no longer taking updates on %s.", cs->path);
+            return NULL;
+        }
+        serve_connection(cs, fd);
+    }
+    return NULL;
+}
+
+int control_start(control_server *cs, live_db *ldb, const char *path) {
+    cs->ldb = ldb;
+    cs->batch = malloc(sizeof(delta_record) * CONTROL_MAX_BATCH);
+    if (!cs->batch) {
+        log_error("Control Error: Could not allocate the record batch.");
+        return -1;
+    }
+    cs->listen_fd = unix_listen(path, "Control");
+    if (cs->listen_fd < 0) {
+        free(cs->batch);
+        return -1;
+    }
+    strcpy(cs->path, path);  // fits, unix_listen() checked it against sun_path
+    if (pthread_create(&cs->thread, NULL, control_loop, cs) != 0) {
+        log_error("Control Error: Could not start the control thread.");
+        close(cs->listen_fd);
+        unlink(path);
+        free(cs->batch);
+        return -1;
+    }
+    log_info("Taking delta updates on %s", path);
+    return 0;
+}
+
+void control_stop(control_server *cs) {
+    pthread_cancel(cs->thread);
+    pthread_join(cs->thread, NULL);
+    close(cs->listen_fd);
+    unlink(cs->path);
+    free(cs->batch);
+}
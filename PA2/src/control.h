@@ -0,0 +1,36 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <pthread.h>
+#include <sys/un.h>
+
+#include "delta.h"
+#include "live_db.h"
+
+// Local control channel: a Unix domain stream socket that takes batches of delta records
+// (one record per line in the text form of delta.h) and applies them to a live_db.
+// A batch ends at an empty line or when the connection is closed, and is answered with one line:
+//   OK <number of records>
+//   ERR line <n>: <reason>      nothing from the batch was applied
+// Batches of more than CONTROL_MAX_BATCH records are applied in chunks of that size.
+typedef struct control_server {
+    live_db *ldb;
+    int listen_fd;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    delta_record *batch;  // CONTROL_MAX_BATCH records being collected
+    pthread_t thread;
+} control_server;
+
+/**
+ * Listen on the Unix socket path (replacing a stale one, owner-only permissions) and serve
+ * connections one at a time on a background thread.
+ * Return 0 on success; -1 on error.
+*/
+int control_start(control_server *cs, live_db *ldb, const char *path);
+
+/**
+ * Stop the control thread and remove the socket.
+*/
+void control_stop(control_server *cs);
+
+#endif
@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "const.h"
+#include "log.h"
+#include "snapshot.h"
+
+int main(int argc, char **argv) {
+    // ======================== CLI ARGS PARSING ========================
+    // Usage: dbcompile [text_db] [snapshot]
+    const char *text_path = DB_FILE_NAME;
+    const char *snap_path = DB_SNAPSHOT_NAME;
+    if (argc > 1) {
+        text_path = argv[1];
+    }
+    if (argc > 2) {
+        snap_path = argv[2];
+    }
+
+    // ======================== COMPILE SNAPSHOT ========================
+    sub_db db;
+    sub_index idx;
+    if (sub_db_load_text(&db, text_path) < 0) {
+        log_fatal("DB Error: Could not load %s. Quit.", text_path);
+        exit(EXIT_FAILURE);
+    }
+    if (sub_index_build(&idx, db.sub_nums, db.len) < 0) {
+        log_fatal("DB Error: Could not build subscriber index. Quit.");
+        exit(EXIT_FAILURE);
+    }
+    if (snapshot_write(snap_path, text_path, &db, &idx) < 0) {
+        log_fatal("Snapshot Error: Could not write %s. Quit.", snap_path);
+        exit(EXIT_FAILURE);
+    }
+    log_info("Compiled %d subscribers from %s into %s (format version %d)", db.len, text_path, snap_path, SNAPSHOT_VERSION);
+
+    sub_index_free(&idx);
+    sub_db_free(&db);
+    return 0;
+}
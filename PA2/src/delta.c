@@ -0,0 +1,277 @@
+#define _GNU_SOURCE
+#include "delta.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "const.h"
+#include "log.h"
+
+// Records are appended in chunks of this many, one write() each.
+#define DELTA_WRITE_CHUNK 256
+
+static inline int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+/**
+ * Parse a subscriber number, skipping '-' and '.' separators, starting at *p.
+ * Return 0 on success (with *p just past it); -1 if there is no digit.
+*/
+static int parse_sub_num(const char **p, unsigned long *sub_num) {
+    const char *s = *p;
+    unsigned long v = 0;
+    int num_digits = 0;
+    while (*s == ' ' || *s == '\t') {
+        s++;
+    }
+    for (; is_digit(*s) || *s == '-' || *s == '.'; s++) {
+        if (is_digit(*s)) {
+            v = v * 10 + (unsigned long)(*s - '0');
+            num_digits++;
+        }
+    }
+    if (num_digits == 0 || num_digits > 19) {
+        return -1;
+    }
+    *sub_num = v;
+    *p = s;
+    return 0;
+}
+
+int delta_parse(const char *line, delta_record *rec) {
+    const char *p = line;
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    if (strncmp(p, "upsert", 6) == 0) {
+        p += 6;
+        char *end;
+        if (parse_sub_num(&p, &rec->sub_num) < 0) {
+            return -1;
+        }
+        long tech = strtol(p, &end, 10);
+        if (end == p || tech == INVALID_TECHNOLOGY || tech < 0 || tech > 127) {
+            return -1;
+        }
+        p = end;
+        long paid = strtol(p, &end, 10);
+        if (end == p || (paid != 0 && paid != 1)) {
+            return -1;
+        }
+        p = end;
+        rec->technology = (char)tech;
+        rec->paid = (char)paid;
+    } else if (strncmp(p, "delete", 6) == 0) {
+        p += 6;
+        if (parse_sub_num(&p, &rec->sub_num) < 0) {
+            return -1;
+        }
+        rec->technology = (char)INVALID_TECHNOLOGY;
+        rec->paid = 0;
+    } else {
+        return -1;
+    }
+    while (*p == ' ' || *p == '\t' || *p == '\r') {
+        p++;
+    }
+    return *p == '\0' ? 0 : -1;
+}
+
+int delta_format(const delta_record *rec, char *buf, size_t buf_len) {
+    int n;
+    if (rec->technology == (char)INVALID_TECHNOLOGY) {
+        n = snprintf(buf, buf_len, "delete %lu\n", rec->sub_num);
+    } else {
+        n = snprintf(buf, buf_len, "upsert %lu %02d %d\n", rec->sub_num, (int)rec->technology, (int)rec->paid);
+    }
+    return n < 0 || (size_t)n >= buf_len ? -1 : n;
+}
+
+int delta_log_open(const char *path) {
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        log_error("Delta Error: Could not open %s.", path);
+    }
+    return fd;
+}
+
+int delta_log_append(int fd, const delta_record *recs, int num_recs) {
+    char buf[DELTA_WRITE_CHUNK * DELTA_LINE_MAX];
+    for (int i = 0; i < num_recs;) {
+        size_t len = 0;
+        for (int end = i + DELTA_WRITE_CHUNK; i < num_recs && i < end; i++) {
+            len += (size_t)delta_format(&recs[i], buf + len, sizeof(buf) - len);
+        }
+        // O_APPEND writes land at the end as a whole; a short write only happens when the disk is full.
+        ssize_t n = write(fd, buf, len);
+        if (n != (ssize_t)len) {
+            log_error("Delta Error: Could not append to the delta log (%s).", n < 0 ? strerror(errno) : "short write");
+            return -1;
+        }
+    }
+    if (fdatasync(fd) < 0) {
+        log_error("Delta Error: Could not sync the delta log.");
+        return -1;
+    }
+    return 0;
+}
+
+int delta_log_replay(const char *path, int (*apply)(void *ctx, const delta_record *rec), void *ctx) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        log_error("Delta Error: Could not open %s.", path);
+        return -1;
+    }
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    long good_len = 0;  // bytes up to the end of the last complete line
+    int line_no = 0;
+    int num_applied = 0;
+    while ((len = getline(&line, &line_cap, fp)) >= 0) {
+        if (len == 0 || line[len - 1] != '\n') {
+            break;  // torn append
+        }
+        good_len += len;
+        line_no++;
+        line[len - 1] = '\0';
+        delta_record rec;
+        if (line[0] == '\0') {
+            continue;
+        }
+        if (delta_parse(line, &rec) < 0) {
+            log_warn("Delta log %s, line %d: skipped malformed record \"%s\".", path, line_no, line);
+            continue;
+        }
+        if (apply(ctx, &rec) < 0) {
+            free(line);
+            fclose(fp);
+            return -1;
+        }
+        num_applied++;
+    }
+    free(line);
+    int failed = ferror(fp);
+    long file_len = ftell(fp);
+    fclose(fp);
+    if (failed) {
+        log_error("Delta Error: Could not read %s.", path);
+        return -1;
+    }
+    if (file_len > good_len) {
+        log_warn("Delta log %s: dropped a torn record at the end of the file.", path);
+        if (truncate(path, good_len) < 0) {
+            log_error("Delta Error: Could not truncate %s.", path);
+            return -1;
+        }
+    }
+    return num_applied;
+}
+
+// A record and its position in the log, for compaction.
+typedef struct delta_entry {
+    delta_record rec;
+    int pos;
+} delta_entry;
+
+typedef struct delta_entries {
+    delta_entry *items;
+    int len;
+    int cap;
+} delta_entries;
+
+/**
+ * delta_log_replay() callback that collects every record into a delta_entries.
+*/
+static int collect_entry(void *ctx, const delta_record *rec) {
+    delta_entries *e = ctx;
+    if (e->len == e->cap) {
+        int cap = e->cap ? e->cap * 2 : 1024;
+        delta_entry *items = realloc(e->items, sizeof(delta_entry) * (size_t)cap);
+        if (!items) {
+            log_error("Delta Error: Out of memory while compacting the delta log.");
+            return -1;
+        }
+        e->items = items;
+        e->cap = cap;
+    }
+    e->items[e->len].rec = *rec;
+    e->items[e->len].pos = e->len;
+    e->len++;
+    return 0;
+}
+
+static int cmp_sub_then_pos(const void *a, const void *b) {
+    const delta_entry *x = a, *y = b;
+    if (x->rec.sub_num != y->rec.sub_num) {
+        return x->rec.sub_num < y->rec.sub_num ? -1 : 1;
+    }
+    return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+static int cmp_pos(const void *a, const void *b) {
+    const delta_entry *x = a, *y = b;
+    return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+int delta_log_compact(const char *path) {
+    delta_entries e = {NULL, 0, 0};
+    if (delta_log_replay(path, collect_entry, &e) < 0) {
+        free(e.items);
+        return -1;
+    }
+    int num_before = e.len;
+
+    // Keep the last entry of every run of the same subscriber, then put the survivors back in log order.
+    qsort(e.items, (size_t)e.len, sizeof(delta_entry), cmp_sub_then_pos);
+    int num_kept = 0;
+    for (int i = 0; i < e.len; i++) {
+        if (i + 1 == e.len || e.items[i + 1].rec.sub_num != e.items[i].rec.sub_num) {
+            e.items[num_kept++] = e.items[i];
+        }
+    }
+    qsort(e.items, (size_t)num_kept, sizeof(delta_entry), cmp_pos);
+    delta_record *recs = malloc(sizeof(delta_record) * (size_t)(num_kept > 0 ? num_kept : 1));
+    if (!recs) {
+        log_error("Delta Error: Out of memory while compacting the delta log.");
+        free(e.items);
+        return -1;
+    }
+    for (int i = 0; i < num_kept; i++) {
+        recs[i] = e.items[i].rec;
+    }
+    free(e.items);
+
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0 || delta_log_append(fd, recs, num_kept) < 0) {
+        log_error("Delta Error: Could not write %s.", tmp_path);
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp_path);
+        }
+        free(recs);
+        return -1;
+    }
+    close(fd);
+    free(recs);
+    if (rename(tmp_path, path) < 0) {
+        log_error("Delta Error: Could not rename %s to %s.", tmp_path, path);
+        unlink(tmp_path);
+        return -1;
+    }
+    if (num_kept < num_before) {
+        log_info("Compacted delta log %s from %d to %d records", path, num_before, num_kept);
+    }
+    return num_kept;
+}
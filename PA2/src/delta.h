@@ -0,0 +1,61 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stddef.h>
+
+// One incremental change to the subscriber table, as sent over the control socket and kept in the delta log.
+// In text form, one record per line:
+//   upsert <subscriber number> <technology> <paid>    e.g. "upsert 408-554-6805 04 1"
+//   delete <subscriber number>
+// Separators inside the subscriber number are skipped, like in Verification_Database.txt.
+typedef struct delta_record {
+    unsigned long sub_num;
+    char technology;  // INVALID_TECHNOLOGY for a delete
+    char paid;        // 1 = paid, 0 = not paid
+} delta_record;
+
+// Longest text form of a record, newline included.
+#define DELTA_LINE_MAX 64
+
+/**
+ * Parse one record from the NUL-terminated line (no trailing newline).
+ * Return 0 on success; -1 if the line is not a valid record.
+*/
+int delta_parse(const char *line, delta_record *rec);
+
+/**
+ * Write the text form of rec, newline included, into buf.
+ * Return the number of bytes written; -1 if buf is too small.
+*/
+int delta_format(const delta_record *rec, char *buf, size_t buf_len);
+
+/**
+ * Open the delta log for appending, creating it if needed.
+ * Return the fd; -1 on error.
+*/
+int delta_log_open(const char *path);
+
+/**
+ * Append recs[0..num_recs) to the log with a single write() and make them durable with fdatasync().
+ * Return 0 on success; -1 on error.
+*/
+int delta_log_append(int fd, const delta_record *recs, int num_recs);
+
+/**
+ * Call apply(ctx, rec) for every record in the log at path, in order. Malformed lines are logged and skipped;
+ * a torn last line (no newline, left by a crash during an append) is cut off the file.
+ * A missing log is an empty log.
+ * Return the number of records applied; -1 if the log could not be read or apply() failed.
+*/
+int delta_log_replay(const char *path, int (*apply)(void *ctx, const delta_record *rec), void *ctx);
+
+/**
+ * Rewrite the log at path with only the last record of each subscriber, in log order. Every record sets a
+ * subscriber's whole state, so the result replays to the same table on top of any database. The new log is
+ * written to a temporary file, synced and renamed into place; an fd still open on the old log keeps
+ * appending to the replaced file, so reopen it afterwards.
+ * Return the number of records kept; -1 on error (the old log is left as it was).
+*/
+int delta_log_compact(const char *path);
+
+#endif
@@ -0,0 +1,50 @@
+#define _GNU_SOURCE
+#include "dgram_ring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+int dgram_ring_init(dgram_ring *ring, int num_slots, size_t req_len, size_t rsp_len) {
+    memset(ring, 0, sizeof(*ring));
+    // The address follows the response, keep it naturally aligned.
+    rsp_len = (rsp_len + sizeof(long) - 1) & ~(sizeof(long) - 1);
+    req_len = (req_len + sizeof(long) - 1) & ~(sizeof(long) - 1);
+    ring->slot_len = (req_len + rsp_len + sizeof(struct sockaddr_in) + DGRAM_RING_ALIGN - 1) & ~(size_t)(DGRAM_RING_ALIGN - 1);
+    ring->req_len = req_len;
+    ring->rsp_len = rsp_len;
+    ring->num_slots = num_slots;
+    ring->mem = aligned_alloc(DGRAM_RING_ALIGN, ring->slot_len * num_slots);
+    ring->in_iovs = calloc(num_slots, sizeof(struct iovec));
+    ring->out_iovs = calloc(num_slots, sizeof(struct iovec));
+    ring->in_msgs = calloc(num_slots, sizeof(struct mmsghdr));
+    ring->out_msgs = calloc(num_slots, sizeof(struct mmsghdr));
+    if (!ring->mem || !ring->in_iovs || !ring->out_iovs || !ring->in_msgs || !ring->out_msgs) {
+        log_error("Ring Error: Could not allocate %d datagram slots.", num_slots);
+        dgram_ring_free(ring);
+        return -1;
+    }
+    memset(ring->mem, 0, ring->slot_len * num_slots);
+
+    for (int i = 0; i < num_slots; i++) {
+        ring->in_iovs[i].iov_base = dgram_ring_req(ring, i);
+        ring->in_iovs[i].iov_len = req_len;
+        ring->in_msgs[i].msg_hdr.msg_iov = &ring->in_iovs[i];
+        ring->in_msgs[i].msg_hdr.msg_iovlen = 1;
+        ring->in_msgs[i].msg_hdr.msg_name = dgram_ring_addr(ring, i);
+        ring->out_msgs[i].msg_hdr.msg_iov = &ring->out_iovs[i];
+        ring->out_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    dgram_ring_rearm(ring, num_slots);
+    return 0;
+}
+
+void dgram_ring_free(dgram_ring *ring) {
+    free(ring->mem);
+    free(ring->in_iovs);
+    free(ring->out_iovs);
+    free(ring->in_msgs);
+    free(ring->out_msgs);
+    memset(ring, 0, sizeof(*ring));
+}
@@ -0,0 +1,71 @@
+#ifndef DGRAM_RING_H
+#define DGRAM_RING_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <sys/socket.h>
+
+// Needs _GNU_SOURCE (struct mmsghdr), defined before the first #include.
+
+// Preallocated datagram buffers for one receive loop, reused batch after batch.
+// Slot i holds a request buffer, the response buffer right after it, and the client address, and starts
+// on a cache line boundary, so a worker touches only its own lines and never allocates per packet.
+// recvmmsg() writes request i straight into slot i and sendmmsg() sends straight from the response
+// buffers (or from the request buffer itself when a request is answered in place), so the only bytes
+// that move are the ones the server writes.
+#define DGRAM_RING_ALIGN 64
+
+typedef struct dgram_ring {
+    unsigned char *mem;      // num_slots * slot_len bytes, DGRAM_RING_ALIGN aligned
+    size_t slot_len;         // request + response + address, rounded up to DGRAM_RING_ALIGN
+    size_t req_len;          // capacity of each request buffer
+    size_t rsp_len;          // capacity of each response buffer
+    int num_slots;
+    struct iovec *in_iovs;   // in_iovs[i] covers the request buffer of slot i
+    struct iovec *out_iovs;  // set per response, see dgram_ring_respond()
+    struct mmsghdr *in_msgs;
+    struct mmsghdr *out_msgs;
+} dgram_ring;
+
+/**
+ * Allocate num_slots slots with req_len request bytes and rsp_len response bytes each, and point
+ * in_msgs at them. The memory is touched once here so the first batch does not fault.
+ * Return 0 on success; -1 if out of memory.
+*/
+int dgram_ring_init(dgram_ring *ring, int num_slots, size_t req_len, size_t rsp_len);
+
+void dgram_ring_free(dgram_ring *ring);
+
+static inline unsigned char *dgram_ring_req(const dgram_ring *ring, int slot) {
+    return ring->mem + (size_t)slot * ring->slot_len;
+}
+
+static inline unsigned char *dgram_ring_rsp(const dgram_ring *ring, int slot) {
+    return dgram_ring_req(ring, slot) + ring->req_len;
+}
+
+static inline struct sockaddr_in *dgram_ring_addr(const dgram_ring *ring, int slot) {
+    return (struct sockaddr_in *)(dgram_ring_rsp(ring, slot) + ring->rsp_len);
+}
+
+/**
+ * Reset the address lengths of the first count slots before the next recvmmsg().
+*/
+static inline void dgram_ring_rearm(dgram_ring *ring, int count) {
+    for (int i = 0; i < count; i++) {
+        ring->in_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+}
+
+/**
+ * Queue response number out, len bytes at buf (the slot's response buffer, or its request buffer when
+ * answered in place), to the client of slot.
+*/
+static inline void dgram_ring_respond(dgram_ring *ring, int out, int slot, unsigned char *buf, size_t len) {
+    ring->out_iovs[out].iov_base = buf;
+    ring->out_iovs[out].iov_len = len;
+    ring->out_msgs[out].msg_hdr.msg_name = dgram_ring_addr(ring, slot);
+    ring->out_msgs[out].msg_hdr.msg_namelen = ring->in_msgs[slot].msg_hdr.msg_namelen;
+}
+
+#endif
@@ -0,0 +1,369 @@
+#define _GNU_SOURCE
+#include "live_db.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "const.h"
+#include "log.h"
+#include "snapshot.h"
+
+// Spare rows given to a version that had to be copied to make room for new subscribers.
+#define LIVE_DB_MIN_SPARE_ROWS 1024
+
+static void version_free(db_version *v) {
+    sub_index_free(&v->idx);
+    sub_db_free(&v->db);
+    free(v);
+}
+
+/**
+ * Copy src into a new heap version with room for max_rows rows in the arrays and in the index.
+ * Return the copy; NULL if out of memory.
+*/
+static db_version *version_clone(const db_version *src, int max_rows) {
+    db_version *v = malloc(sizeof(db_version));
+    if (!v) {
+        return NULL;
+    }
+    if (sub_db_clone(&v->db, &src->db, max_rows) < 0) {
+        free(v);
+        return NULL;
+    }
+    if (sub_index_build_for(&v->idx, v->db.sub_nums, v->db.len, max_rows) < 0) {
+        sub_db_free(&v->db);
+        free(v);
+        return NULL;
+    }
+    v->generation = src->generation;
+    return v;
+}
+
+/**
+ * Apply rec to v in place; readers may be using v.
+ * Return 0 on success; -1 if a new subscriber does not fit in v (the caller copies v with more room).
+*/
+static int version_apply(db_version *v, const delta_record *rec) {
+    int row = sub_index_find(&v->idx, v->db.sub_nums, rec->sub_num);
+    if (row >= 0) {
+        // Seqlock write: readers that overlap the two stores see an odd or changed row_seq and retry,
+        // so no reader pairs the old technology with the new paid byte or the other way round.
+        unsigned int seq = v->db.row_seq;  // only the writer changes it, under writer_mutex
+        __atomic_store_n(&v->db.row_seq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        __atomic_store_n(&v->db.sub_techs[row], rec->technology, __ATOMIC_RELAXED);
+        __atomic_store_n(&v->db.sub_paid_arr[row], rec->paid, __ATOMIC_RELAXED);
+        __atomic_store_n(&v->db.row_seq, seq + 2, __ATOMIC_RELEASE);
+        return 0;
+    }
+    if (rec->technology == (char)INVALID_TECHNOLOGY) {
+        return 0;  // deleting a subscriber that does not exist
+    }
+    if (v->db.len >= v->db.cap) {
+        return -1;  // full, or mapped from a snapshot
+    }
+    // Rows past db.len are never reached by readers until the index slot below is published.
+    row = v->db.len;
+    v->db.sub_nums[row] = rec->sub_num;
+    v->db.sub_techs[row] = rec->technology;
+    v->db.sub_paid_arr[row] = rec->paid;
+    if (sub_index_insert(&v->idx, v->db.sub_nums, row) < 0) {
+        return -1;
+    }
+    v->db.len++;
+    return 0;
+}
+
+/**
+ * delta_log_replay() callback for a version no reader can see yet: *ctx is grown by copying when needed.
+*/
+static int replay_apply(void *ctx, const delta_record *rec) {
+    db_version **v = ctx;
+    if (version_apply(*v, rec) == 0) {
+        return 0;
+    }
+    db_version *bigger = version_clone(*v, (*v)->db.len * 2 + LIVE_DB_MIN_SPARE_ROWS);
+    if (!bigger) {
+        log_error("Delta Error: Out of memory while replaying the delta log.");
+        return -1;
+    }
+    version_free(*v);
+    *v = bigger;
+    return version_apply(bigger, rec);
+}
+
+/**
+ * Replay the delta log on top of *v, which no reader can see yet (*v may be replaced by a larger copy).
+ * Return 0 on success; -1 on error.
+*/
+static int replay_deltas(live_db *ldb, db_version **v) {
+    int num_applied = delta_log_replay(ldb->delta_path, replay_apply, v);
+    if (num_applied < 0) {
+        return -1;
+    }
+    if (num_applied > 0) {
+        log_info("Replayed %d delta records from %s", num_applied, ldb->delta_path);
+    }
+    return 0;
+}
+
+/**
+ * Compact the delta log (see delta_log_compact()) and reopen it for appending. Caller holds writer_mutex,
+ * or is live_db_init(). If the log cannot be rewritten, appends go on to the old one.
+ * Return 0 on success; -1 if the log cannot be opened for appending.
+*/
+static int compact_deltas(live_db *ldb) {
+    int num_kept = delta_log_compact(ldb->delta_path);
+    if (num_kept >= 0) {
+        if (ldb->delta_fd >= 0) {
+            close(ldb->delta_fd);  // open on the replaced file
+        }
+        ldb->delta_fd = delta_log_open(ldb->delta_path);
+        ldb->delta_records = num_kept;
+    } else {
+        log_warn("Could not compact %s, appending to it as it is.", ldb->delta_path);
+        if (ldb->delta_fd < 0) {
+            ldb->delta_fd = delta_log_open(ldb->delta_path);
+        }
+    }
+    ldb->compact_at = ldb->delta_records * 2 + LIVE_DB_COMPACT_MIN_RECORDS;
+    return ldb->delta_fd < 0 ? -1 : 0;
+}
+
+/**
+ * Wait until every reader that may still hold a version older than epoch target has gone offline.
+ * Only the writing thread waits here, the readers never do.
+*/
+static void wait_for_readers(live_db *ldb, unsigned long target) {
+    struct timespec nap = {0, 1000000};  // 1 ms, a worker finishes its batch well within that
+    for (int i = 0; i < ldb->num_readers; i++) {
+        for (;;) {
+            unsigned long seen = atomic_load(&ldb->readers[i].epoch);
+            if (seen == LIVE_DB_OFFLINE || seen >= target) {
+                break;
+            }
+            nanosleep(&nap, NULL);
+        }
+    }
+}
+
+/**
+ * Swap v in as the current version and free the old one after the grace period. Caller holds writer_mutex.
+*/
+static void publish(live_db *ldb, db_version *v) {
+    db_version *old = atomic_load(&ldb->current);
+    // Publish, then open a new epoch: readers entering from now on see v.
+    atomic_store(&ldb->current, v);
+    unsigned long target = atomic_fetch_add(&ldb->epoch, 1) + 1;
+    wait_for_readers(ldb, target);
+    version_free(old);
+}
+
+int live_db_init(live_db *ldb, const char *snap_path, const char *text_path, const char *delta_path, int num_readers) {
+    ldb->readers = aligned_alloc(64, sizeof(db_reader) * (size_t)num_readers);
+    db_version *v = malloc(sizeof(db_version));
+    if (!ldb->readers || !v) {
+        free(ldb->readers);
+        free(v);
+        return -1;
+    }
+    for (int i = 0; i < num_readers; i++) {
+        atomic_init(&ldb->readers[i].epoch, LIVE_DB_OFFLINE);
+    }
+    ldb->num_readers = num_readers;
+    ldb->snap_path = snap_path;
+    ldb->text_path = text_path;
+    ldb->delta_path = delta_path;
+    ldb->inotify_fd = -1;
+    ldb->delta_fd = -1;
+    ldb->delta_records = 0;
+    if (snapshot_load_or_parse(snap_path, text_path, &v->db, &v->idx) < 0) {
+        free(ldb->readers);
+        free(v);
+        return -1;
+    }
+    v->generation = 1;
+    if (replay_deltas(ldb, &v) < 0 || compact_deltas(ldb) < 0) {
+        version_free(v);
+        free(ldb->readers);
+        return -1;
+    }
+    atomic_init(&ldb->current, v);
+    atomic_init(&ldb->epoch, 1);
+    pthread_mutex_init(&ldb->writer_mutex, NULL);
+    return 0;
+}
+
+int live_db_reload(live_db *ldb) {
+    pthread_mutex_lock(&ldb->writer_mutex);
+    struct timespec t0, t1, t2;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    // Build the whole new version while the workers keep serving the current one.
+    db_version *v = malloc(sizeof(db_version));
+    if (!v || sub_db_load_text(&v->db, ldb->text_path) < 0) {
+        log_error("Reload Error: Could not load %s, still serving the current database.", ldb->text_path);
+        free(v);
+        pthread_mutex_unlock(&ldb->writer_mutex);
+        return -1;
+    }
+    if (sub_index_build(&v->idx, v->db.sub_nums, v->db.len) < 0 || replay_deltas(ldb, &v) < 0) {
+        log_error("Reload Error: Could not index %s or replay %s, still serving the current database.", ldb->text_path, ldb->delta_path);
+        version_free(v);
+        pthread_mutex_unlock(&ldb->writer_mutex);
+        return -1;
+    }
+    v->generation = atomic_load(&ldb->current)->generation + 1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    publish(ldb, v);
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    if (compact_deltas(ldb) < 0) {
+        log_error("Reload Error: Could not reopen %s, delta updates will fail.", ldb->delta_path);
+    }
+
+    log_info("Reloaded %s: generation %lu, %d subscribers, built in %.3f s, old version freed after %.3f ms",
+             ldb->text_path, v->generation, v->db.len,
+             (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9,
+             ((t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9) * 1e3);
+    pthread_mutex_unlock(&ldb->writer_mutex);
+    return 0;
+}
+
+int live_db_update(live_db *ldb, const delta_record *recs, int num_recs) {
+    pthread_mutex_lock(&ldb->writer_mutex);
+    if (delta_log_append(ldb->delta_fd, recs, num_recs) < 0) {
+        pthread_mutex_unlock(&ldb->writer_mutex);
+        return -1;
+    }
+    ldb->delta_records += num_recs;
+
+    db_version *cur = atomic_load(&ldb->current);
+    int i = 0;
+    while (i < num_recs && version_apply(cur, &recs[i]) == 0) {
+        i++;
+    }
+    if (i < num_recs) {
+        // Out of room for new subscribers: copy once with room to spare, finish there, and swap.
+        db_version *v = version_clone(cur, (cur->db.len + num_recs - i) * 2 + LIVE_DB_MIN_SPARE_ROWS);
+        if (!v) {
+            log_error("Update Error: Out of memory, %d delta records logged but not applied until the next reload.", num_recs - i);
+            pthread_mutex_unlock(&ldb->writer_mutex);
+            return -1;
+        }
+        v->generation = cur->generation + 1;
+        for (; i < num_recs; i++) {
+            version_apply(v, &recs[i]);
+        }
+        publish(ldb, v);
+        log_info("Grew the subscriber table to generation %lu, %d subscribers with room for %d", v->generation, v->db.len, v->db.cap);
+    }
+    if (ldb->delta_records >= ldb->compact_at && compact_deltas(ldb) < 0) {
+        log_error("Update Error: Could not reopen %s, delta updates will fail.", ldb->delta_path);
+    }
+    pthread_mutex_unlock(&ldb->writer_mutex);
+    return 0;
+}
+
+/**
+ * Return 1 if the inotify events in buf[0..len) touch the file named name; 0 otherwise.
+*/
+static int events_match(const char *buf, ssize_t len, const char *name) {
+    for (const char *p = buf; p < buf + len;) {
+        const struct inotify_event *ev = (const struct inotify_event *)p;
+        if (ev->len > 0 && strcmp(ev->name, name) == 0) {
+            return 1;
+        }
+        p += sizeof(struct inotify_event) + ev->len;
+    }
+    return 0;
+}
+
+/**
+ * Watcher thread: wait for the database file to be rewritten, let the writer settle for
+ * LIVE_DB_DEBOUNCE_MS, then reload. Runs at idle priority so that parsing a large file yields to the workers.
+*/
+static void *watch_loop(void *arg) {
+    live_db *ldb = arg;
+    const char *slash = strrchr(ldb->text_path, '/');
+    const char *name = slash ? slash + 1 : ldb->text_path;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    // SCHED_IDLE only runs when no worker is runnable; fall back to a plain nice value.
+    struct sched_param idle = {0};
+    if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &idle) != 0 &&
+        setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), LIVE_DB_RELOAD_NICE) < 0) {
+        log_warn("Could not lower the priority of the database watcher.");
+    }
+    while (TRUE) {
+        ssize_t len = read(ldb->inotify_fd, buf, sizeof(buf));
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_error("Reload Error: Could not read inotify events, no longer watching %s.", ldb->text_path);
+            return NULL;
+        }
+        if (!events_match(buf, len, name)) {
+            continue;
+        }
+        // A file copied in several writes, or replaced twice in a row, is reloaded once.
+        struct pollfd pfd = {ldb->inotify_fd, POLLIN, 0};
+        while (poll(&pfd, 1, LIVE_DB_DEBOUNCE_MS) > 0 && read(ldb->inotify_fd, buf, sizeof(buf)) > 0) {
+        }
+        log_info("%s changed, reloading.", ldb->text_path);
+        live_db_reload(ldb);
+    }
+    return NULL;
+}
+
+int live_db_watch(live_db *ldb) {
+    // Watch the directory rather than the file: a file replaced by rename() is a new inode.
+    char dir[PATH_MAX];
+    const char *slash = strrchr(ldb->text_path, '/');
+    if (!slash) {
+        strcpy(dir, ".");
+    } else {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - ldb->text_path), ldb->text_path);
+    }
+
+    ldb->inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (ldb->inotify_fd < 0 || inotify_add_watch(ldb->inotify_fd, dir[0] ? dir : "/", IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        log_error("Reload Error: Could not watch %s with inotify.", dir);
+        if (ldb->inotify_fd >= 0) {
+            close(ldb->inotify_fd);
+            ldb->inotify_fd = -1;
+        }
+        return -1;
+    }
+    if (pthread_create(&ldb->watcher, NULL, watch_loop, ldb) != 0) {
+        log_error("Reload Error: Could not start the database watcher.");
+        close(ldb->inotify_fd);
+        ldb->inotify_fd = -1;
+        return -1;
+    }
+    log_info("Watching %s for changes", ldb->text_path);
+    return 0;
+}
+
+void live_db_free(live_db *ldb) {
+    if (ldb->inotify_fd >= 0) {
+        pthread_cancel(ldb->watcher);
+        pthread_join(ldb->watcher, NULL);
+        close(ldb->inotify_fd);
+        ldb->inotify_fd = -1;
+    }
+    version_free(atomic_load(&ldb->current));
+    close(ldb->delta_fd);
+    free(ldb->readers);
+    pthread_mutex_destroy(&ldb->writer_mutex);
+}
@@ -0,0 +1,108 @@
+#ifndef LIVE_DB_H
+#define LIVE_DB_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "delta.h"
+#include "sub_db.h"
+#include "sub_index.h"
+
+// One generation of the subscriber database and its index. A reload replaces it as a whole;
+// delta records change its rows in place or add rows to it (see live_db below).
+typedef struct db_version {
+    sub_db db;
+    sub_index idx;
+    unsigned long generation;  // 1 for the database loaded at startup, +1 per reload
+} db_version;
+
+// Marks a reader that holds no db_version (see live_db_exit()).
+#define LIVE_DB_OFFLINE 0UL
+
+// Grace-period state of one reader (one worker thread), on its own cache line so that
+// workers announcing quiescent states do not invalidate each other's lines.
+typedef struct db_reader {
+    atomic_ulong epoch;  // global epoch seen when the reader went online, LIVE_DB_OFFLINE between batches
+    char pad[64 - sizeof(atomic_ulong)];
+} db_reader;
+
+// Subscriber database that can be replaced while workers keep serving, RCU style.
+// Readers never lock or wait: live_db_enter() publishes the reader's epoch and loads the current
+// version, live_db_exit() marks the reader offline again. A reload builds the new version on the
+// side, swaps the pointer atomically, and frees the old version only after every reader that was
+// online during the swap has gone offline (the grace period), so a lookup never sees freed memory.
+//
+// Delta records (delta.h) change the current version in place instead: a row's technology and paid
+// bytes are written together under the version's row_seq (see sub_db_read_row()), and a new subscriber is written to a spare row before its index
+// slot is published. Only when the arrays or the index run out of room is the version copied, with room
+// to spare, and swapped like a reload. A deleted subscriber keeps its row with technology
+// INVALID_TECHNOLOGY, which verification treats as not existing.
+// Every record is first appended to the delta log, which is replayed on top of the text database at
+// startup and after every reload. The log is then compacted to the last record of each subscriber, and
+// again whenever it has doubled since, so it grows with the subscribers changed, not with the updates.
+typedef struct live_db {
+    _Atomic(db_version *) current;
+    atomic_ulong epoch;         // bumped by every swap, starts at 1 (LIVE_DB_OFFLINE is 0)
+    db_reader *readers;         // one per worker
+    int num_readers;
+    const char *snap_path;      // binary snapshot tried first at startup
+    const char *text_path;      // text database that is watched and reloaded
+    const char *delta_path;     // delta log replayed on top of text_path
+    int delta_fd;               // delta log opened for appending
+    int delta_records;          // records in the delta log
+    int compact_at;             // delta_records at which live_db_update() compacts the log
+    pthread_mutex_t writer_mutex;  // serializes reloads and updates; never taken by readers
+    int inotify_fd;             // -1 when not watching
+    pthread_t watcher;
+} live_db;
+
+/**
+ * Load the first version (snapshot if fresh, else the text database), replay the delta log on top of it,
+ * and set up num_readers readers.
+ * Return 0 on success; -1 on error.
+*/
+int live_db_init(live_db *ldb, const char *snap_path, const char *text_path, const char *delta_path, int num_readers);
+
+/**
+ * Start a background thread that watches text_path with inotify and reloads it whenever it is
+ * rewritten or replaced (e.g. by rename()).
+ * Return 0 on success; -1 on error (the server keeps serving the version it has).
+*/
+int live_db_watch(live_db *ldb);
+
+/**
+ * Parse text_path into a new version, replay the delta log on it, swap it in, compact the log, and free
+ * the old one after the grace period. If the file cannot be loaded, the current version stays in place.
+ * Return 0 on success; -1 on error.
+*/
+int live_db_reload(live_db *ldb);
+
+/**
+ * Append recs[0..num_recs) to the delta log, then apply them to the current version, in order.
+ * Return 0 on success; -1 if the records could not be logged, or logged but not applied (out of memory;
+ * they take effect at the next reload or restart).
+*/
+int live_db_update(live_db *ldb, const delta_record *recs, int num_recs);
+
+/**
+ * Reader `reader` starts using the database. The returned version stays valid until live_db_exit().
+*/
+static inline const db_version *live_db_enter(live_db *ldb, int reader) {
+    // The epoch store must be visible before the pointer load, or a swap could miss this reader.
+    atomic_store(&ldb->readers[reader].epoch, atomic_load(&ldb->epoch));
+    return atomic_load(&ldb->current);
+}
+
+/**
+ * Reader `reader` holds no version any more (a quiescent state). Call it before blocking.
+*/
+static inline void live_db_exit(live_db *ldb, int reader) {
+    atomic_store_explicit(&ldb->readers[reader].epoch, LIVE_DB_OFFLINE, memory_order_release);
+}
+
+/**
+ * Stop the watcher and free the current version. No reader may be online.
+*/
+void live_db_free(live_db *ldb);
+
+#endif
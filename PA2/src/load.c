@@ -0,0 +1,481 @@
+#include "load.h"
+
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "const.h"
+#include "log.h"
+#include "rtt.h"
+#include "sub_index.h"
+#include "wire.h"
+
+// Subscribers a kind of query is drawn from, most popular first.
+typedef struct key_pool {
+    unsigned long *sub_nums;
+    char *techs;
+    double *cdf;  // cdf[i]: probability of drawing one of the first i + 1 keys; NULL if uniform
+    int len;
+} key_pool;
+
+// What every worker reads.
+typedef struct load_shared {
+    const load_opts *opts;
+    const struct sockaddr_in *server_addr;
+    key_pool pools[LOAD_NUM_KINDS];
+    int mix_total;  // sum of the mix weights
+    long end_us;    // when workers stop sending
+} load_shared;
+
+// One outstanding request. Its seg_num is slot + depth * gen, so a late answer to an earlier request of
+// the same slot (another gen) is told apart from the answer to the current one.
+typedef struct load_slot {
+    unsigned char buf[WIRE_MESSAGE_LEN];  // the encoded request, for retransmissions
+    int kind;                             // LOAD_HIT, LOAD_MISS or LOAD_UNPAID
+    int gen;
+    int attempts;                         // transmissions so far
+    long sent_us;                         // first transmission
+    long deadline_us;                     // retransmission due
+} load_slot;
+
+typedef struct load_worker {
+    pthread_t thread;
+    int id;  // also the client_id of its requests
+    const load_shared *shared;
+    int sock_fd;
+    uint64_t rng;
+    rtt_estimator rtt;
+    load_slot slots[LOAD_MAX_DEPTH];
+    unsigned long sent;                       // requests, not counting retransmissions
+    unsigned long answered;
+    unsigned long lost;                       // no answer after CLIENT_MAX_ATTEMPTS transmissions
+    unsigned long retransmits;                // expired timers, each one a retransmission or a loss
+    unsigned long stale;                      // answers to requests that were already answered or lost
+    unsigned long wrong;                      // answers that do not match the kind of query
+    unsigned long responses[LOAD_NUM_KINDS];  // answers by the kind they stand for (ACC_OK = LOAD_HIT, ...)
+} load_worker;
+
+// xorshift64*, one state per worker.
+static inline uint64_t next_rand(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+// Uniform in [0, 1).
+static inline double rand_unit(uint64_t *state) {
+    return (double)(next_rand(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+int load_parse_mix(const char *spec, int mix[LOAD_NUM_KINDS]) {
+    const char *p = spec;
+    int total = 0;
+    for (int k = 0; k < LOAD_NUM_KINDS; k++) {
+        char *end;
+        long w = strtol(p, &end, 10);
+        if (end == p || w < 0 || w > 1000000 || (k < LOAD_NUM_KINDS - 1 ? *end != ',' : *end != '\0')) {
+            return -1;
+        }
+        mix[k] = (int)w;
+        total += mix[k];
+        p = end + 1;
+    }
+    return total > 0 ? 0 : -1;
+}
+
+/**
+ * Allocate pool p for len keys. With zipf > 0, key i (from 0) is drawn with probability proportional
+ * to 1 / (i + 1)^zipf.
+ * Return 0 on success; -1 if out of memory.
+*/
+static int pool_init(key_pool *p, int len, double zipf) {
+    memset(p, 0, sizeof(*p));
+    p->len = len;
+    p->sub_nums = malloc(sizeof(unsigned long) * (len > 0 ? len : 1));
+    p->techs = malloc(len > 0 ? len : 1);
+    if (!p->sub_nums || !p->techs) {
+        return -1;
+    }
+    if (zipf > 0 && len > 0) {
+        p->cdf = malloc(sizeof(double) * len);
+        if (!p->cdf) {
+            return -1;
+        }
+        double sum = 0;
+        for (int i = 0; i < len; i++) {
+            sum += pow(i + 1, -zipf);
+            p->cdf[i] = sum;
+        }
+        for (int i = 0; i < len; i++) {
+            p->cdf[i] /= sum;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Shuffle the keys of p, so that the popular ones are spread over the database instead of its first rows.
+*/
+static void pool_shuffle(key_pool *p, uint64_t *rng) {
+    for (int i = p->len - 1; i > 0; i--) {
+        int j = (int)(next_rand(rng) % (uint64_t)(i + 1));
+        unsigned long n = p->sub_nums[i];
+        char t = p->techs[i];
+        p->sub_nums[i] = p->sub_nums[j];
+        p->techs[i] = p->techs[j];
+        p->sub_nums[j] = n;
+        p->techs[j] = t;
+    }
+}
+
+static inline int pool_draw(const key_pool *p, uint64_t *rng) {
+    if (!p->cdf) {
+        return (int)(next_rand(rng) % (uint64_t)p->len);
+    }
+    double u = rand_unit(rng);
+    int lo = 0;
+    int hi = p->len - 1;
+    while (lo < hi) {  // first key whose cdf reaches u
+        int mid = (lo + hi) / 2;
+        if (p->cdf[mid] < u) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void pool_free(key_pool *p) {
+    free(p->sub_nums);
+    free(p->techs);
+    free(p->cdf);
+}
+
+/**
+ * Fill the hit and unpaid pools from db, and the miss pool with random subscriber numbers that are not in it.
+ * Return 0 on success; -1 on error.
+*/
+static int build_pools(load_shared *sh, const sub_db *db) {
+    const load_opts *opts = sh->opts;
+    int num_paid = 0;
+    int num_unpaid = 0;
+    for (int i = 0; i < db->len; i++) {
+        if (db->sub_techs[i] != (char)INVALID_TECHNOLOGY) {
+            num_paid += db->sub_paid_arr[i] != 0;
+            num_unpaid += db->sub_paid_arr[i] == 0;
+        }
+    }
+    int num_misses = db->len < LOAD_MAX_MISSES ? (db->len > 0 ? db->len : 1) : LOAD_MAX_MISSES;
+    if (pool_init(&sh->pools[LOAD_HIT], num_paid, opts->zipf) < 0 || pool_init(&sh->pools[LOAD_UNPAID], num_unpaid, opts->zipf) < 0 ||
+        pool_init(&sh->pools[LOAD_MISS], num_misses, opts->zipf) < 0) {
+        log_error("Load: out of memory for the query pools.");
+        return -1;
+    }
+    num_paid = 0;
+    num_unpaid = 0;
+    for (int i = 0; i < db->len; i++) {
+        if (db->sub_techs[i] == (char)INVALID_TECHNOLOGY) {
+            continue;
+        }
+        key_pool *p = &sh->pools[db->sub_paid_arr[i] ? LOAD_HIT : LOAD_UNPAID];
+        int j = db->sub_paid_arr[i] ? num_paid++ : num_unpaid++;
+        p->sub_nums[j] = db->sub_nums[i];
+        p->techs[j] = db->sub_techs[i];
+    }
+
+    sub_index idx;
+    if (sub_index_build(&idx, db->sub_nums, db->len) < 0) {
+        log_error("Load: could not index the database.");
+        return -1;
+    }
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    key_pool *miss = &sh->pools[LOAD_MISS];
+    for (int j = 0; j < miss->len; j++) {
+        unsigned long n;
+        do {
+            n = 1000000000UL + (unsigned long)(next_rand(&rng) % 9000000000ULL);  // ten digits, like a phone number
+        } while (sub_index_find(&idx, db->sub_nums, n) >= 0);
+        miss->sub_nums[j] = n;
+        miss->techs[j] = (char)(1 + next_rand(&rng) % 5);
+    }
+    sub_index_free(&idx);
+
+    for (int k = 0; k < LOAD_NUM_KINDS; k++) {
+        pool_shuffle(&sh->pools[k], &rng);
+        if (opts->mix[k] > 0 && sh->pools[k].len == 0) {
+            log_error("Load: the mix asks for %s queries, but the database has no such subscriber.", k == LOAD_HIT ? "hit" : "unpaid");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Send a new query from slot, drawn from the mix.
+*/
+static void issue(load_worker *w, int slot) {
+    const load_shared *sh = w->shared;
+    load_slot *s = &w->slots[slot];
+    int r = (int)(next_rand(&w->rng) % (uint64_t)sh->mix_total);
+    int kind = 0;
+    while (r >= sh->opts->mix[kind]) {
+        r -= sh->opts->mix[kind];
+        kind++;
+    }
+    const key_pool *p = &sh->pools[kind];
+    int key = pool_draw(p, &w->rng);
+
+    s->kind = kind;
+    s->gen = (s->gen + 1) % (256 / sh->opts->depth);
+    message_packet pkt;
+    pkt.start_id = START_ID;
+    pkt.client_id = (char)w->id;
+    pkt.type = ACC_PER;
+    pkt.seg_num = (char)(slot + sh->opts->depth * s->gen);
+    pkt.length = WIRE_MESSAGE_PAYLOAD_LEN;
+    pkt.technology = p->techs[key];
+    pkt.sub_num = p->sub_nums[key];
+    pkt.end_id = END_ID;
+    wire_encode_message(&pkt, s->buf, sizeof(s->buf));
+
+    s->attempts = 1;
+    s->sent_us = rtt_now_us();
+    s->deadline_us = s->sent_us + rtt_timeout_ms(&w->rtt) * 1000L;
+    w->sent++;
+    if (sendto(w->sock_fd, s->buf, WIRE_MESSAGE_LEN, 0, (const struct sockaddr *)sh->server_addr, sizeof(struct sockaddr_in)) < 0) {
+        log_warn("Load worker %d: sendto() failed, retrying on timeout.", w->id);
+    }
+}
+
+/**
+ * Take the response in buf[0..len) to one of w's slots, and send the slot's next query.
+*/
+static void take_response(load_worker *w, const unsigned char *buf, int len, long now_us) {
+    int depth = w->shared->opts->depth;
+    message_packet rsp;
+    if (wire_decode_message(&rsp, buf, len) < 0 || rsp.client_id != (char)w->id) {
+        w->stale++;
+        return;
+    }
+    unsigned char seq = (unsigned char)rsp.seg_num;
+    int slot = seq % depth;
+    load_slot *s = &w->slots[slot];
+    if (slot + depth * s->gen != seq || s->attempts == 0) {
+        w->stale++;  // late answer to a request that was answered or given up already
+        return;
+    }
+    int kind;
+    if (rsp.type == (short)ACC_OK) {
+        kind = LOAD_HIT;
+    } else if (rsp.type == (short)NOT_PAID) {
+        kind = LOAD_UNPAID;
+    } else {
+        kind = LOAD_MISS;
+    }
+    w->answered++;
+    w->responses[kind]++;
+    w->wrong += kind != s->kind;
+    if (s->attempts == 1) {  // Karn's algorithm: retransmitted requests give ambiguous samples
+        rtt_sample(&w->rtt, now_us - s->sent_us);
+    }
+    s->attempts = 0;
+    if (now_us < w->shared->end_us) {
+        issue(w, slot);
+    }
+}
+
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void log_lock(bool lock, void *udata) {
+    if (lock) {
+        pthread_mutex_lock(udata);
+    } else {
+        pthread_mutex_unlock(udata);
+    }
+}
+
+static void *load_worker_loop(void *arg) {
+    load_worker *w = arg;
+    const load_shared *sh = w->shared;
+    int depth = sh->opts->depth;
+    unsigned char buf[WIRE_MESSAGE_LEN + 1];  // one more byte, so that a longer datagram fails to decode
+    struct pollfd pfd = {.fd = w->sock_fd, .events = POLLIN};
+
+    for (int i = 0; i < depth; i++) {
+        issue(w, i);
+    }
+    while (TRUE) {
+        long now_us = rtt_now_us();
+        if (now_us >= sh->end_us) {
+            break;
+        }
+        long wait_us = sh->end_us - now_us;
+        for (int i = 0; i < depth; i++) {
+            if (w->slots[i].attempts > 0 && w->slots[i].deadline_us - now_us < wait_us) {
+                wait_us = w->slots[i].deadline_us - now_us;
+            }
+        }
+        if (poll(&pfd, 1, wait_us > 0 ? (int)((wait_us + 999) / 1000) : 0) < 0) {
+            log_error("Load worker %d: poll() failed. Stop.", w->id);
+            break;
+        }
+        if (pfd.revents & POLLIN) {
+            int len;
+            while ((len = (int)recv(w->sock_fd, buf, sizeof(buf), MSG_DONTWAIT)) >= 0) {
+                take_response(w, buf, len, rtt_now_us());
+            }
+        }
+
+        // Timers that expire together stand for one congestion event (e.g. a server stall), so the shared RTO
+        // backs off once per pass, not once per expired slot, which would pin it at the maximum at high depth.
+        now_us = rtt_now_us();
+        int backed_off = FALSE;
+        for (int i = 0; i < depth; i++) {
+            load_slot *s = &w->slots[i];
+            if (s->attempts == 0 || s->deadline_us > now_us) {
+                continue;
+            }
+            if (!backed_off) {
+                rtt_backoff(&w->rtt);
+                backed_off = TRUE;
+            }
+            w->retransmits++;
+            if (s->attempts >= CLIENT_MAX_ATTEMPTS) {
+                w->lost++;
+                s->attempts = 0;
+                if (now_us < sh->end_us) {
+                    issue(w, i);
+                }
+                continue;
+            }
+            s->attempts++;
+            s->deadline_us = now_us + rtt_timeout_ms(&w->rtt) * 1000L;
+            sendto(w->sock_fd, s->buf, WIRE_MESSAGE_LEN, 0, (const struct sockaddr *)sh->server_addr, sizeof(struct sockaddr_in));
+        }
+    }
+    return NULL;
+}
+
+static int cmp_long(const void *a, const void *b) {
+    long x = *(const long *)a;
+    long y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Log the totals over every worker: the capacity report.
+*/
+static void report(load_worker *workers, const load_opts *opts, long elapsed_us) {
+    unsigned long sent = 0, answered = 0, lost = 0, stale = 0, wrong = 0, retransmits = 0;
+    unsigned long responses[LOAD_NUM_KINDS] = {0};
+    size_t num_samples = 0;
+    for (int i = 0; i < opts->num_workers; i++) {
+        load_worker *w = &workers[i];
+        log_info("Worker %d (client_id %d): %lu sent, %lu answered, %lu lost, %lu retransmits", w->id, w->id, w->sent, w->answered, w->lost, w->retransmits);
+        sent += w->sent;
+        answered += w->answered;
+        lost += w->lost;
+        stale += w->stale;
+        wrong += w->wrong;
+        retransmits += w->retransmits;
+        for (int k = 0; k < LOAD_NUM_KINDS; k++) {
+            responses[k] += w->responses[k];
+        }
+        num_samples += w->rtt.num_samples;
+    }
+    double elapsed_s = elapsed_us / 1e6;
+    log_info("Load: %d workers x %d outstanding, mix %d/%d/%d hit/miss/unpaid, Zipf %.2f, %.1f s",
+             opts->num_workers, opts->depth, opts->mix[LOAD_HIT], opts->mix[LOAD_MISS], opts->mix[LOAD_UNPAID], opts->zipf, elapsed_s);
+    log_info("Load: %lu sent, %lu answered, %lu lost (%.3f%%), %lu retransmits, %lu stale",
+             sent, answered, lost, sent > 0 ? 100.0 * lost / sent : 0.0, retransmits, stale);
+    log_info("Load: %lu ACC_OK, %lu NOT_EXIST, %lu NOT_PAID, %lu not matching the query",
+             responses[LOAD_HIT], responses[LOAD_MISS], responses[LOAD_UNPAID], wrong);
+
+    long *samples = num_samples > 0 ? malloc(sizeof(long) * num_samples) : NULL;
+    if (samples) {
+        size_t n = 0;
+        for (int i = 0; i < opts->num_workers; i++) {
+            memcpy(samples + n, workers[i].rtt.samples_us, sizeof(long) * workers[i].rtt.num_samples);
+            n += workers[i].rtt.num_samples;
+        }
+        qsort(samples, n, sizeof(long), cmp_long);
+        log_info("Load: RTT over %zu samples (us): p50 %ld, p90 %ld, p99 %ld, p99.9 %ld, max %ld", n,
+                 samples[(size_t)(0.5 * (n - 1))], samples[(size_t)(0.9 * (n - 1))], samples[(size_t)(0.99 * (n - 1))],
+                 samples[(size_t)(0.999 * (n - 1))], samples[n - 1]);
+        free(samples);
+    }
+    log_info("Load: capacity %.0f verifications/s at %d outstanding requests", elapsed_s > 0 ? answered / elapsed_s : 0.0,
+             opts->num_workers * opts->depth);
+}
+
+int load_run(const sub_db *db, const struct sockaddr_in *server_addr, const load_opts *opts) {
+    load_shared sh;
+    memset(&sh, 0, sizeof(sh));
+    sh.opts = opts;
+    sh.server_addr = server_addr;
+    for (int k = 0; k < LOAD_NUM_KINDS; k++) {
+        sh.mix_total += opts->mix[k];
+    }
+    int ret = build_pools(&sh, db);
+    load_worker *workers = ret == 0 ? calloc(opts->num_workers, sizeof(load_worker)) : NULL;
+    if (!workers) {
+        for (int k = 0; k < LOAD_NUM_KINDS; k++) {
+            pool_free(&sh.pools[k]);
+        }
+        return -1;
+    }
+
+    log_set_lock(log_lock, &log_mutex);  // the workers log next to each other
+    int num_started = 0;
+    long start_us = rtt_now_us();
+    sh.end_us = start_us + opts->duration_s * 1000000L;
+    for (int i = 0; i < opts->num_workers; i++) {
+        load_worker *w = &workers[i];
+        w->id = i;
+        w->shared = &sh;
+        w->rng = 0x2545F4914F6CDD1DULL * (uint64_t)(i + 1);
+        rtt_init(&w->rtt, CLIENT_INITIAL_RTO, CLIENT_MIN_RTO, CLIENT_RECV_TIMEOUT);
+        w->sock_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (w->sock_fd < 0 || pthread_create(&w->thread, NULL, load_worker_loop, w) != 0) {
+            log_error("Load: could not start worker %d.", i);
+            ret = -1;
+            break;
+        }
+        num_started++;
+    }
+    for (int i = 0; i < num_started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    if (ret == 0) {
+        report(workers, opts, rtt_now_us() - start_us);
+    }
+    unsigned long answered = 0;
+    for (int i = 0; i < num_started; i++) {
+        answered += workers[i].answered;
+        ret = workers[i].wrong > 0 ? -1 : ret;
+        close(workers[i].sock_fd);
+        rtt_free(&workers[i].rtt);
+    }
+    if (num_started < opts->num_workers) {  // the worker that failed to start
+        if (workers[num_started].sock_fd >= 0) {
+            close(workers[num_started].sock_fd);
+        }
+        rtt_free(&workers[num_started].rtt);
+    }
+    if (answered == 0) {
+        log_error("Load: the server answered no request.");
+        ret = -1;
+    }
+    free(workers);
+    for (int k = 0; k < LOAD_NUM_KINDS; k++) {
+        pool_free(&sh.pools[k]);
+    }
+    return ret;
+}
@@ -0,0 +1,53 @@
+#ifndef LOAD_H
+#define LOAD_H
+
+#include <netinet/in.h>
+
+#include "sub_db.h"
+
+// Defaults of the client's load mode.
+#ifndef LOAD_DEFAULT_DURATION_S
+#define LOAD_DEFAULT_DURATION_S 5
+#endif
+
+#ifndef LOAD_MAX_DEPTH
+#define LOAD_MAX_DEPTH 128
+#endif
+
+// Most distinct unknown subscriber numbers a run draws its misses from.
+#ifndef LOAD_MAX_MISSES
+#define LOAD_MAX_MISSES 65536
+#endif
+
+// Kinds of query in the load mix, and the response the server must give to each.
+#define LOAD_HIT 0     // paid subscriber with its own technology: ACC_OK
+#define LOAD_MISS 1    // subscriber number not in the database: NOT_EXIST
+#define LOAD_UNPAID 2  // subscriber that has not paid: NOT_PAID
+#define LOAD_NUM_KINDS 3
+
+typedef struct load_opts {
+    int num_workers;           // threads, each with its own socket and client_id
+    int depth;                 // requests each worker keeps outstanding, 1..LOAD_MAX_DEPTH
+    int duration_s;            // seconds to send for
+    int mix[LOAD_NUM_KINDS];   // relative weight of each kind of query
+    double zipf;               // Zipf exponent of subscriber popularity, 0 = uniform
+} load_opts;
+
+/**
+ * Parse a mix such as "80,10,10" (hit, miss, unpaid weights) into mix.
+ * Return 0 on success; -1 if it is malformed or all weights are 0.
+*/
+int load_parse_mix(const char *spec, int mix[LOAD_NUM_KINDS]);
+
+/**
+ * Closed-loop load: num_workers threads each keep depth ACC_PER requests outstanding against server_addr
+ * for duration_s seconds. Every query is drawn from db according to the mix, with Zipf-skewed popularity
+ * within each kind, and its response is checked against the kind. Requests are retransmitted on the
+ * adaptive RTO (rtt.h) and counted lost after CLIENT_MAX_ATTEMPTS transmissions. The aggregate throughput,
+ * outcome counts and RTT percentiles are logged at the end, which is the server's capacity at this
+ * concurrency (num_workers * depth).
+ * Return 0 if the server answered, and answered every query right; -1 otherwise.
+*/
+int load_run(const sub_db *db, const struct sockaddr_in *server_addr, const load_opts *opts);
+
+#endif
@@ -21,6 +21,16 @@
  */
 
 #include "log.h"
+#include "trace.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
 
 #define MAX_CALLBACKS 32
 
@@ -35,9 +45,19 @@ static struct {
   log_LockFn lock;
   int level;
   bool quiet;
+  int min_level;  /* lowest level any sink wants, for the early-out in log_log() */
   Callback callbacks[MAX_CALLBACKS];
 } L;
 
+/* Broken-down time and formatted prefixes of the last second an event was
+ * logged in, rebuilt at most once per second. Guarded by the log lock. */
+static struct {
+  time_t sec;
+  struct tm tm;
+  char hms[16];
+  char ymd_hms[32];
+} T = { .sec = (time_t)-1 };
+
 
 static const char *level_strings[] = {
   "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"
@@ -52,7 +72,11 @@ static const char *level_colors[] = {
 
 static void stdout_callback(log_Event *ev) {
   char buf[16];
-  buf[strftime(buf, sizeof(buf), "%H:%M:%S", ev->time)] = '\0';
+  if (ev->time == &T.tm) {
+    memcpy(buf, T.hms, sizeof(buf));
+  } else {
+    buf[strftime(buf, sizeof(buf), "%H:%M:%S", ev->time)] = '\0';
+  }
 #ifdef LOG_USE_COLOR
   fprintf(
     ev->udata, "%s %s%-5s\x1b[0m \x1b[90m%s:%d:\x1b[0m ",
@@ -71,7 +95,11 @@ static void stdout_callback(log_Event *ev) {
 
 static void file_callback(log_Event *ev) {
   char buf[64];
-  buf[strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", ev->time)] = '\0';
+  if (ev->time == &T.tm) {
+    memcpy(buf, T.ymd_hms, sizeof(T.ymd_hms));
+  } else {
+    buf[strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", ev->time)] = '\0';
+  }
   fprintf(
     ev->udata, "%s %-5s %s:%d: ",
     buf, level_strings[ev->level], ev->file, ev->line);
@@ -102,13 +130,24 @@ void log_set_lock(log_LockFn fn, void *udata) {
 }
 
 
+static void update_min_level(void) {
+  int min = L.quiet ? LOG_FATAL + 1 : L.level;
+  for (int i = 0; i < MAX_CALLBACKS && L.callbacks[i].fn; i++) {
+    if (L.callbacks[i].level < min) { min = L.callbacks[i].level; }
+  }
+  L.min_level = min;
+}
+
+
 void log_set_level(int level) {
   L.level = level;
+  update_min_level();
 }
 
 
 void log_set_quiet(bool enable) {
   L.quiet = enable;
+  update_min_level();
 }
 
 
@@ -116,6 +155,7 @@ int log_add_callback(log_LogFn fn, void *udata, int level) {
   for (int i = 0; i < MAX_CALLBACKS; i++) {
     if (!L.callbacks[i].fn) {
       L.callbacks[i] = (Callback) { fn, udata, level };
+      update_min_level();
       return 0;
     }
   }
@@ -131,13 +171,41 @@ int log_add_fp(FILE *fp, int level) {
 static void init_event(log_Event *ev, void *udata) {
   if (!ev->time) {
     time_t t = time(NULL);
-    ev->time = localtime(&t);
+    if (t != T.sec) {
+      localtime_r(&t, &T.tm);
+      strftime(T.hms, sizeof(T.hms), "%H:%M:%S", &T.tm);
+      strftime(T.ymd_hms, sizeof(T.ymd_hms), "%Y-%m-%d %H:%M:%S", &T.tm);
+      T.sec = t;
+    }
+    ev->time = &T.tm;
   }
   ev->udata = udata;
 }
 
 
+static bool log_async_enqueue(int level, const char *file, int line, const char *fmt, va_list ap);
+static atomic_bool async_enabled;
+static atomic_uint async_producers;  /* log_log() calls between the async_enabled check and the enqueue */
+
+
 void log_log(int level, const char *file, int line, const char *fmt, ...) {
+  if (level < L.min_level) { return; }  /* nobody wants it: skip the lock and the clock */
+  TRACE_START(trace_start);
+
+  if (level < LOG_FATAL && atomic_load_explicit(&async_enabled, memory_order_relaxed)) {
+    /* Announce ourselves before the second check, so log_async_stop() either sees us or we see it. */
+    bool queued = false;
+    atomic_fetch_add(&async_producers, 1);
+    if (atomic_load(&async_enabled)) {
+      va_list ap;
+      va_start(ap, fmt);
+      queued = log_async_enqueue(level, file, line, fmt, ap);
+      va_end(ap);
+    }
+    atomic_fetch_sub_explicit(&async_producers, 1, memory_order_release);
+    if (queued) { TRACE_END(TRACE_LOG, trace_start); return; }
+  }
+
   log_Event ev = {
     .fmt   = fmt,
     .file  = file,
@@ -165,4 +233,421 @@ void log_log(int level, const char *file, int line, const char *fmt, ...) {
   }
 
   unlock();
+  TRACE_END(TRACE_LOG, trace_start);
+}
+
+
+/* ======================== ASYNC BACKEND ======================== */
+
+#define ASYNC_MAX_ARGS   16
+#define ASYNC_STR_BYTES  192
+#define ASYNC_LINE_BYTES 1024
+#define ASYNC_BATCH_BYTES (64 * 1024)
+#define ASYNC_IDLE_NS    1000000
+
+enum { ARG_INT, ARG_UINT, ARG_DOUBLE, ARG_LDOUBLE, ARG_PTR, ARG_STR };
+
+typedef union {
+  long long i;
+  unsigned long long u;
+  double d;
+  long double ld;
+  const void *p;
+  size_t str_off;
+} AsyncArg;
+
+/* One ring slot: a log_log() call with its arguments captured by value. */
+typedef struct {
+  atomic_size_t seq;
+  int level;
+  int line;
+  const char *file;
+  const char *fmt;
+  time_t time;
+  int num_args;
+  unsigned char types[ASYNC_MAX_ARGS];
+  AsyncArg args[ASYNC_MAX_ARGS];
+  size_t str_used;
+  char strs[ASYNC_STR_BYTES];
+} AsyncRecord;
+
+static struct {
+  AsyncRecord *ring;
+  size_t mask;
+  atomic_size_t enqueue_pos;
+  size_t dequeue_pos;
+  atomic_ulong dropped;
+  unsigned long dropped_reported;
+  atomic_bool running;
+  pthread_t thread;
+  bool atexit_registered;
+} A;
+
+
+/* A printf conversion spec, parsed from fmt: [flags][width][.precision][length]conv */
+typedef struct {
+  const char *start;  /* the '%' */
+  const char *end;    /* one past the conversion character */
+  bool star_width;
+  bool star_prec;
+  int length;         /* 'H' hh, 'h', 'l', 'L' ll/L, 'j', 'z', 't', or 0 */
+  char conv;
+} FmtSpec;
+
+
+static const char *parse_spec(const char *p, FmtSpec *spec) {
+  spec->start = p++;
+  spec->star_width = spec->star_prec = false;
+  spec->length = 0;
+  while (*p && strchr("-+ #0'", *p)) { p++; }
+  if (*p == '*') { spec->star_width = true; p++; }
+  while (*p >= '0' && *p <= '9') { p++; }
+  if (*p == '.') {
+    p++;
+    if (*p == '*') { spec->star_prec = true; p++; }
+    while (*p >= '0' && *p <= '9') { p++; }
+  }
+  if (*p == 'h') { p++; spec->length = 'h'; if (*p == 'h') { p++; spec->length = 'H'; } }
+  else if (*p == 'l') { p++; spec->length = 'l'; if (*p == 'l') { p++; spec->length = 'L'; } }
+  else if (*p && strchr("Ljzt", *p)) { spec->length = *p++; }
+  spec->conv = *p;
+  spec->end = *p ? p + 1 : p;
+  return spec->end;
+}
+
+
+/* Pull the arguments of one log_log() call out of ap, typed by fmt. */
+static bool capture_args(AsyncRecord *r, const char *fmt, va_list ap) {
+  r->num_args = 0;
+  r->str_used = 0;
+  for (const char *p = fmt; *p; ) {
+    if (*p != '%') { p++; continue; }
+    if (p[1] == '%') { p += 2; continue; }
+    FmtSpec spec;
+    p = parse_spec(p, &spec);
+    int needed = spec.star_width + spec.star_prec + 1;
+    if (r->num_args + needed > ASYNC_MAX_ARGS) { return false; }
+    if (spec.star_width) {
+      r->types[r->num_args] = ARG_INT;
+      r->args[r->num_args++].i = va_arg(ap, int);
+    }
+    if (spec.star_prec) {
+      r->types[r->num_args] = ARG_INT;
+      r->args[r->num_args++].i = va_arg(ap, int);
+    }
+    AsyncArg *arg = &r->args[r->num_args];
+    unsigned char *type = &r->types[r->num_args];
+    switch (spec.conv) {
+      case 'd': case 'i':
+        *type = ARG_INT;
+        switch (spec.length) {
+          case 'l': arg->i = va_arg(ap, long); break;
+          case 'L': arg->i = va_arg(ap, long long); break;
+          case 'j': arg->i = va_arg(ap, intmax_t); break;
+          case 'z': arg->i = va_arg(ap, ssize_t); break;
+          case 't': arg->i = va_arg(ap, ptrdiff_t); break;
+          default:  arg->i = va_arg(ap, int); break;
+        }
+        break;
+      case 'c':
+        *type = ARG_INT;
+        arg->i = va_arg(ap, int);
+        break;
+      case 'u': case 'o': case 'x': case 'X':
+        *type = ARG_UINT;
+        switch (spec.length) {
+          case 'l': arg->u = va_arg(ap, unsigned long); break;
+          case 'L': arg->u = va_arg(ap, unsigned long long); break;
+          case 'j': arg->u = va_arg(ap, uintmax_t); break;
+          case 'z': arg->u = va_arg(ap, size_t); break;
+          case 't': arg->u = va_arg(ap, ptrdiff_t); break;
+          default:  arg->u = va_arg(ap, unsigned int); break;
+        }
+        break;
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        if (spec.length == 'L') {
+          *type = ARG_LDOUBLE;
+          arg->ld = va_arg(ap, long double);
+        } else {
+          *type = ARG_DOUBLE;
+          arg->d = va_arg(ap, double);
+        }
+        break;
+      case 'p':
+        *type = ARG_PTR;
+        arg->p = va_arg(ap, void *);
+        break;
+      case 's': {
+        /* The string may not outlive the call (e.g. inet_ntoa()), so copy it. */
+        const char *str = va_arg(ap, const char *);
+        size_t len = str ? strlen(str) : 6;
+        size_t room = ASYNC_STR_BYTES - r->str_used;
+        if (room == 0) { return false; }
+        if (len >= room) { len = room - 1; }
+        memcpy(r->strs + r->str_used, str ? str : "(null)", len);
+        r->strs[r->str_used + len] = '\0';
+        *type = ARG_STR;
+        arg->str_off = r->str_used;
+        r->str_used += len + 1;
+        break;
+      }
+      default:
+        return false;  /* %n or something we cannot capture safely */
+    }
+    r->num_args++;
+  }
+  return true;
+}
+
+
+/* Format a captured record into buf, one conversion spec at a time. */
+static void format_record(const AsyncRecord *r, char *buf, size_t size) {
+  size_t used = 0;
+  int next = 0;
+  char spec_buf[64];
+  for (const char *p = r->fmt; *p && used + 1 < size; ) {
+    if (*p != '%') { buf[used++] = *p++; continue; }
+    if (p[1] == '%') { buf[used++] = '%'; p += 2; continue; }
+    FmtSpec spec;
+    p = parse_spec(p, &spec);
+    /* Rebuild the spec with any '*' replaced by the captured value. */
+    size_t n = 0;
+    for (const char *q = spec.start; q < spec.end && n + 12 < sizeof(spec_buf); q++) {
+      if (*q == '*') {
+        n += snprintf(spec_buf + n, sizeof(spec_buf) - n, "%lld", r->args[next++].i);
+      } else {
+        spec_buf[n++] = *q;
+      }
+    }
+    spec_buf[n] = '\0';
+    const AsyncArg *arg = &r->args[next];
+    int w = 0;
+    switch (r->types[next]) {
+      case ARG_INT:
+        switch (spec.length) {
+          case 'l': w = snprintf(buf + used, size - used, spec_buf, (long)arg->i); break;
+          case 'L': w = snprintf(buf + used, size - used, spec_buf, (long long)arg->i); break;
+          case 'j': w = snprintf(buf + used, size - used, spec_buf, (intmax_t)arg->i); break;
+          case 'z': w = snprintf(buf + used, size - used, spec_buf, (ssize_t)arg->i); break;
+          case 't': w = snprintf(buf + used, size - used, spec_buf, (ptrdiff_t)arg->i); break;
+          default:  w = snprintf(buf + used, size - used, spec_buf, (int)arg->i); break;
+        }
+        break;
+      case ARG_UINT:
+        switch (spec.length) {
+          case 'l': w = snprintf(buf + used, size - used, spec_buf, (unsigned long)arg->u); break;
+          case 'L': w = snprintf(buf + used, size - used, spec_buf, (unsigned long long)arg->u); break;
+          case 'j': w = snprintf(buf + used, size - used, spec_buf, (uintmax_t)arg->u); break;
+          case 'z': w = snprintf(buf + used, size - used, spec_buf, (size_t)arg->u); break;
+          case 't': w = snprintf(buf + used, size - used, spec_buf, (ptrdiff_t)arg->u); break;
+          default:  w = snprintf(buf + used, size - used, spec_buf, (unsigned int)arg->u); break;
+        }
+        break;
+      case ARG_DOUBLE:  w = snprintf(buf + used, size - used, spec_buf, arg->d); break;
+      case ARG_LDOUBLE: w = snprintf(buf + used, size - used, spec_buf, arg->ld); break;
+      case ARG_PTR:     w = snprintf(buf + used, size - used, spec_buf, arg->p); break;
+      case ARG_STR:     w = snprintf(buf + used, size - used, spec_buf, r->strs + arg->str_off); break;
+    }
+    next++;
+    if (w > 0) { used += (size_t)w < size - used ? (size_t)w : size - used - 1; }
+  }
+  buf[used] = '\0';
+}
+
+
+static bool log_async_enqueue(int level, const char *file, int line, const char *fmt, va_list ap) {
+  /* Bounded MPMC queue (Vyukov): claim a slot by advancing enqueue_pos. */
+  AsyncRecord *r;
+  size_t pos = atomic_load_explicit(&A.enqueue_pos, memory_order_relaxed);
+  for (;;) {
+    r = &A.ring[pos & A.mask];
+    size_t seq = atomic_load_explicit(&r->seq, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&A.enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      atomic_fetch_add_explicit(&A.dropped, 1, memory_order_relaxed);
+      return true;  /* ring full: drop rather than block the caller */
+    } else {
+      pos = atomic_load_explicit(&A.enqueue_pos, memory_order_relaxed);
+    }
+  }
+
+  r->level = level;
+  r->file = file;
+  r->line = line;
+  r->fmt = fmt;
+  r->time = time(NULL);
+  if (!capture_args(r, fmt, ap)) {
+    /* Too many or unsupported arguments: keep the format string as the message. */
+    r->fmt = "%s";
+    r->num_args = 1;
+    r->types[0] = ARG_STR;
+    r->args[0].str_off = 0;
+    size_t len = strlen(fmt);
+    if (len >= ASYNC_STR_BYTES) { len = ASYNC_STR_BYTES - 1; }
+    memcpy(r->strs, fmt, len);
+    r->strs[len] = '\0';
+  }
+  atomic_store_explicit(&r->seq, pos + 1, memory_order_release);
+  return true;
+}
+
+
+/* Hand an already formatted message to a callback, which expects fmt + va_list. */
+static void dispatch(Callback *cb, log_Event *ev, const char *fmt, ...) {
+  ev->fmt = fmt;
+  ev->udata = cb->udata;
+  va_start(ev->ap, fmt);
+  cb->fn(ev);
+  va_end(ev->ap);
+}
+
+
+static size_t append_line(char *batch, size_t used, int level, const char *file, int line, const char *ts, const char *msg) {
+  int w;
+#ifdef LOG_USE_COLOR
+  w = snprintf(batch + used, ASYNC_BATCH_BYTES - used, "%s %s%-5s\x1b[0m \x1b[90m%s:%d:\x1b[0m %s\n",
+               ts, level_colors[level], level_strings[level], file, line, msg);
+#else
+  w = snprintf(batch + used, ASYNC_BATCH_BYTES - used, "%s %-5s %s:%d: %s\n",
+               ts, level_strings[level], file, line, msg);
+#endif
+  if (w < 0) { return used; }
+  return used + ((size_t)w < ASYNC_BATCH_BYTES - used ? (size_t)w : ASYNC_BATCH_BYTES - used - 1);
+}
+
+
+/* Drain everything queued so far. Return the number of records written. */
+static size_t log_async_drain(char *batch) {
+  size_t count = 0;
+  size_t used = 0;
+  char msg[ASYNC_LINE_BYTES];
+  time_t tm_sec = (time_t)-1;
+  struct tm tm;
+  char ts[16];
+
+  for (;;) {
+    AsyncRecord *r = &A.ring[A.dequeue_pos & A.mask];
+    size_t seq = atomic_load_explicit(&r->seq, memory_order_acquire);
+    if ((intptr_t)seq - (intptr_t)(A.dequeue_pos + 1) != 0) { break; }
+
+    format_record(r, msg, sizeof(msg));
+    if (r->time != tm_sec) {
+      tm_sec = r->time;
+      localtime_r(&tm_sec, &tm);
+      strftime(ts, sizeof(ts), "%H:%M:%S", &tm);
+    }
+    if (!L.quiet && r->level >= L.level) {
+      if (used + ASYNC_LINE_BYTES + 256 > ASYNC_BATCH_BYTES) {
+        fwrite(batch, 1, used, stderr);
+        used = 0;
+      }
+      used = append_line(batch, used, r->level, r->file, r->line, ts, msg);
+    }
+    for (int i = 0; i < MAX_CALLBACKS && L.callbacks[i].fn; i++) {
+      Callback *cb = &L.callbacks[i];
+      if (r->level >= cb->level) {
+        log_Event ev = { .file = r->file, .line = r->line, .level = r->level, .time = &tm };
+        dispatch(cb, &ev, "%s", msg);
+      }
+    }
+
+    atomic_store_explicit(&r->seq, A.dequeue_pos + A.mask + 1, memory_order_release);
+    A.dequeue_pos++;
+    count++;
+  }
+
+  unsigned long dropped = atomic_load_explicit(&A.dropped, memory_order_relaxed);
+  if (dropped != A.dropped_reported && !L.quiet) {
+    time_t now = time(NULL);
+    localtime_r(&now, &tm);
+    strftime(ts, sizeof(ts), "%H:%M:%S", &tm);
+    snprintf(msg, sizeof(msg), "log: ring buffer full, dropped %lu messages (%lu total)", dropped - A.dropped_reported, dropped);
+    used = append_line(batch, used, LOG_WARN, __FILE__, __LINE__, ts, msg);
+    A.dropped_reported = dropped;
+  }
+  if (used > 0) {
+    fwrite(batch, 1, used, stderr);
+    fflush(stderr);
+  }
+  return count;
+}
+
+
+static void *log_async_thread(void *arg) {
+  char *batch = arg;
+  struct timespec idle = { 0, ASYNC_IDLE_NS };
+  while (atomic_load_explicit(&A.running, memory_order_acquire)) {
+    if (log_async_drain(batch) == 0) {
+      nanosleep(&idle, NULL);
+    }
+  }
+  log_async_drain(batch);
+  free(batch);
+  return NULL;
+}
+
+
+static void log_async_atexit(void) {
+  log_async_stop();
+}
+
+
+int log_async_start(size_t capacity) {
+  if (atomic_load(&A.running)) { return 0; }
+  size_t size = 2;
+  while (size < capacity) { size <<= 1; }
+
+  A.ring = calloc(size, sizeof(AsyncRecord));
+  char *batch = malloc(ASYNC_BATCH_BYTES);
+  if (!A.ring || !batch) {
+    free(A.ring);
+    free(batch);
+    A.ring = NULL;
+    return -1;
+  }
+  for (size_t i = 0; i < size; i++) {
+    atomic_init(&A.ring[i].seq, i);
+  }
+  A.mask = size - 1;
+  atomic_store(&A.enqueue_pos, 0);
+  A.dequeue_pos = 0;
+  atomic_store(&A.dropped, 0);
+  A.dropped_reported = 0;
+  atomic_store(&A.running, true);
+  if (pthread_create(&A.thread, NULL, log_async_thread, batch) != 0) {
+    atomic_store(&A.running, false);
+    free(A.ring);
+    free(batch);
+    A.ring = NULL;
+    return -1;
+  }
+  if (!A.atexit_registered) {
+    atexit(log_async_atexit);  /* flush whatever is queued when the process exits */
+    A.atexit_registered = true;
+  }
+  atomic_store(&async_enabled, true);
+  return 0;
+}
+
+
+void log_async_stop(void) {
+  if (!atomic_load(&A.running)) { return; }
+  atomic_store(&async_enabled, false);
+  /* Wait for producers already past the check: their records must land before the last drain and the free. */
+  while (atomic_load_explicit(&async_producers, memory_order_acquire) > 0) {
+    sched_yield();
+  }
+  atomic_store_explicit(&A.running, false, memory_order_release);
+  pthread_join(A.thread, NULL);
+  free(A.ring);
+  A.ring = NULL;
+}
+
+
+unsigned long log_async_dropped(void) {
+  return atomic_load_explicit(&A.dropped, memory_order_relaxed);
 }
@@ -30,9 +30,31 @@ typedef void (*log_LockFn)(bool lock, void *udata);
 
 enum { LOG_TRACE, LOG_DEBUG, LOG_INFO, LOG_WARN, LOG_ERROR, LOG_FATAL };
 
+/* Compile-time floor: build with -DLOG_MIN_LEVEL=n (0 = TRACE .. 3 = WARN) to
+ * compile log_trace/log_debug/log_info calls below level n down to nothing.
+ * The arguments are still type-checked but never evaluated. log_warn and
+ * above are always kept. */
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+#define LOG_DISCARD(...) do { if (0) { log_log(__VA_ARGS__); } } while (0)
+
+#if LOG_MIN_LEVEL <= 0
 #define log_trace(...) log_log(LOG_TRACE, __FILE__, __LINE__, __VA_ARGS__)
+#else
+#define log_trace(...) LOG_DISCARD(LOG_TRACE, __FILE__, __LINE__, __VA_ARGS__)
+#endif
+#if LOG_MIN_LEVEL <= 1
 #define log_debug(...) log_log(LOG_DEBUG, __FILE__, __LINE__, __VA_ARGS__)
+#else
+#define log_debug(...) LOG_DISCARD(LOG_DEBUG, __FILE__, __LINE__, __VA_ARGS__)
+#endif
+#if LOG_MIN_LEVEL <= 2
 #define log_info(...)  log_log(LOG_INFO,  __FILE__, __LINE__, __VA_ARGS__)
+#else
+#define log_info(...)  LOG_DISCARD(LOG_INFO,  __FILE__, __LINE__, __VA_ARGS__)
+#endif
 #define log_warn(...)  log_log(LOG_WARN,  __FILE__, __LINE__, __VA_ARGS__)
 #define log_error(...) log_log(LOG_ERROR, __FILE__, __LINE__, __VA_ARGS__)
 #define log_fatal(...) log_log(LOG_FATAL, __FILE__, __LINE__, __VA_ARGS__)
@@ -46,4 +68,17 @@ int log_add_fp(FILE *fp, int level);
 
 void log_log(int level, const char *file, int line, const char *fmt, ...);
 
+/* Asynchronous mode: log_log() packs the level, file/line, format pointer and raw
+ * arguments into a lock-free ring buffer, and a background thread formats and
+ * writes them in batches. When the ring is full the message is dropped and
+ * counted instead of blocking the caller. LOG_FATAL is always written
+ * synchronously. The format string and file name must outlive the call
+ * (string literals), %s arguments are copied. log_async_stop() waits for
+ * log_log() calls still enqueueing, writes out the ring and frees it. */
+#define LOG_ASYNC_DEFAULT_CAPACITY 8192
+
+int log_async_start(size_t capacity);
+void log_async_stop(void);
+unsigned long log_async_dropped(void);
+
 #endif
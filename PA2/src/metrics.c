@@ -0,0 +1,162 @@
+#define _GNU_SOURCE
+#include "metrics.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "unix_sock.h"
+
+_Thread_local metrics_shard *metrics_local;
+
+/**
+ * Largest value that maps to bucket index.
+*/
+static uint64_t bucket_high(int index) {
+    if (index < METRICS_HIST_SUB_COUNT) {
+        return (uint64_t)index;
+    }
+    int shift = index / METRICS_HIST_SUB_COUNT - 1;
+    uint64_t low = (uint64_t)(index % METRICS_HIST_SUB_COUNT + METRICS_HIST_SUB_COUNT) << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+/**
+ * Service time at percentile p (0..100) of the total datagrams counted in latency, in microseconds.
+*/
+static double percentile_us(const unsigned long *latency, unsigned long total, uint64_t max_ns, double p) {
+    unsigned long rank = (unsigned long)(p / 100.0 * (double)total + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    unsigned long seen = 0;
+    for (int i = 0; i < METRICS_HIST_BUCKETS; i++) {
+        seen += latency[i];
+        if (seen >= rank) {
+            uint64_t high = bucket_high(i);
+            return (high < max_ns ? high : max_ns) / 1e3;
+        }
+    }
+    return max_ns / 1e3;
+}
+
+int metrics_init(metrics *m, int num_shards, const char *const *outcome_names, int num_outcomes) {
+    memset(m, 0, sizeof(*m));
+    m->listen_fd = -1;
+    m->shards = aligned_alloc(64, sizeof(metrics_shard) * (size_t)num_shards);
+    if (!m->shards || num_outcomes > METRICS_MAX_OUTCOMES) {
+        free(m->shards);
+        return -1;
+    }
+    memset(m->shards, 0, sizeof(metrics_shard) * (size_t)num_shards);
+    m->num_shards = num_shards;
+    m->outcome_names = outcome_names;
+    m->num_outcomes = num_outcomes;
+    clock_gettime(CLOCK_MONOTONIC, &m->started);
+    return 0;
+}
+
+void metrics_bind(metrics *m, int shard) {
+    metrics_local = &m->shards[shard];
+}
+
+void metrics_report(metrics *m, FILE *out) {
+    unsigned long outcomes[METRICS_MAX_OUTCOMES] = {0};
+    unsigned long *latency = calloc(METRICS_HIST_BUCKETS, sizeof(unsigned long));
+    unsigned long total = 0;  // datagrams with a service time
+    unsigned long sum_ns = 0;
+    uint64_t max_ns = 0;
+    if (!latency) {
+        fprintf(out, "error out of memory\n");
+        return;
+    }
+    for (int s = 0; s < m->num_shards; s++) {
+        metrics_shard *shard = &m->shards[s];
+        for (int i = 0; i < m->num_outcomes; i++) {
+            outcomes[i] += atomic_load_explicit(&shard->outcomes[i], memory_order_relaxed);
+        }
+        for (int i = 0; i < METRICS_HIST_BUCKETS; i++) {
+            unsigned long n = atomic_load_explicit(&shard->latency[i], memory_order_relaxed);
+            latency[i] += n;
+            total += n;
+        }
+        sum_ns += atomic_load_explicit(&shard->latency_sum_ns, memory_order_relaxed);
+        uint64_t shard_max = atomic_load_explicit(&shard->latency_max_ns, memory_order_relaxed);
+        max_ns = shard_max > max_ns ? shard_max : max_ns;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    fprintf(out, "uptime_s %.1f\n", (now.tv_sec - m->started.tv_sec) + (now.tv_nsec - m->started.tv_nsec) / 1e9);
+    unsigned long requests = 0;
+    for (int i = 0; i < m->num_outcomes; i++) {
+        requests += outcomes[i];
+    }
+    for (int i = 0; i < m->num_outcomes; i++) {
+        fprintf(out, "outcome %s %lu %.2f%%\n", m->outcome_names[i], outcomes[i], requests > 0 ? 100.0 * outcomes[i] / requests : 0.0);
+    }
+    fprintf(out, "service_time_us count %lu", total);
+    if (total > 0) {
+        fprintf(out, " mean %.1f p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f", (double)sum_ns / total / 1e3,
+                percentile_us(latency, total, max_ns, 50), percentile_us(latency, total, max_ns, 90),
+                percentile_us(latency, total, max_ns, 99), percentile_us(latency, total, max_ns, 99.9), max_ns / 1e3);
+    }
+    fprintf(out, "\n");
+    free(latency);
+}
+
+static void *stats_loop(void *arg) {
+    metrics *m = arg;
+    while (1) {
+        int fd = accept4(m->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            log_error("Stats Error: accept() failed, no longer serving %s.", m->path);
+            return NULL;
+        }
+        // Rendered first, then sent in one go without SIGPIPE in case the reader has already hung up.
+        char *report = NULL;
+        size_t len = 0;
+        FILE *out = open_memstream(&report, &len);
+        if (out) {
+            metrics_report(m, out);
+            fclose(out);
+            send(fd, report, len, MSG_NOSIGNAL);
+            free(report);
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+int metrics_serve(metrics *m, const char *path) {
+    m->listen_fd = unix_listen(path, "Stats");
+    if (m->listen_fd < 0) {
+        return -1;
+    }
+    strcpy(m->path, path);  // fits, unix_listen() checked it against sun_path
+    if (pthread_create(&m->thread, NULL, stats_loop, m) != 0) {
+        log_error("Stats Error: Could not start the stats thread.");
+        close(m->listen_fd);
+        m->listen_fd = -1;
+        unlink(path);
+        return -1;
+    }
+    log_info("Serving stats on %s", path);
+    return 0;
+}
+
+void metrics_free(metrics *m) {
+    if (m->listen_fd >= 0) {
+        pthread_cancel(m->thread);
+        pthread_join(m->thread, NULL);
+        close(m->listen_fd);
+        unlink(m->path);
+    }
+    free(m->shards);
+}
@@ -0,0 +1,122 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/un.h>
+#include <time.h>
+
+// Outcome counters and a service-time histogram, one shard per server thread.
+// A thread binds its shard once (metrics_bind()) and from then on only it writes there, so counting is a
+// plain load and store on a line no other thread writes: no lock and no atomic read-modify-write on the
+// packet path. Each shard starts on its own cache line. Readers (the stats socket) add up all shards with
+// relaxed loads whenever they are asked, so a report may be a few packets behind, never torn.
+// Code that does not run on a bound thread (benchmarks, tools) counts nothing.
+#define METRICS_MAX_OUTCOMES 8
+
+// Log-linear latency buckets, as in bench/src/histogram.h: values below 2^METRICS_HIST_SUB_BITS ns are
+// exact, above that every power of two is split into 2^METRICS_HIST_SUB_BITS sub-buckets (within 3%).
+#define METRICS_HIST_SUB_BITS 5
+#define METRICS_HIST_SUB_COUNT (1 << METRICS_HIST_SUB_BITS)
+#define METRICS_HIST_BUCKETS ((64 - METRICS_HIST_SUB_BITS + 1) * METRICS_HIST_SUB_COUNT)
+
+typedef struct metrics_shard {
+    atomic_ulong outcomes[METRICS_MAX_OUTCOMES];  // requests answered (or dropped) with each outcome
+    atomic_ulong latency[METRICS_HIST_BUCKETS];   // datagrams by service time, see metrics_record_latency()
+    atomic_ulong latency_sum_ns;
+    atomic_ulong latency_max_ns;
+} __attribute__((aligned(64))) metrics_shard;
+
+typedef struct metrics {
+    metrics_shard *shards;
+    int num_shards;
+    const char *const *outcome_names;  // names of outcomes 0..num_outcomes-1, for the report
+    int num_outcomes;
+    struct timespec started;           // CLOCK_MONOTONIC at metrics_init()
+    int listen_fd;                     // stats socket, -1 when not serving
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    pthread_t thread;
+} metrics;
+
+// Shard of the calling thread, NULL if it is not bound.
+extern _Thread_local metrics_shard *metrics_local;
+
+/**
+ * Allocate num_shards zeroed shards for outcomes named outcome_names[0..num_outcomes).
+ * Return 0 on success; -1 on error.
+*/
+int metrics_init(metrics *m, int num_shards, const char *const *outcome_names, int num_outcomes);
+
+/**
+ * Make shard the calling thread's shard. Each shard must be bound by one thread only.
+*/
+void metrics_bind(metrics *m, int shard);
+
+// Single-writer increment: the owning thread is the only one that stores, so no atomic add is needed.
+static inline void metrics_add(atomic_ulong *counter, unsigned long n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+/**
+ * Count one request with outcome on the calling thread's shard.
+*/
+static inline void metrics_count(int outcome) {
+    metrics_shard *s = metrics_local;
+    if (s) {
+        metrics_add(&s->outcomes[outcome], 1);
+    }
+}
+
+static inline int metrics_bucket(uint64_t ns) {
+    if (ns < METRICS_HIST_SUB_COUNT) {
+        return (int)ns;
+    }
+    int exp = 63 - __builtin_clzll(ns);
+    int shift = exp - METRICS_HIST_SUB_BITS;
+    return (shift + 1) * METRICS_HIST_SUB_COUNT + (int)((ns >> shift) - METRICS_HIST_SUB_COUNT);
+}
+
+/**
+ * Record count datagrams that each spent ns nanoseconds in the server on the calling thread's shard.
+*/
+static inline void metrics_record_latency(uint64_t ns, unsigned long count) {
+    metrics_shard *s = metrics_local;
+    if (s && count > 0) {
+        metrics_add(&s->latency[metrics_bucket(ns)], count);
+        metrics_add(&s->latency_sum_ns, ns * count);
+        if (ns > atomic_load_explicit(&s->latency_max_ns, memory_order_relaxed)) {
+            atomic_store_explicit(&s->latency_max_ns, ns, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Monotonic clock in nanoseconds, for metrics_record_latency().
+*/
+static inline uint64_t metrics_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Add up every shard and write the report to out: uptime, one line per outcome with its count and share,
+ * and the service time count, mean, p50, p90, p99, p99.9 and max in microseconds.
+*/
+void metrics_report(metrics *m, FILE *out);
+
+/**
+ * Listen on the Unix socket path (replacing a stale one, owner-only permissions) and answer every
+ * connection with metrics_report(), from a background thread.
+ * Return 0 on success; -1 on error.
+*/
+int metrics_serve(metrics *m, const char *path);
+
+/**
+ * Stop serving and free the shards. No thread may count any more.
+*/
+void metrics_free(metrics *m);
+
+#endif
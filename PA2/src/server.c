@@ -1,174 +1,560 @@
+#define _GNU_SOURCE
 #include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
 #include <math.h>
 #include <netdb.h>
 #include <netinet/in.h>
-#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "const.h"
+#include "control.h"
+#include "dgram_ring.h"
+#include "live_db.h"
 #include "log.h"
+#include "metrics.h"
+#include "trace.h"
+#include "uring.h"
+#include "verify.h"
+#include "wire.h"
+
+// user_data of the multishot receive on the io_uring backend; a send carries the slot it answers.
+#define URING_RECV_DATA UINT64_MAX
+
+// Per-worker state. Every worker owns its socket; the subscriber tables are shared read-only
+// and may be swapped for a reloaded version between two batches (see live_db.h).
+typedef struct worker {
+    pthread_t thread;
+    int id;                // worker number, 0..num_threads-1
+    int cpu;               // core the worker is pinned to, -1 if not pinned
+    int server_fd;         // this worker's socket, bound to the shared port
+    int batch_size;        // max datagrams per recvmmsg()/sendmmsg()
+    int use_uring;         // serve with io_uring (uring.h) instead of recvmmsg()/sendmmsg()
+    live_db *ldb;          // shared subscriber database; this worker is reader number id
+    metrics *metrics;      // outcome counters and service times; this worker owns shard number id
+    unsigned long num_batches;    // recvmmsg() calls that returned data
+    unsigned long num_datagrams;  // datagrams received over those calls
+    unsigned long bytes_copied;   // request bytes copied into responses over those datagrams
+    unsigned long num_syscalls;   // receive and send system calls over those datagrams
+    double cpu_at_report;         // thread CPU time at the last report, in seconds
+} worker;
+
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void log_lock(bool lock, void *udata) {
+    if (lock) {
+        pthread_mutex_lock(udata);
+    } else {
+        pthread_mutex_unlock(udata);
+    }
+}
+
+/**
+ * Create the UDP server socket and bind it to port on all addresses.
+ * With reuse_port set, several sockets can bind the same port and the kernel spreads datagrams across them.
+ * Return the socket fd; exits on failure.
+*/
+static int open_server_socket(int port, int reuse_port) {
+    struct sockaddr_in server_addr;  // sock address for server
+    int server_fd;                   // fd for socket
+
+    // Creating a UDP Socket for the Server
+    if ((server_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        log_fatal("Socket creation failed.");
+        exit(EXIT_FAILURE);
+    }
+    if (reuse_port) {
+        int one = 1;
+        if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+            log_fatal("Could not set SO_REUSEPORT.");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Setup the Server Sock Addr
+    // Bind it to the Socket and the Selected Port for this communication
+    memset((char *)&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    server_addr.sin_port = htons(port);
+    if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        log_fatal("Binding Failed.");
+        exit(EXIT_FAILURE);
+    }
+    return server_fd;
+}
+
+static double thread_cpu_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Log the average number of datagrams per batch (per recvmmsg(), or per io_uring_enter() that returned data),
+ * the bytes copied, system calls and CPU time per datagram, and the Bloom filter counters since the last report,
+ * then reset the counters. Must run on the worker's own thread, the lookup counters are thread-local.
+*/
+static void report_batch_fill(worker *w) {
+    double cpu = thread_cpu_seconds();
+    if (w->num_batches > 0 && w->num_datagrams > 0) {
+        log_info("Worker %d: %lu datagrams in %lu batches, average batch fill %.2f / %d, %.2f bytes copied, %.3f syscalls, %.2f us CPU per datagram",
+                 w->id, w->num_datagrams, w->num_batches, (double)w->num_datagrams / w->num_batches, w->batch_size,
+                 (double)w->bytes_copied / w->num_datagrams, (double)w->num_syscalls / w->num_datagrams,
+                 (cpu - w->cpu_at_report) * 1e6 / w->num_datagrams);
+    }
+    w->num_batches = 0;
+    w->num_datagrams = 0;
+    w->bytes_copied = 0;
+    w->num_syscalls = 0;
+    w->cpu_at_report = cpu;
+
+    sub_index_stats st;
+    sub_index_stats_take(&st);
+    unsigned long misses = st.bloom_rejects + st.false_positives;  // lookups the filter did not pass as hits
+    if (misses > 0) {
+        log_info("Worker %d: %lu lookups, Bloom filter answered %lu misses (%.1f%% of lookups), %lu false positives (%.2f%% of misses)",
+                 w->id, st.lookups, st.bloom_rejects, 100.0 * st.bloom_rejects / st.lookups, st.false_positives, 100.0 * st.false_positives / misses);
+    }
+}
+
+/**
+ * Send all responses in out[0..count). sendmmsg() may stop early, so keep going from where it stopped.
+*/
+static void flush_responses(worker *w, struct mmsghdr *out, int count) {
+    int sent = 0;
+    while (sent < count) {
+        int ret = sendmmsg(w->server_fd, out + sent, count - sent, 0);
+        w->num_syscalls++;
+        if (ret < 0) {
+            char client_ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &((struct sockaddr_in *)out[sent].msg_hdr.msg_name)->sin_addr, client_ip, sizeof(client_ip));
+            log_error("Server Error: Failed to Send Packet to Client ip = %s.", client_ip);
+            // doesn't stop the worker on this failure: skip this response, in case issue was on Client's end
+            sent++;
+        } else {
+            sent += ret;
+        }
+    }
+}
+
+/**
+ * Log the request received from client_ip, which was recv_bytes long.
+*/
+static inline void log_arrival(const char *client_ip, int recv_bytes) {
+    // Sanity check: packet has content
+    if (recv_bytes == 0) {
+        log_warn("Received zero bytes at recvmmsg(), client ip = %s", client_ip);  // datagram sockets might permit zero length packets
+    } else {
+        log_info("Message received from client ip = %s", client_ip);
+    }
+}
+
+/**
+ * Classic backend: receive a batch of requests into this worker's datagram ring with one recvmmsg(),
+ * verify each of them where it landed, and send all replies back with one sendmmsg(), forever.
+*/
+static void serve_classic(worker *w) {
+    int batch = w->batch_size;
+    char client_ip[INET_ADDRSTRLEN];  // printable client address (inet_ntoa is not thread-safe)
+
+    dgram_ring ring;
+    if (dgram_ring_init(&ring, batch, WIRE_BATCH_REQUEST_MAX_LEN, WIRE_BATCH_RESPONSE_MAX_LEN) < 0) {
+        log_fatal("Worker %d: could not allocate its datagram ring.", w->id);
+        exit(EXIT_FAILURE);
+    }
+    log_info("Worker %d: serving on fd %d, CPU %d, batch size %d, recvmmsg()", w->id, w->server_fd, w->cpu, batch);
+    time_t last_report = time(NULL);
+
+    // ======================== SERVER LOOP ========================
+    while (TRUE) {
+        // We wait on the socket until at least one data packet arrives, then take whatever else is queued.
+        dgram_ring_rearm(&ring, batch);
+        // Hold no database version while blocked, so a reload never waits for an idle worker.
+        live_db_exit(w->ldb, w->id);
+        TRACE_START(recv_start);
+        int num_msgs = recvmmsg(w->server_fd, ring.in_msgs, batch, MSG_WAITFORONE, NULL);
+        TRACE_END_ARG(TRACE_RECV, recv_start, num_msgs);
+        w->num_syscalls++;
+        if (num_msgs < 0) {
+            log_error("Error at recvmmsg() on worker %d", w->id);
+            break;
+        }
+        const db_version *v = live_db_enter(w->ldb, w->id);  // used for the whole batch
+        uint64_t recv_ns = metrics_now_ns();
+        TRACE_START(batch_start);
+        w->num_batches++;
+        w->num_datagrams += num_msgs;
+
+        int num_out = 0;
+        for (int i = 0; i < num_msgs; i++) {
+            int recv_bytes = ring.in_msgs[i].msg_len;  // length of received message packet
+            TRACE_START(datagram_start);
+            TRACE_START(addr_start);
+            inet_ntop(AF_INET, &dgram_ring_addr(&ring, i)->sin_addr, client_ip, sizeof(client_ip));
+            TRACE_END(TRACE_ADDR, addr_start);
+            log_arrival(client_ip, recv_bytes);
+
+            unsigned char *out;  // request slot (answered in place) or response slot
+            int out_len = verify_datagram(&v->db, &v->idx, dgram_ring_req(&ring, i), recv_bytes, dgram_ring_rsp(&ring, i), &out, &w->bytes_copied);
+            TRACE_END(TRACE_DATAGRAM, datagram_start);
+            if (out_len < 0) {
+                log_warn("Dropped malformed datagram of %d bytes from client ip = %s (wire version %d).", recv_bytes, client_ip, WIRE_VERSION);
+                continue;
+            }
+            dgram_ring_respond(&ring, num_out, i, out, out_len);
+            num_out++;
+        }
+
+        // Send information packets back to the clients
+        TRACE_START(send_start);
+        flush_responses(w, ring.out_msgs, num_out);
+        TRACE_END_ARG(TRACE_SEND, send_start, num_out);
+        TRACE_END_ARG(TRACE_BATCH, batch_start, num_msgs);
+        metrics_record_latency(metrics_now_ns() - recv_ns, num_msgs);
+
+        if (time(NULL) - last_report >= BATCH_REPORT_INTERVAL) {
+            report_batch_fill(w);
+            last_report = time(NULL);
+        }
+    }
+    report_batch_fill(w);
+    dgram_ring_free(&ring);
+}
 
 /**
- * Linear search on subscriber number array subn_arr to find the sub_num
- * Return index if found; -1 if not found
+ * io_uring backend: one multishot recvmsg fills the slots of the datagram ring (as provided buffers),
+ * every request is verified in its slot and answered with a sendmsg SQE from that slot, and the slot goes
+ * back to the kernel when the send completes. One io_uring_enter() submits the sends of the last pass and
+ * waits for the next completions, forever.
+ * Return -1 if io_uring cannot be set up (nothing was served); 0 after a fatal error while serving.
 */
-int find(unsigned long *subn_arr, int arr_len, unsigned long sub_num) {
-    int ret_index = -1;
-    for (int i = 0; i < arr_len; i++) {
-        if (subn_arr[i] == sub_num) {
-            ret_index = i;
+static int serve_uring(worker *w) {
+    // Room for a full batch of responses in flight while the next batch arrives.
+    int num_slots = 1;
+    while (num_slots < 2 * w->batch_size) {
+        num_slots <<= 1;
+    }
+    dgram_ring ring;
+    if (dgram_ring_init(&ring, num_slots, sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + WIRE_BATCH_REQUEST_MAX_LEN, WIRE_BATCH_RESPONSE_MAX_LEN) < 0) {
+        return -1;
+    }
+    uring u;
+    if (uring_init(&u, (unsigned)num_slots, w->server_fd) < 0) {
+        log_warn("Worker %d: io_uring is not available (%s), falling back to recvmmsg().", w->id, strerror(errno));
+        dgram_ring_free(&ring);
+        return -1;
+    }
+    if (uring_provide_buffers(&u, &ring) < 0) {
+        log_warn("Worker %d: falling back to recvmmsg().", w->id);
+        uring_free(&u);
+        dgram_ring_free(&ring);
+        return -1;
+    }
+    struct msghdr recv_msg;  // layout of every provided buffer: io_uring_recvmsg_out, address, datagram
+    memset(&recv_msg, 0, sizeof(recv_msg));
+    recv_msg.msg_namelen = sizeof(struct sockaddr_in);
+    int recv_armed = FALSE;      // the multishot receive is still active
+    int slots_free = num_slots;  // slots owned by the kernel, waiting for a datagram
+    unsigned long received = 0;  // datagrams of the last pass, answered once the next io_uring_enter() submits their sends
+    uint64_t pass_ns = 0;        // when the last pass started
+    char client_ip[INET_ADDRSTRLEN];
+
+    log_info("Worker %d: serving on fd %d, CPU %d, %d slots, io_uring", w->id, w->server_fd, w->cpu, num_slots);
+    time_t last_report = time(NULL);
+
+    // ======================== SERVER LOOP ========================
+    while (TRUE) {
+        // The receive stops when it runs out of buffers (or on an error); re-arm it once sends freed some.
+        if (!recv_armed && slots_free > 0) {
+            if (uring_queue_recvmsg(&u, &recv_msg, URING_RECV_DATA) < 0) {
+                log_error("Worker %d: could not queue the io_uring receive.", w->id);
+                break;
+            }
+            recv_armed = TRUE;
+        }
+        metrics_record_latency(metrics_now_ns() - pass_ns, received);
+        live_db_exit(w->ldb, w->id);
+        TRACE_START(wait_start);
+        if (uring_enter(&u, 1, -1) < 0) {
             break;
         }
+        TRACE_END(TRACE_WAIT, wait_start);
+        const db_version *v = live_db_enter(w->ldb, w->id);  // used for every completion of this pass
+        pass_ns = metrics_now_ns();
+        TRACE_START(batch_start);
+
+        received = 0;
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(&u)) != NULL) {
+            if (cqe->user_data != URING_RECV_DATA) {  // a response went out, its slot can take the next datagram
+                int slot = (int)cqe->user_data;
+                if (cqe->res < 0) {
+                    inet_ntop(AF_INET, &((struct sockaddr_in *)ring.out_msgs[slot].msg_hdr.msg_name)->sin_addr, client_ip, sizeof(client_ip));
+                    log_error("Server Error: Failed to Send Packet to Client ip = %s.", client_ip);
+                }
+                uring_recycle_buffer(&u, &ring, slot);
+                slots_free++;
+                uring_cqe_seen(&u);
+                continue;
+            }
+
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                recv_armed = FALSE;
+            }
+            if (cqe->res < 0 || !(cqe->flags & IORING_CQE_F_BUFFER)) {
+                if (cqe->res != -ENOBUFS) {
+                    log_error("Error at io_uring recvmsg on worker %d: %s", w->id, strerror(-cqe->res));
+                }
+                uring_cqe_seen(&u);
+                continue;
+            }
+            int slot = (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            slots_free--;
+            received++;
+            unsigned char *req;
+            struct sockaddr_in *addr;
+            int recv_bytes = uring_recvmsg_datagram(cqe, &recv_msg, &ring, slot, &req, &addr);
+            uring_cqe_seen(&u);
+            if (recv_bytes < 0) {
+                log_warn("Dropped truncated datagram on worker %d.", w->id);
+                uring_recycle_buffer(&u, &ring, slot);
+                slots_free++;
+                continue;
+            }
+            TRACE_START(datagram_start);
+            TRACE_START(addr_start);
+            inet_ntop(AF_INET, &addr->sin_addr, client_ip, sizeof(client_ip));
+            TRACE_END(TRACE_ADDR, addr_start);
+            log_arrival(client_ip, recv_bytes);
+
+            unsigned char *out;
+            int out_len = verify_datagram(&v->db, &v->idx, req, recv_bytes, dgram_ring_rsp(&ring, slot), &out, &w->bytes_copied);
+            TRACE_END(TRACE_DATAGRAM, datagram_start);
+            if (out_len < 0) {
+                log_warn("Dropped malformed datagram of %d bytes from client ip = %s (wire version %d).", recv_bytes, client_ip, WIRE_VERSION);
+                uring_recycle_buffer(&u, &ring, slot);
+                slots_free++;
+                continue;
+            }
+            // The address and the request stay in the slot until the send completes.
+            struct msghdr *msg = &ring.out_msgs[slot].msg_hdr;
+            ring.out_iovs[slot].iov_base = out;
+            ring.out_iovs[slot].iov_len = out_len;
+            msg->msg_name = addr;
+            msg->msg_namelen = sizeof(struct sockaddr_in);
+            if (uring_queue_sendmsg(&u, msg, (uint64_t)slot) < 0) {
+                log_error("Server Error: Failed to Send Packet to Client ip = %s.", client_ip);
+                uring_recycle_buffer(&u, &ring, slot);
+                slots_free++;
+            }
+        }
+        if (received > 0) {
+            w->num_batches++;
+            w->num_datagrams += received;
+        }
+        TRACE_END_ARG(TRACE_BATCH, batch_start, received);
+
+        if (time(NULL) - last_report >= BATCH_REPORT_INTERVAL) {
+            w->num_syscalls += u.num_enters;
+            u.num_enters = 0;
+            report_batch_fill(w);
+            last_report = time(NULL);
+        }
     }
-    return ret_index;
+    report_batch_fill(w);
+    uring_free(&u);
+    dgram_ring_free(&ring);
+    return 0;
+}
+
+/**
+ * Worker thread: pin to the worker's CPU, then serve with the selected backend.
+*/
+static void *worker_loop(void *arg) {
+    worker *w = arg;
+    if (w->cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(w->cpu, &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+            log_warn("Worker %d: could not pin to CPU %d.", w->id, w->cpu);
+        }
+    }
+    metrics_bind(w->metrics, w->id);
+    TRACE_THREAD_START("worker");
+    // The datagram ring is allocated after pinning, so its slots are first touched on the worker's own core.
+    w->cpu_at_report = thread_cpu_seconds();
+    if (!w->use_uring || serve_uring(w) < 0) {
+        serve_classic(w);
+    }
+    TRACE_THREAD_STOP();
+    return NULL;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--threads N] [--batch N] [--io MODE] [--async-log] [--control PATH] [--stats PATH] [port]\n", prog);
+    fprintf(stderr, "  -t, --threads N  serve with N worker threads, one SO_REUSEPORT socket each (default 1)\n");
+    fprintf(stderr, "  -b, --batch N    datagrams per recvmmsg()/sendmmsg(), 1..%d (default %d)\n", MAX_BATCH_SIZE, DEFAULT_BATCH_SIZE);
+    fprintf(stderr, "  -i, --io MODE    socket I/O: classic (recvmmsg()/sendmmsg(), default) or uring (io_uring, falls back to classic)\n");
+    fprintf(stderr, "  -a, --async-log  format and write log lines on a background thread, dropping them when it falls behind\n");
+    fprintf(stderr, "  -c, --control P  take delta updates on Unix socket P (default %s)\n", CONTROL_SOCKET_NAME);
+    fprintf(stderr, "  -s, --stats P    serve outcome counters and service times on Unix socket P (default %s)\n", STATS_SOCKET_NAME);
 }
 
 int main(int argc, char **argv) {
     // ======================== CLI ARGS PARSING ========================
     int port = DEFAULT_SERVER_PORT;
+    int num_threads = 1;
+    int batch_size = DEFAULT_BATCH_SIZE;
+    int use_uring = FALSE;
+    const char *control_path = CONTROL_SOCKET_NAME;
+    const char *stats_path = STATS_SOCKET_NAME;
+    static const struct option long_opts[] = {
+        {"threads", required_argument, NULL, 't'},
+        {"batch", required_argument, NULL, 'b'},
+        {"io", required_argument, NULL, 'i'},
+        {"async-log", no_argument, NULL, 'a'},
+        {"control", required_argument, NULL, 'c'},
+        {"stats", required_argument, NULL, 's'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:b:i:ac:s:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 't':
+                num_threads = atoi(optarg);
+                if (num_threads < 1) {
+                    log_fatal("Invalid number of threads %s.", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'b':
+                batch_size = atoi(optarg);
+                if (batch_size < 1 || batch_size > MAX_BATCH_SIZE) {
+                    log_fatal("Invalid batch size %s, must be 1..%d.", optarg, MAX_BATCH_SIZE);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'i':
+                if (strcmp(optarg, "uring") == 0) {
+                    use_uring = TRUE;
+                } else if (strcmp(optarg, "classic") == 0) {
+                    use_uring = FALSE;
+                } else {
+                    log_fatal("Invalid I/O mode %s, must be classic or uring.", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'a':
+                if (log_async_start(LOG_ASYNC_DEFAULT_CAPACITY) < 0) {
+                    log_fatal("Could not start the asynchronous logger.");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'c':
+                control_path = optarg;
+                break;
+            case 's':
+                stats_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
     // Set port from command line argument
-    if (argc < 2) {
+    if (optind >= argc) {
         log_info("Using default port %d <port>", DEFAULT_SERVER_PORT);
     } else {
-        log_info("Using port %s", argv[1]);
-        port = atoi(argv[1]);
+        log_info("Using port %s", argv[optind]);
+        port = atoi(argv[optind]);
     }
 
     // ======================== DB FILE PARSING ========================
-    char buffer[128] = {0};  // a buffer to store intermediary string for parsing
-    int db_len;              // Number of entries in db
-    char wc_command[50];
-    strcpy(wc_command, "wc -l ");
-    FILE *db_wc = popen(strcat(wc_command, DB_FILE_NAME), "r");
-    if (!db_wc) {
-        log_error("DB Error: Could not get num entries in DB. Quit.");
+    // Serve straight from the compiled snapshot when it is fresh, otherwise parse the text database
+    // and build the hash index once, so each request is an O(1) expected lookup instead of a scan.
+    // After that the text database is watched, and every change is reloaded without a restart.
+    // Delta records from the control socket are logged and applied in place, see live_db.h.
+    live_db ldb;  // all subscriber numbers, technologies and payment status, with their hash index
+    if (live_db_init(&ldb, DB_SNAPSHOT_NAME, DB_FILE_NAME, DB_DELTA_LOG_NAME, num_threads) < 0) {
+        log_error("DB Error: Could not load %s. Quit.", DB_FILE_NAME);
         return -1;
     }
-    fscanf(db_wc, "%s", buffer);
-    db_len = atoi(buffer);
-    pclose(db_wc);
-
-    // parse the following field arrays from database file
-    unsigned long sub_nums[db_len];  // all subscriber numbers in the database
-    char sub_techs[db_len];          // technology which each subscribers is using
-    char sub_paid_arr[db_len];       // subscribers payment status (1 = paid, 0 = not paid).
-
-    // The following are just variables for getting the data out.
-    size_t len = 0;
-    ssize_t read;
-    char *line = NULL;
-    char *token = NULL;
-    int idx = 0;
-    char *end_ptr;
-
-    FILE *input_dbfile = fopen(DB_FILE_NAME, "r");
-    if (!input_dbfile) {
-        log_error("DB Error: Could not open %s. Quit.", DB_FILE_NAME);
-        return -1;
+    log_info("Indexed %d subscribers", atomic_load(&ldb.current)->db.len);
+    // The watcher, control and stats threads log next to the workers in every mode, so serialize the log from here on.
+    log_set_lock(log_lock, &log_mutex);
+    if (live_db_watch(&ldb) < 0) {
+        log_warn("Changes to %s will need a server restart.", DB_FILE_NAME);
     }
-    while ((read = getline(&line, &len, input_dbfile)) != -1) {
-        token = strtok(line, " ");  // this grabs the subscriber-number and puts it into "token"
-        // Skip any non-numeric characters in the subscriber numer, example '-' or '.'
-        int j = 0;
-        for (int k = 0; k < strlen(token); k++) {
-            if (token[k] >= '0' && token[k] <= '9') {
-                buffer[j++] = token[k];
-            }
-        }
-        buffer[j] = '\0';
-        sub_nums[idx] = strtoul(buffer, &end_ptr, 10);      // Parse substriber number and save to an unsigned long (4bytes)
-        sub_techs[idx] = (char)atoi(strtok(NULL, " "));     // Parse technology field
-        sub_paid_arr[idx] = (char)atoi(strtok(NULL, " "));  // Parse paid field
-        idx++;
-    }
-    fclose(input_dbfile);  // done with the data-base file. We can close it now.
-
-    // ======================== INIT VARIABLES AND SOCKETS ========================
-    // Initializing values for completing socket programming communications
-    // Most of the following is just lifted from Assignment 1.
-    struct sockaddr_in server_addr, client_addr;      // sock addresses for client and server.
-    int server_fd;                                    // fd for socket
-    socklen_t addr_len = sizeof(struct sockaddr_in);  // length of a sockaddr_in
-    int recv_bytes;                                   // variable to hold length of received message packet
-    message_packet client_pkt;                        // struct to hold data packet being sent to server
-    message_packet server_pkt;                        // struct for return packet from server
-    int index = -1;                                   // Index of a Subscriber Number on the Verified Database
-
-    // Creating a UDP Socket for the Client
-    if ((server_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-        log_fatal("Socket creation failed.");
-        exit(EXIT_FAILURE);
+    control_server control;
+    int control_running = control_start(&control, &ldb, control_path) == 0;
+    if (!control_running) {
+        log_warn("Delta updates are disabled.");
     }
 
-    // Setup the Server Sock Addr
-    // Bind it to the Socket and the Selected Port for this communication
-    memset((char *)&server_addr, 0, addr_len);
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    server_addr.sin_port = htons(port);
-    if (bind(server_fd, (struct sockaddr *)&server_addr, addr_len) < 0) {
-        log_fatal("Binding Failed.");
+    // Outcome counters and service times: one shard per worker, counted without locks and added up
+    // on demand by the stats socket.
+    metrics metrics;
+    if (metrics_init(&metrics, num_threads, verify_outcome_names, VERIFY_NUM_OUTCOMES) < 0) {
+        log_fatal("Could not allocate the metrics.");
         exit(EXIT_FAILURE);
     }
+    if (metrics_serve(&metrics, stats_path) < 0) {
+        log_warn("Stats are disabled.");
+    }
 
-    // Use poll() to detect timeout, easier to use than using C timers
-    struct pollfd server_timer_pollfd;
-    server_timer_pollfd.fd = server_fd;
-    server_timer_pollfd.events = POLLIN;  // notes anything coming in on the socket.
+    // ======================== INIT WORKERS AND SOCKETS ========================
+    // With more than one thread, each worker binds its own socket to the port with SO_REUSEPORT,
+    // so the kernel load-balances clients across workers and no socket is shared between threads.
+    worker *workers = calloc(num_threads, sizeof(worker));
+    if (!workers) {
+        log_fatal("Could not allocate %d workers.", num_threads);
+        exit(EXIT_FAILURE);
+    }
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 0; i < num_threads; i++) {
+        workers[i].id = i;
+        workers[i].cpu = num_threads > 1 && num_cpus > 0 ? (int)(i % num_cpus) : -1;
+        workers[i].server_fd = open_server_socket(port, num_threads > 1);
+        workers[i].batch_size = batch_size;
+        workers[i].use_uring = use_uring;
+        workers[i].ldb = &ldb;
+        workers[i].metrics = &metrics;
+    }
+    log_info("PA2 Server: Listening on port %d with %d worker(s)", port, num_threads);
 
-    // ======================== SERVER LOOP ========================
-    while (TRUE) {
-        // We wait on the socket to get a data packet from the Client
-        recv_bytes = recvfrom(server_fd, &client_pkt, sizeof(message_packet), 0, (struct sockaddr *)&client_addr, &addr_len);
-        char *client_ip = inet_ntoa(client_addr.sin_addr);
-        // Sanity check: packet has content
-        if (recv_bytes < 0) {
-            log_error("Error at recvfrom(), client ip = %s", client_ip);
-            return -1;
-        } else if (recv_bytes == 0) {
-            log_warn("Received zero bytes at recvfrom(), client ip = %s", client_ip);  // datagram sockets might permit zero length packets
-        } else {
-            log_info("Message received from client ip = %s", client_ip);
+    if (num_threads == 1) {
+        worker_loop(&workers[0]);
+    } else {
+        for (int i = 0; i < num_threads; i++) {
+            if (pthread_create(&workers[i].thread, NULL, worker_loop, &workers[i]) != 0) {
+                log_fatal("Could not start worker %d.", i);
+                exit(EXIT_FAILURE);
+            }
         }
-
-        // Data packes sent back to the user have several commonalities, regardless of response type.
-        server_pkt.start_id = START_ID;
-        server_pkt.end_id = END_ID;
-        server_pkt.client_id = client_pkt.client_id;
-        server_pkt.seg_num = client_pkt.seg_num;
-        server_pkt.technology = client_pkt.technology;  // This will get changed later if there's a Tech Mis-Match.
-        server_pkt.sub_num = client_pkt.sub_num;
-        server_pkt.length = sizeof(client_pkt.technology) + sizeof(client_pkt.sub_num);
-
-        // First, search the database for the client's subscriber number, and verify it.
-        index = find(sub_nums, db_len, client_pkt.sub_num);
-        // Now, run through verification checks
-        if (index < 0) {  // The subscriber number couldn't be found on the database.
-            log_warn("Access Denied: Subscriber %lu Does Not Exist in the Verification Database.", client_pkt.sub_num);
-            server_pkt.type = NOT_EXIST;
-        } else if (client_pkt.technology != sub_techs[index]) {  // The subscriber number asked for the wrong Technology
-            log_warn("Access Denied: Subscriber %lu Requested Access to Incorrect Technology. Requested %dG, but is authorized for %dG.", client_pkt.sub_num, (int)client_pkt.technology, (int)sub_techs[index]);
-            server_pkt.type = NOT_EXIST;
-            server_pkt.technology = (char)INVALID_TECHNOLOGY;
-        } else if (sub_paid_arr[index] == 0) {  // The subscriber number has not paid.
-            log_warn("Access Denied: Subscriber %lu have not paid.", client_pkt.sub_num);
-            server_pkt.type = NOT_PAID;
-        } else {  // No issues found in database or client-packet. Give Access Permission to Client.
-            log_info("Access Granted: Subscriber %lu request has been verified against the Database.", client_pkt.sub_num);
-            server_pkt.type = ACC_OK;
+        for (int i = 0; i < num_threads; i++) {
+            pthread_join(workers[i].thread, NULL);
         }
+    }
 
-        // Send information packet back to client
-        if (sendto(server_fd, &server_pkt, sizeof(message_packet), 0, (struct sockaddr *)&client_addr, addr_len) < 0) {
-            log_error("Server Error: Failed to Send Packet to Client ip = %s.", client_ip);
-            // doesn't return -1 on this failure: Server continues to operate in case issue was on Client's end
-        }
+    for (int i = 0; i < num_threads; i++) {
+        close(workers[i].server_fd);
+    }
+    free(workers);
+    metrics_free(&metrics);
+    if (control_running) {
+        control_stop(&control);
     }
-    close(server_fd);
+    live_db_free(&ldb);
     return 0;
 }
@@ -0,0 +1,288 @@
+#include "snapshot.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+
+#define SNAPSHOT_ALIGN 64
+
+_Static_assert(sizeof(unsigned long) == sizeof(uint64_t), "snapshot sub_nums section is mapped as unsigned long");
+_Static_assert(sizeof(snapshot_header) % 8 == 0, "snapshot header must keep the checksum word-aligned");
+
+static inline uint64_t align_up(uint64_t off) {
+    return (off + SNAPSHOT_ALIGN - 1) & ~(uint64_t)(SNAPSHOT_ALIGN - 1);
+}
+
+/**
+ * Word-at-a-time multiply/xor checksum. len must be a multiple of 8.
+ * This only has to catch truncated or corrupted files, and it has to keep up with the disk.
+*/
+static uint64_t checksum_update(uint64_t h, const void *data, size_t len) {
+    const uint64_t *words = data;
+    for (size_t i = 0; i < len / 8; i++) {
+        h ^= words[i];
+        h *= 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+#define CHECKSUM_SEED 0xCBF29CE484222325ULL
+
+/**
+ * Write len bytes, padded with zeros up to the next 8-byte boundary, and fold them into the checksum.
+ * Return 0 on success; -1 on error.
+*/
+static int write_section(int fd, const void *data, size_t len, uint64_t *checksum) {
+    size_t whole = len & ~(size_t)7;
+    const char *p = data;
+    size_t left = whole;
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        left -= (size_t)n;
+    }
+    *checksum = checksum_update(*checksum, data, whole);
+
+    // Tail bytes are folded in as one zero-padded word.
+    size_t tail = len - whole;
+    if (tail > 0) {
+        uint64_t last = 0;
+        memcpy(&last, (const char *)data + whole, tail);
+        if (write(fd, &last, sizeof(last)) != sizeof(last)) {
+            return -1;
+        }
+        *checksum = checksum_update(*checksum, &last, sizeof(last));
+    }
+
+    return 0;
+}
+
+/**
+ * Write zeros up to file offset off, where the next section starts, and fold them into the checksum.
+ * Return 0 on success; -1 on error.
+*/
+static int pad_to(int fd, uint64_t off, uint64_t *checksum) {
+    static const char zeros[SNAPSHOT_ALIGN] = {0};
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+    if (pos < 0 || (uint64_t)pos > off) {
+        return -1;
+    }
+    size_t pad = (size_t)(off - (uint64_t)pos);
+    if (pad > 0) {
+        if (write(fd, zeros, pad) != (ssize_t)pad) {
+            return -1;
+        }
+        *checksum = checksum_update(*checksum, zeros, pad);
+    }
+    return 0;
+}
+
+int snapshot_write(const char *path, const char *text_path, const sub_db *db, const sub_index *idx) {
+    struct stat src_st;
+    if (stat(text_path, &src_st) < 0) {
+        log_error("Snapshot Error: Could not stat %s.", text_path);
+        return -1;
+    }
+
+    snapshot_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.byte_order = SNAPSHOT_BYTE_ORDER;
+    hdr.num_rows = (uint64_t)db->len;
+    hdr.index_capacity = idx->mask + 1;
+    hdr.nums_off = align_up(sizeof(snapshot_header));
+    hdr.techs_off = align_up(hdr.nums_off + hdr.num_rows * sizeof(uint64_t));
+    hdr.paid_off = align_up(hdr.techs_off + hdr.num_rows);
+    hdr.index_off = align_up(hdr.paid_off + hdr.num_rows);
+    hdr.bloom_off = align_up(hdr.index_off + hdr.index_capacity * sizeof(uint64_t));
+    hdr.bloom_blocks = idx->bloom.num_blocks;
+    hdr.file_size = hdr.bloom_off + hdr.bloom_blocks * SUB_BLOOM_BLOCK_WORDS * sizeof(uint32_t);
+    hdr.src_size = (uint64_t)src_st.st_size;
+    hdr.src_mtime_sec = (int64_t)src_st.st_mtim.tv_sec;
+    hdr.src_mtime_nsec = (int64_t)src_st.st_mtim.tv_nsec;
+
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        log_error("Snapshot Error: Could not create %s.", tmp_path);
+        return -1;
+    }
+
+    // The header goes first with checksum = 0, then gets rewritten once the checksum is known.
+    uint64_t checksum = CHECKSUM_SEED;
+    if (write_section(fd, &hdr, sizeof(hdr), &checksum) < 0 ||
+        pad_to(fd, hdr.nums_off, &checksum) < 0 ||
+        write_section(fd, db->sub_nums, hdr.num_rows * sizeof(uint64_t), &checksum) < 0 ||
+        pad_to(fd, hdr.techs_off, &checksum) < 0 ||
+        write_section(fd, db->sub_techs, hdr.num_rows, &checksum) < 0 ||
+        pad_to(fd, hdr.paid_off, &checksum) < 0 ||
+        write_section(fd, db->sub_paid_arr, hdr.num_rows, &checksum) < 0 ||
+        pad_to(fd, hdr.index_off, &checksum) < 0 ||
+        write_section(fd, idx->slots, hdr.index_capacity * sizeof(uint64_t), &checksum) < 0 ||
+        pad_to(fd, hdr.bloom_off, &checksum) < 0 ||
+        write_section(fd, idx->bloom.words, hdr.bloom_blocks * SUB_BLOOM_BLOCK_WORDS * sizeof(uint32_t), &checksum) < 0) {
+        log_error("Snapshot Error: Could not write %s.", tmp_path);
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+
+    hdr.checksum = checksum;
+    if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || fsync(fd) < 0) {
+        log_error("Snapshot Error: Could not finalize %s.", tmp_path);
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    close(fd);
+
+    if (rename(tmp_path, path) < 0) {
+        log_error("Snapshot Error: Could not rename %s to %s.", tmp_path, path);
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Validate the mapped snapshot against its header, its checksum and the text database.
+ * Return 0 if usable; -1 otherwise (the reason is logged).
+*/
+static int snapshot_validate(const char *path, const char *text_path, const char *map, size_t map_len) {
+    const snapshot_header *hdr = (const snapshot_header *)map;
+    if (map_len < sizeof(snapshot_header) || memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        log_warn("Snapshot %s: not a snapshot file.", path);
+        return -1;
+    }
+    if (hdr->version != SNAPSHOT_VERSION || hdr->byte_order != SNAPSHOT_BYTE_ORDER) {
+        log_warn("Snapshot %s: version %u is not supported (want %u), or compiled on a different byte order.", path, hdr->version, SNAPSHOT_VERSION);
+        return -1;
+    }
+    // Every offset and count is bounded by the file size first, so the sums below cannot wrap around.
+    if (hdr->file_size != map_len || hdr->num_rows > (uint64_t)0x7FFFFFFF ||
+        hdr->nums_off > map_len || hdr->techs_off > map_len || hdr->paid_off > map_len ||
+        hdr->index_off > map_len || hdr->bloom_off > map_len ||
+        hdr->index_capacity > map_len || hdr->bloom_blocks > map_len ||
+        hdr->index_capacity == 0 || (hdr->index_capacity & (hdr->index_capacity - 1)) != 0 || hdr->bloom_blocks == 0 ||
+        hdr->nums_off < sizeof(snapshot_header) || hdr->nums_off % SNAPSHOT_ALIGN != 0 ||
+        hdr->index_off % SNAPSHOT_ALIGN != 0 || hdr->bloom_off % SNAPSHOT_ALIGN != 0 ||
+        hdr->nums_off + hdr->num_rows * sizeof(uint64_t) > hdr->techs_off ||
+        hdr->techs_off + hdr->num_rows > hdr->paid_off ||
+        hdr->paid_off + hdr->num_rows > hdr->index_off ||
+        hdr->index_off + hdr->index_capacity * sizeof(uint64_t) > hdr->bloom_off ||
+        hdr->bloom_off + hdr->bloom_blocks * SUB_BLOOM_BLOCK_WORDS * sizeof(uint32_t) != map_len) {
+        log_warn("Snapshot %s: truncated or inconsistent header.", path);
+        return -1;
+    }
+
+    struct stat src_st;
+    if (stat(text_path, &src_st) == 0 &&
+        ((uint64_t)src_st.st_size != hdr->src_size ||
+         (int64_t)src_st.st_mtim.tv_sec != hdr->src_mtime_sec ||
+         (int64_t)src_st.st_mtim.tv_nsec != hdr->src_mtime_nsec)) {
+        log_warn("Snapshot %s: stale, %s changed since it was compiled.", path, text_path);
+        return -1;
+    }
+
+    snapshot_header zeroed = *hdr;
+    zeroed.checksum = 0;
+    uint64_t checksum = checksum_update(CHECKSUM_SEED, &zeroed, sizeof(zeroed));
+    checksum = checksum_update(checksum, map + sizeof(snapshot_header), map_len - sizeof(snapshot_header));
+    if (checksum != hdr->checksum) {
+        log_warn("Snapshot %s: checksum mismatch.", path);
+        return -1;
+    }
+
+    // The checksum only catches accidents: check that every used slot points at a row (row + 1 in the low 32 bits).
+    const uint64_t *slots = (const uint64_t *)(map + hdr->index_off);
+    for (uint64_t i = 0; i < hdr->index_capacity; i++) {
+        uint64_t row = slots[i] & 0xFFFFFFFFULL;
+        if (slots[i] != 0 && (row == 0 || row > hdr->num_rows)) {
+            log_warn("Snapshot %s: index slot %lu points past the %lu rows.", path, (unsigned long)i, (unsigned long)hdr->num_rows);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int snapshot_load(const char *path, const char *text_path, sub_db *db, sub_index *idx) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        log_info("Snapshot %s not found.", path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(snapshot_header)) {
+        log_warn("Snapshot %s: truncated.", path);
+        close(fd);
+        return -1;
+    }
+    size_t map_len = (size_t)st.st_size;
+    // Writable but private: delta updates (live_db.h) change a row in place by copying only its page.
+    char *map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        log_error("Snapshot Error: Could not mmap %s.", path);
+        return -1;
+    }
+    if (snapshot_validate(path, text_path, map, map_len) < 0) {
+        munmap(map, map_len);
+        return -1;
+    }
+
+    const snapshot_header *hdr = (const snapshot_header *)map;
+    db->sub_nums = (unsigned long *)(map + hdr->nums_off);
+    db->sub_techs = map + hdr->techs_off;
+    db->sub_paid_arr = map + hdr->paid_off;
+    db->len = (int)hdr->num_rows;
+    db->cap = (int)hdr->num_rows;
+    db->map = map;
+    db->map_len = map_len;
+    db->row_seq = 0;
+
+    idx->slots = (uint64_t *)(map + hdr->index_off);
+    idx->mask = hdr->index_capacity - 1;
+    idx->len = (int)hdr->num_rows;
+    idx->mapped = 1;
+    idx->bloom.words = (uint32_t *)(map + hdr->bloom_off);
+    idx->bloom.num_blocks = hdr->bloom_blocks;
+    idx->bloom.mapped = 1;
+    return 0;
+}
+
+int snapshot_load_or_parse(const char *snap_path, const char *text_path, sub_db *db, sub_index *idx) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (snapshot_load(snap_path, text_path, db, idx) == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        log_info("Loaded %d subscribers from snapshot %s in %.3f s", db->len, snap_path, secs);
+        return 0;
+    }
+
+    log_info("Falling back to text database %s", text_path);
+    if (sub_db_load_text(db, text_path) < 0) {
+        return -1;
+    }
+    if (sub_index_build(idx, db->sub_nums, db->len) < 0) {
+        sub_db_free(db);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "sub_db.h"
+#include "sub_index.h"
+
+// Binary snapshot of the subscriber database, compiled from the text file by dbcompile.
+// The file is a header followed by five sections, each starting on a 64-byte boundary:
+//   sub_nums    num_rows x uint64_t
+//   sub_techs   num_rows x uint8_t
+//   sub_paid    num_rows x uint8_t
+//   index       index_capacity x uint64_t (sub_index slots)
+//   bloom       bloom_blocks x SUB_BLOOM_BLOCK_WORDS x uint32_t (the index's Bloom filter)
+// Everything is stored in host byte order, so the server can serve straight from the mapping.
+// Bump SNAPSHOT_VERSION whenever the layout, the sub_index hash function or the filter layout changes.
+#define SNAPSHOT_MAGIC "SUBSNAP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+
+typedef struct snapshot_header {
+    char magic[8];            // SNAPSHOT_MAGIC
+    uint32_t version;         // SNAPSHOT_VERSION
+    uint32_t byte_order;      // SNAPSHOT_BYTE_ORDER as written by the compiling host
+    uint64_t file_size;       // total snapshot size in bytes
+    uint64_t num_rows;        // number of subscribers
+    uint64_t index_capacity;  // number of index slots (power of two)
+    uint64_t nums_off;        // section offsets from the start of the file
+    uint64_t techs_off;
+    uint64_t paid_off;
+    uint64_t index_off;
+    uint64_t bloom_off;
+    uint64_t bloom_blocks;    // number of Bloom filter blocks
+    uint64_t src_size;        // size of the text database the snapshot was compiled from
+    int64_t src_mtime_sec;    // modification time of that text database
+    int64_t src_mtime_nsec;
+    uint64_t checksum;        // checksum_update() (snapshot.c) over the whole file with this field set to 0
+} snapshot_header;
+
+/**
+ * Write db and its index to path as a snapshot compiled from the text database text_path.
+ * The snapshot is written to a temporary file and renamed into place.
+ * Return 0 on success; -1 on error.
+*/
+int snapshot_write(const char *path, const char *text_path, const sub_db *db, const sub_index *idx);
+
+/**
+ * Map the snapshot at path and point db and idx into it, without any parsing.
+ * The snapshot is rejected if it is missing, corrupt (bad magic, version, section bounds, index rows or checksum), or stale,
+ * i.e. text_path exists and its size or modification time differs from the one recorded at compile time.
+ * Release with sub_index_free() then sub_db_free().
+ * Return 0 on success; -1 if the snapshot cannot be used.
+*/
+int snapshot_load(const char *path, const char *text_path, sub_db *db, sub_index *idx);
+
+/**
+ * Load the subscriber database from the snapshot at snap_path if it is usable,
+ * otherwise parse text_path and build the index.
+ * Return 0 on success; -1 on error.
+*/
+int snapshot_load_or_parse(const char *snap_path, const char *text_path, sub_db *db, sub_index *idx);
+
+#endif
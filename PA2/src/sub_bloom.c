@@ -0,0 +1,30 @@
+#include "sub_bloom.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+int sub_bloom_init(sub_bloom *b, int max_keys) {
+    uint64_t bits = (uint64_t)(max_keys > 0 ? max_keys : 1) * SUB_BLOOM_BITS_PER_KEY;
+    b->num_blocks = (bits + SUB_BLOOM_BLOCK_WORDS * 32 - 1) / (SUB_BLOOM_BLOCK_WORDS * 32);
+    b->mapped = 0;
+    size_t size = b->num_blocks * SUB_BLOOM_BLOCK_WORDS * sizeof(uint32_t);
+    b->words = aligned_alloc(64, (size + 63) & ~(size_t)63);
+    if (!b->words) {
+        log_error("Index Error: Could not allocate a %zu byte Bloom filter.", size);
+        b->num_blocks = 0;
+        return -1;
+    }
+    memset(b->words, 0, size);
+    return 0;
+}
+
+void sub_bloom_free(sub_bloom *b) {
+    if (!b->mapped) {
+        free(b->words);
+    }
+    b->words = NULL;
+    b->num_blocks = 0;
+    b->mapped = 0;
+}
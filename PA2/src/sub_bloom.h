@@ -0,0 +1,70 @@
+#ifndef SUB_BLOOM_H
+#define SUB_BLOOM_H
+
+#include <stdint.h>
+
+// Filter bits per subscriber. 16 bits per key keeps false positives around 0.1 %.
+#ifndef SUB_BLOOM_BITS_PER_KEY
+#define SUB_BLOOM_BITS_PER_KEY 16
+#endif
+
+#define SUB_BLOOM_BLOCK_WORDS 8  // 8 x 32 bits = one 256-bit block, half a cache line
+
+// Split-block Bloom filter (the layout Parquet and Impala use) over subscriber number hashes.
+// A key selects one 256-bit block from the high half of its hash and sets one bit in each of the block's
+// eight 32-bit words from the low half. A lookup therefore reads a single block, and the eight word tests
+// are independent, so the compiler turns them into a couple of vector instructions.
+// There are no false negatives: a key the filter rejects is definitely not in the table.
+typedef struct sub_bloom {
+    uint32_t *words;      // num_blocks x SUB_BLOOM_BLOCK_WORDS, NULL if there is no filter
+    uint64_t num_blocks;
+    int mapped;           // words point into a snapshot mapping and are not owned by the filter
+} sub_bloom;
+
+/**
+ * Allocate an empty filter sized for max_keys keys.
+ * Return 0 on success; -1 if out of memory (the filter is left disabled).
+*/
+int sub_bloom_init(sub_bloom *b, int max_keys);
+
+void sub_bloom_free(sub_bloom *b);
+
+static inline const uint32_t *sub_bloom_block(const sub_bloom *b, uint64_t hash) {
+    // Maps the high 32 bits onto [0, num_blocks) without a division.
+    return b->words + (((hash >> 32) * b->num_blocks) >> 32) * SUB_BLOOM_BLOCK_WORDS;
+}
+
+/**
+ * One bit per word, picked by multiplying the low 32 bits of the hash by a per-word odd constant.
+*/
+static inline uint32_t sub_bloom_bit(uint64_t hash, int word) {
+    static const uint32_t salts[SUB_BLOOM_BLOCK_WORDS] = {
+        0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+    };
+    return 1U << (((uint32_t)hash * salts[word]) >> 27);
+}
+
+/**
+ * Add a key by its hash. Safe while readers test the filter: each word is updated with an atomic OR.
+*/
+static inline void sub_bloom_add(sub_bloom *b, uint64_t hash) {
+    uint32_t *block = (uint32_t *)sub_bloom_block(b, hash);
+    for (int i = 0; i < SUB_BLOOM_BLOCK_WORDS; i++) {
+        __atomic_fetch_or(&block[i], sub_bloom_bit(hash, i), __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Return 0 if the key with this hash is definitely not in the filter; 1 if it may be.
+*/
+static inline int sub_bloom_may_contain(const sub_bloom *b, uint64_t hash) {
+    const uint32_t *block = sub_bloom_block(b, hash);
+    uint32_t missing = 0;
+    for (int i = 0; i < SUB_BLOOM_BLOCK_WORDS; i++) {
+        uint32_t bit = sub_bloom_bit(hash, i);
+        missing |= (block[i] & bit) ^ bit;
+    }
+    return missing == 0;
+}
+
+#endif
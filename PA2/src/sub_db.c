@@ -0,0 +1,209 @@
+#include "sub_db.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+
+// Shortest line we expect ("408-554-6805 04 1\n" is 18 bytes), used to pre-size the arrays
+// from the file size so that a well-formed file never needs to grow them.
+#define SUB_DB_MIN_LINE_LEN 16
+#define SUB_DB_MIN_CAPACITY 16
+
+static inline int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline int is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/**
+ * Grow all three columns to hold at least new_cap rows.
+ * Return 0 on success; -1 if out of memory.
+*/
+static int sub_db_reserve(sub_db *db, int new_cap) {
+    unsigned long *nums = realloc(db->sub_nums, sizeof(unsigned long) * new_cap);
+    if (!nums) {
+        return -1;
+    }
+    db->sub_nums = nums;
+    char *techs = realloc(db->sub_techs, new_cap);
+    if (!techs) {
+        return -1;
+    }
+    db->sub_techs = techs;
+    char *paid = realloc(db->sub_paid_arr, new_cap);
+    if (!paid) {
+        return -1;
+    }
+    db->sub_paid_arr = paid;
+    db->cap = new_cap;
+    return 0;
+}
+
+/**
+ * Parse one decimal field starting at p, skipping leading blanks.
+ * Return pointer just past the last digit consumed.
+*/
+static inline const char *scan_uint(const char *p, const char *end, unsigned long *value) {
+    unsigned long v = 0;
+    while (p < end && is_blank(*p)) {
+        p++;
+    }
+    while (p < end && is_digit(*p)) {
+        v = v * 10 + (unsigned long)(*p - '0');
+        p++;
+    }
+    *value = v;
+    return p;
+}
+
+/**
+ * Parse the mapped text in [p, end) and append one row per non-empty line.
+ * Return 0 on success; -1 if out of memory.
+*/
+static int sub_db_parse(sub_db *db, const char *p, const char *end) {
+    while (p < end) {
+        // Subscriber number: keep the digits, skip separators such as '-' or '.'
+        unsigned long sub_num = 0;
+        int num_digits = 0;
+        while (p < end && is_blank(*p)) {
+            p++;
+        }
+        while (p < end && !is_blank(*p) && *p != '\n') {
+            if (is_digit(*p)) {
+                sub_num = sub_num * 10 + (unsigned long)(*p - '0');
+                num_digits++;
+            }
+            p++;
+        }
+
+        unsigned long tech = 0, paid = 0;
+        p = scan_uint(p, end, &tech);
+        p = scan_uint(p, end, &paid);
+
+        // Drop whatever is left on the line, including the newline itself.
+        while (p < end && *p != '\n') {
+            p++;
+        }
+        p++;
+
+        if (num_digits == 0) {
+            continue;  // blank line
+        }
+        if (db->len == db->cap && sub_db_reserve(db, db->cap * 2) < 0) {
+            return -1;
+        }
+        db->sub_nums[db->len] = sub_num;
+        db->sub_techs[db->len] = (char)tech;
+        db->sub_paid_arr[db->len] = (char)paid;
+        db->len++;
+    }
+    return 0;
+}
+
+int sub_db_load_text(sub_db *db, const char *path) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    db->sub_nums = NULL;
+    db->sub_techs = NULL;
+    db->sub_paid_arr = NULL;
+    db->len = 0;
+    db->cap = 0;
+    db->map = NULL;
+    db->map_len = 0;
+    db->row_seq = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        log_error("DB Error: Could not open %s.", path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        log_error("DB Error: Could not stat %s.", path);
+        close(fd);
+        return -1;
+    }
+    size_t file_size = (size_t)st.st_size;
+
+    long est_rows = (long)(file_size / SUB_DB_MIN_LINE_LEN) + 1;
+    if (est_rows < SUB_DB_MIN_CAPACITY) {
+        est_rows = SUB_DB_MIN_CAPACITY;
+    }
+    if (sub_db_reserve(db, (int)est_rows) < 0) {
+        log_error("DB Error: Could not allocate %ld rows.", est_rows);
+        close(fd);
+        sub_db_free(db);
+        return -1;
+    }
+
+    if (file_size > 0) {
+        char *map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            log_error("DB Error: Could not mmap %s.", path);
+            close(fd);
+            sub_db_free(db);
+            return -1;
+        }
+        madvise(map, file_size, MADV_SEQUENTIAL);
+        int ret = sub_db_parse(db, map, map + file_size);
+        munmap(map, file_size);
+        if (ret < 0) {
+            log_error("DB Error: Out of memory after %d rows of %s.", db->len, path);
+            close(fd);
+            sub_db_free(db);
+            return -1;
+        }
+    }
+    close(fd);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    log_info("Loaded %d subscribers from %s in %.3f s (%.0f rows/s)", db->len, path, secs, secs > 0 ? db->len / secs : 0.0);
+    return 0;
+}
+
+int sub_db_clone(sub_db *dst, const sub_db *src, int cap) {
+    dst->sub_nums = NULL;
+    dst->sub_techs = NULL;
+    dst->sub_paid_arr = NULL;
+    dst->len = 0;
+    dst->cap = 0;
+    dst->map = NULL;
+    dst->map_len = 0;
+    dst->row_seq = 0;
+    if (sub_db_reserve(dst, cap > src->len ? cap : src->len) < 0) {
+        sub_db_free(dst);
+        return -1;
+    }
+    memcpy(dst->sub_nums, src->sub_nums, sizeof(unsigned long) * src->len);
+    memcpy(dst->sub_techs, src->sub_techs, src->len);
+    memcpy(dst->sub_paid_arr, src->sub_paid_arr, src->len);
+    dst->len = src->len;
+    return 0;
+}
+
+void sub_db_free(sub_db *db) {
+    if (db->map) {
+        munmap(db->map, db->map_len);
+    } else {
+        free(db->sub_nums);
+        free(db->sub_techs);
+        free(db->sub_paid_arr);
+    }
+    db->map = NULL;
+    db->map_len = 0;
+    db->sub_nums = NULL;
+    db->sub_techs = NULL;
+    db->sub_paid_arr = NULL;
+    db->len = 0;
+    db->cap = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef SUB_DB_H
+#define SUB_DB_H
+
+#include <stddef.h>
+
+// Subscriber database held as three parallel (columnar) arrays.
+// The arrays live on the heap when parsed from text, or inside a private copy-on-write mapping when
+// served from a binary snapshot (see snapshot.h), in which case map is non-NULL. Either way delta
+// updates (live_db.h) may change a row's technology and paid bytes in place while readers use them.
+typedef struct sub_db {
+    unsigned long *sub_nums;  // all subscriber numbers in the database
+    char *sub_techs;          // technology which each subscribers is using
+    char *sub_paid_arr;       // subscribers payment status (1 = paid, 0 = not paid).
+    int len;                  // number of entries in db
+    int cap;                  // allocated entries in each array
+    void *map;                // snapshot mapping backing the arrays, NULL if heap allocated
+    size_t map_len;           // length of the snapshot mapping
+    unsigned int row_seq;     // odd while a row is being changed in place, see sub_db_read_row()
+} sub_db;
+
+/**
+ * Read the technology and paid bytes of row as one pair that existed at some instant: a delta update
+ * changes both under row_seq (a seqlock), and a read that overlapped an update is retried.
+*/
+static inline void sub_db_read_row(const sub_db *db, int row, char *tech, char *paid) {
+    unsigned int seq;
+    do {
+        seq = __atomic_load_n(&db->row_seq, __ATOMIC_ACQUIRE);
+        *tech = __atomic_load_n(&db->sub_techs[row], __ATOMIC_RELAXED);
+        *paid = __atomic_load_n(&db->sub_paid_arr[row], __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) != 0 || seq != __atomic_load_n(&db->row_seq, __ATOMIC_RELAXED));
+}
+
+/**
+ * Load a text database such as Verification_Database.txt into db.
+ * Each line is "<subscriber number> <technology> <paid>", e.g. "408-554-6805 04 1". Any non-digit
+ * character inside the subscriber number ('-', '.') is skipped. The file is mmap'ed and parsed
+ * in a single pass, and the load throughput is logged.
+ * Return 0 on success; -1 on error (db is left empty).
+*/
+int sub_db_load_text(sub_db *db, const char *path);
+
+/**
+ * Copy src into a new heap database dst with room for cap rows (at least src->len).
+ * Return 0 on success; -1 if out of memory (dst is left empty).
+*/
+int sub_db_clone(sub_db *dst, const sub_db *src, int cap);
+
+void sub_db_free(sub_db *db);
+
+#endif
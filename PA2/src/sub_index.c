@@ -0,0 +1,144 @@
+#include "sub_index.h"
+
+#include <stdlib.h>
+
+#include "log.h"
+#include "sub_scan.h"
+
+#define SLOT_ROW_MASK 0xFFFFFFFFULL
+#define SUB_INDEX_MIN_CAPACITY 16
+
+static _Thread_local sub_index_stats stats;
+
+/**
+ * 64-bit finalizer from MurmurHash3. Subscriber numbers are dense decimal phone numbers,
+ * so the low bits have to be mixed before they can be used as a slot position.
+*/
+static inline uint64_t sub_hash(unsigned long sub_num) {
+    uint64_t h = (uint64_t)sub_num;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+int find(const unsigned long *subn_arr, int arr_len, unsigned long sub_num) {
+    return sub_scan_find(subn_arr, arr_len, sub_num);
+}
+
+int sub_index_build(sub_index *idx, const unsigned long *sub_nums, int len) {
+    return sub_index_build_for(idx, sub_nums, len, len);
+}
+
+int sub_index_build_for(sub_index *idx, const unsigned long *sub_nums, int len, int max_rows) {
+    // Keep the load factor at or below 3/4 so probe sequences stay short.
+    uint64_t capacity = SUB_INDEX_MIN_CAPACITY;
+    while (capacity * 3 < (uint64_t)(max_rows > len ? max_rows : len) * 4) {
+        capacity <<= 1;
+    }
+
+    idx->slots = calloc(capacity, sizeof(uint64_t));
+    if (!idx->slots) {
+        log_error("Index Error: Could not allocate %lu slots.", (unsigned long)capacity);
+        return -1;
+    }
+    idx->mask = capacity - 1;
+    idx->len = len;
+    idx->mapped = 0;
+    if (sub_bloom_init(&idx->bloom, max_rows > len ? max_rows : len) < 0) {
+        free(idx->slots);
+        idx->slots = NULL;
+        return -1;
+    }
+
+    for (int row = 0; row < len; row++) {
+        uint64_t h = sub_hash(sub_nums[row]);
+        sub_bloom_add(&idx->bloom, h);
+        uint64_t tag = h >> 32;
+        uint64_t pos = h & idx->mask;
+        while (idx->slots[pos] != 0) {
+            uint64_t slot = idx->slots[pos];
+            if ((slot >> 32) == tag && sub_nums[(slot & SLOT_ROW_MASK) - 1] == sub_nums[row]) {
+                break;  // duplicate subscriber number, keep the first row
+            }
+            pos = (pos + 1) & idx->mask;
+        }
+        if (idx->slots[pos] == 0) {
+            idx->slots[pos] = (tag << 32) | (uint64_t)(row + 1);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Probe for sub_num, confirming tag matches against keys[row * stride].
+*/
+static inline int index_probe(const sub_index *idx, const unsigned long *keys, size_t stride, unsigned long sub_num) {
+    uint64_t h = sub_hash(sub_num);
+    stats.lookups++;
+    if (idx->bloom.words && !sub_bloom_may_contain(&idx->bloom, h)) {
+        stats.bloom_rejects++;
+        return -1;
+    }
+    uint64_t tag = h >> 32;
+    uint64_t pos = h & idx->mask;
+    uint64_t slot;
+    // Acquire pairs with the release in sub_index_insert(); a plain load on x86.
+    while ((slot = __atomic_load_n(&idx->slots[pos], __ATOMIC_ACQUIRE)) != 0) {
+        if ((slot >> 32) == tag) {
+            int row = (int)((slot & SLOT_ROW_MASK) - 1);
+            if (keys[(size_t)row * stride] == sub_num) {
+                return row;
+            }
+        }
+        pos = (pos + 1) & idx->mask;
+    }
+    stats.false_positives += idx->bloom.words != NULL;
+    return -1;
+}
+
+int sub_index_find(const sub_index *idx, const unsigned long *sub_nums, unsigned long sub_num) {
+    return index_probe(idx, sub_nums, 1, sub_num);
+}
+
+int sub_index_find_strided(const sub_index *idx, const unsigned long *keys, size_t stride, unsigned long sub_num) {
+    return index_probe(idx, keys, stride, sub_num);
+}
+
+int sub_index_insert(sub_index *idx, const unsigned long *sub_nums, int row) {
+    if (idx->mapped || (uint64_t)(idx->len + 1) * 4 > (idx->mask + 1) * 3) {
+        return -1;
+    }
+    uint64_t h = sub_hash(sub_nums[row]);
+    uint64_t tag = h >> 32;
+    uint64_t pos = h & idx->mask;
+    while (idx->slots[pos] != 0) {
+        pos = (pos + 1) & idx->mask;
+    }
+    if (idx->bloom.words) {
+        sub_bloom_add(&idx->bloom, h);  // before the slot, so a reader that finds the slot passes the filter
+    }
+    __atomic_store_n(&idx->slots[pos], (tag << 32) | (uint64_t)(row + 1), __ATOMIC_RELEASE);
+    idx->len++;
+    return 0;
+}
+
+void sub_index_stats_take(sub_index_stats *out) {
+    *out = stats;
+    stats.lookups = 0;
+    stats.bloom_rejects = 0;
+    stats.false_positives = 0;
+}
+
+void sub_index_free(sub_index *idx) {
+    if (!idx->mapped) {
+        free(idx->slots);
+    }
+    sub_bloom_free(&idx->bloom);
+    idx->slots = NULL;
+    idx->mask = 0;
+    idx->len = 0;
+    idx->mapped = 0;
+}
@@ -0,0 +1,80 @@
+#ifndef SUB_INDEX_H
+#define SUB_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sub_bloom.h"
+
+// Open-addressing (linear probing) hash index over the subscriber number column.
+// Each slot is a single 64-bit word: the high 32 bits hold a tag taken from the key's hash,
+// the low 32 bits hold (row + 1) so that an all-zero slot means "empty".
+// The index never stores the key itself, a tag match is confirmed against sub_nums[row].
+// A Bloom filter over the same hash sits in front of the slots: most lookups for numbers that are not
+// in the table stop after reading one filter block, without touching the slot array.
+typedef struct sub_index {
+    uint64_t *slots;  // slot array, capacity is a power of two
+    uint64_t mask;    // capacity - 1
+    int len;          // number of rows in the index
+    int mapped;       // slots point into a snapshot mapping and are not owned by the index
+    sub_bloom bloom;  // filter over every indexed key, words == NULL if disabled
+} sub_index;
+
+// Lookup counters of the calling thread, see sub_index_stats_take().
+typedef struct sub_index_stats {
+    unsigned long lookups;          // sub_index_find() and sub_index_find_strided() calls
+    unsigned long bloom_rejects;    // misses answered by the filter alone
+    unsigned long false_positives;  // misses the filter let through to the slots
+} sub_index_stats;
+
+/**
+ * Linear search on subscriber number array subn_arr to find the sub_num (vectorized, see sub_scan.h)
+ * Return index if found; -1 if not found
+*/
+int find(const unsigned long *subn_arr, int arr_len, unsigned long sub_num);
+
+/**
+ * Build the hash index over sub_nums[0..len). If a subscriber number appears more than once,
+ * the first row wins (same answer as find()).
+ * Return 0 on success; -1 if the slot array could not be allocated.
+*/
+int sub_index_build(sub_index *idx, const unsigned long *sub_nums, int len);
+
+/**
+ * Same as sub_index_build(), with enough slots and filter bits for sub_index_insert() to add rows up to
+ * max_rows in total.
+*/
+int sub_index_build_for(sub_index *idx, const unsigned long *sub_nums, int len, int max_rows);
+
+/**
+ * Add row, whose subscriber number sub_nums[row] is not in the index yet, while readers may be probing:
+ * the slot is published with a release store after sub_nums[row] has been written.
+ * Return 0 on success; -1 if the index is mapped or would go past its maximum load factor.
+*/
+int sub_index_insert(sub_index *idx, const unsigned long *sub_nums, int row);
+
+/**
+ * Look up sub_num using the hash index built over sub_nums.
+ * Return row index if found; -1 if not found
+*/
+int sub_index_find(const sub_index *idx, const unsigned long *sub_nums, unsigned long sub_num);
+
+/**
+ * sub_index_find() for keys that are not a dense column: row i's subscriber number is keys[i * stride]
+ * (an array of structs, see sub_layout.h). The index must have been built over the same numbers.
+ * Return row index if found; -1 if not found
+*/
+int sub_index_find_strided(const sub_index *idx, const unsigned long *keys, size_t stride, unsigned long sub_num);
+
+/**
+ * Copy the calling thread's lookup counters into stats and reset them.
+ * The counters are thread-local, so workers never share a cache line to count.
+*/
+void sub_index_stats_take(sub_index_stats *stats);
+
+/**
+ * Release the slot array and the filter. Parts that live in a snapshot mapping are left to the mapping's owner.
+*/
+void sub_index_free(sub_index *idx);
+
+#endif
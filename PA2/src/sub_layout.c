@@ -0,0 +1,77 @@
+#include "sub_layout.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+#if SUB_LAYOUT == SUB_LAYOUT_AOS
+_Static_assert(sizeof(sub_row) % sizeof(unsigned long) == 0, "sub_table_find() strides over whole keys");
+#endif
+
+int sub_table_build(sub_table *table, const sub_db *db) {
+    memset(table, 0, sizeof(*table));
+    size_t len = db->len > 0 ? (size_t)db->len : 1;
+#if SUB_LAYOUT == SUB_LAYOUT_AOS
+    table->rows = malloc(sizeof(sub_row) * len);
+    if (!table->rows) {
+        log_error("Layout Error: Could not allocate %d rows.", db->len);
+        return -1;
+    }
+    for (int i = 0; i < db->len; i++) {
+        table->rows[i].sub_num = db->sub_nums[i];
+        table->rows[i].technology = db->sub_techs[i];
+        table->rows[i].paid = db->sub_paid_arr[i];
+    }
+#else
+    table->sub_nums = malloc(sizeof(unsigned long) * len);
+#if SUB_LAYOUT == SUB_LAYOUT_HYBRID
+    table->attrs = malloc(sizeof(unsigned short) * len);
+    if (!table->sub_nums || !table->attrs) {
+#else
+    table->sub_techs = malloc(len);
+    table->sub_paid_arr = malloc(len);
+    if (!table->sub_nums || !table->sub_techs || !table->sub_paid_arr) {
+#endif
+        log_error("Layout Error: Could not allocate %d rows.", db->len);
+        sub_table_free(table);
+        return -1;
+    }
+    memcpy(table->sub_nums, db->sub_nums, sizeof(unsigned long) * db->len);
+#if SUB_LAYOUT == SUB_LAYOUT_HYBRID
+    for (int i = 0; i < db->len; i++) {
+        table->attrs[i] = (unsigned short)((unsigned char)db->sub_techs[i] | (unsigned char)db->sub_paid_arr[i] << SUB_ATTR_PAID_SHIFT);
+    }
+#else
+    memcpy(table->sub_techs, db->sub_techs, db->len);
+    memcpy(table->sub_paid_arr, db->sub_paid_arr, db->len);
+#endif
+#endif
+    table->len = db->len;
+    return 0;
+}
+
+void sub_table_free(sub_table *table) {
+#if SUB_LAYOUT == SUB_LAYOUT_AOS
+    free(table->rows);
+#else
+    free(table->sub_nums);
+#if SUB_LAYOUT == SUB_LAYOUT_HYBRID
+    free(table->attrs);
+#else
+    free(table->sub_techs);
+    free(table->sub_paid_arr);
+#endif
+#endif
+    memset(table, 0, sizeof(*table));
+}
+
+const char *sub_table_layout_name(void) {
+#if SUB_LAYOUT == SUB_LAYOUT_AOS
+    return "aos";
+#elif SUB_LAYOUT == SUB_LAYOUT_HYBRID
+    return "hybrid";
+#else
+    return "soa";
+#endif
+}
@@ -0,0 +1,85 @@
+#ifndef SUB_LAYOUT_H
+#define SUB_LAYOUT_H
+
+#include "const.h"
+#include "sub_db.h"
+#include "sub_index.h"
+
+// Read-only copy of a sub_db in the row layout selected by SUB_LAYOUT (const.h), for comparing how
+// many cache lines a verification touches:
+//  - SUB_LAYOUT_SOA: the sub_db columns as they are. A hit reads the key, technology and paid lines.
+//  - SUB_LAYOUT_AOS: one sub_row per row, so a hit reads a single line, but scans over the keys
+//    read twice as many bytes.
+//  - SUB_LAYOUT_HYBRID: the key column stays dense for probing and scanning; technology and paid are
+//    packed into one 16-bit attribute, so a hit reads two lines.
+// The hash index is built over the subscriber numbers as usual; row numbers are the same in every layout.
+#if SUB_LAYOUT == SUB_LAYOUT_AOS
+typedef struct sub_row {
+    unsigned long sub_num;
+    char technology;
+    char paid;
+} sub_row;  // padded to 16 bytes, so rows never straddle a cache line
+#elif SUB_LAYOUT == SUB_LAYOUT_HYBRID
+#define SUB_ATTR_PAID_SHIFT 8  // attribute = technology | paid << SUB_ATTR_PAID_SHIFT
+#elif SUB_LAYOUT != SUB_LAYOUT_SOA
+#error "SUB_LAYOUT must be SUB_LAYOUT_SOA, SUB_LAYOUT_AOS or SUB_LAYOUT_HYBRID"
+#endif
+
+typedef struct sub_table {
+#if SUB_LAYOUT == SUB_LAYOUT_AOS
+    sub_row *rows;
+#else
+    unsigned long *sub_nums;
+#if SUB_LAYOUT == SUB_LAYOUT_HYBRID
+    unsigned short *attrs;
+#else
+    char *sub_techs;
+    char *sub_paid_arr;
+#endif
+#endif
+    int len;
+} sub_table;
+
+/**
+ * Copy db into table in the SUB_LAYOUT layout.
+ * Return 0 on success; -1 if out of memory (table is left empty).
+*/
+int sub_table_build(sub_table *table, const sub_db *db);
+
+void sub_table_free(sub_table *table);
+
+const char *sub_table_layout_name(void);
+
+/**
+ * Look up sub_num with idx (built over the same subscriber numbers).
+ * Return the row if found; -1 if not found.
+*/
+static inline int sub_table_find(const sub_index *idx, const sub_table *table, unsigned long sub_num) {
+#if SUB_LAYOUT == SUB_LAYOUT_AOS
+    return sub_index_find_strided(idx, &table->rows[0].sub_num, sizeof(sub_row) / sizeof(unsigned long), sub_num);
+#else
+    return sub_index_find(idx, table->sub_nums, sub_num);
+#endif
+}
+
+static inline char sub_table_tech(const sub_table *table, int row) {
+#if SUB_LAYOUT == SUB_LAYOUT_AOS
+    return table->rows[row].technology;
+#elif SUB_LAYOUT == SUB_LAYOUT_HYBRID
+    return (char)(table->attrs[row] & 0xFF);
+#else
+    return table->sub_techs[row];
+#endif
+}
+
+static inline char sub_table_paid(const sub_table *table, int row) {
+#if SUB_LAYOUT == SUB_LAYOUT_AOS
+    return table->rows[row].paid;
+#elif SUB_LAYOUT == SUB_LAYOUT_HYBRID
+    return (char)(table->attrs[row] >> SUB_ATTR_PAID_SHIFT);
+#else
+    return table->sub_paid_arr[row];
+#endif
+}
+
+#endif
@@ -0,0 +1,188 @@
+#include "sub_scan.h"
+
+#include <immintrin.h>
+#include <stdint.h>
+
+#include "const.h"
+
+typedef struct scan_impl {
+    int (*find)(const unsigned long *sub_nums, int len, unsigned long sub_num);
+    // Bit i of the result is set if row base + i matches, for the rows base..base+31 (all present).
+    uint32_t (*match32)(const char *techs, const char *paid, int technology, int paid_wanted);
+} scan_impl;
+
+_Static_assert(sizeof(unsigned long) == sizeof(uint64_t), "the find kernels compare 64-bit lanes");
+
+// ======================== SCALAR ========================
+
+static int find_scalar(const unsigned long *sub_nums, int len, unsigned long sub_num) {
+    for (int i = 0; i < len; i++) {
+        if (sub_nums[i] == sub_num) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static inline int row_matches(char tech, char paid, int technology, int paid_wanted) {
+    return tech != (char)INVALID_TECHNOLOGY &&
+           (technology == SUB_SCAN_ANY || tech == (char)technology) &&
+           (paid_wanted == SUB_SCAN_ANY || paid == (char)paid_wanted);
+}
+
+static uint32_t match32_scalar(const char *techs, const char *paid, int technology, int paid_wanted) {
+    uint32_t mask = 0;
+    for (int i = 0; i < 32; i++) {
+        mask |= (uint32_t)row_matches(techs[i], paid[i], technology, paid_wanted) << i;
+    }
+    return mask;
+}
+
+// ======================== SSE4 ========================
+
+__attribute__((target("sse4.2"))) static int find_sse4(const unsigned long *sub_nums, int len, unsigned long sub_num) {
+    __m128i key = _mm_set1_epi64x((long long)sub_num);
+    int i = 0;
+    for (; i + 8 <= len; i += 8) {
+        __m128i e0 = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i *)(sub_nums + i)), key);
+        __m128i e1 = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i *)(sub_nums + i + 2)), key);
+        __m128i e2 = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i *)(sub_nums + i + 4)), key);
+        __m128i e3 = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i *)(sub_nums + i + 6)), key);
+        __m128i any = _mm_or_si128(_mm_or_si128(e0, e1), _mm_or_si128(e2, e3));
+        if (!_mm_testz_si128(any, any)) {
+            break;  // the hit is in these 8, the scalar tail finds which
+        }
+    }
+    int hit = find_scalar(sub_nums + i, len - i, sub_num);
+    return hit < 0 ? -1 : i + hit;
+}
+
+__attribute__((target("sse4.2"))) static uint32_t match16_sse4(const char *techs, const char *paid, __m128i tech_v, __m128i paid_v, int any_tech, int any_paid) {
+    __m128i t = _mm_loadu_si128((const __m128i *)techs);
+    __m128i m = any_tech ? _mm_xor_si128(_mm_cmpeq_epi8(t, _mm_setzero_si128()), _mm_set1_epi8(-1)) : _mm_cmpeq_epi8(t, tech_v);
+    if (!any_paid) {
+        m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)paid), paid_v));
+    }
+    return (uint32_t)_mm_movemask_epi8(m);
+}
+
+__attribute__((target("sse4.2"))) static uint32_t match32_sse4(const char *techs, const char *paid, int technology, int paid_wanted) {
+    // A wanted technology is never INVALID_TECHNOLOGY (0), so equality already excludes deleted rows.
+    __m128i tech_v = _mm_set1_epi8((char)technology);
+    __m128i paid_v = _mm_set1_epi8((char)paid_wanted);
+    int any_tech = technology == SUB_SCAN_ANY, any_paid = paid_wanted == SUB_SCAN_ANY;
+    return match16_sse4(techs, paid, tech_v, paid_v, any_tech, any_paid) |
+           match16_sse4(techs + 16, paid + 16, tech_v, paid_v, any_tech, any_paid) << 16;
+}
+
+// ======================== AVX2 ========================
+
+__attribute__((target("avx2"))) static int find_avx2(const unsigned long *sub_nums, int len, unsigned long sub_num) {
+    __m256i key = _mm256_set1_epi64x((long long)sub_num);
+    int i = 0;
+    for (; i + 8 <= len; i += 8) {
+        __m256i e0 = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(sub_nums + i)), key);
+        __m256i e1 = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(sub_nums + i + 4)), key);
+        __m256i any = _mm256_or_si256(e0, e1);
+        if (!_mm256_testz_si256(any, any)) {
+            break;
+        }
+    }
+    int hit = find_scalar(sub_nums + i, len - i, sub_num);
+    return hit < 0 ? -1 : i + hit;
+}
+
+__attribute__((target("avx2"))) static uint32_t match32_avx2(const char *techs, const char *paid, int technology, int paid_wanted) {
+    __m256i t = _mm256_loadu_si256((const __m256i *)techs);
+    __m256i m;
+    if (technology == SUB_SCAN_ANY) {
+        m = _mm256_xor_si256(_mm256_cmpeq_epi8(t, _mm256_setzero_si256()), _mm256_set1_epi8(-1));
+    } else {
+        m = _mm256_cmpeq_epi8(t, _mm256_set1_epi8((char)technology));
+    }
+    if (paid_wanted != SUB_SCAN_ANY) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)paid);
+        m = _mm256_and_si256(m, _mm256_cmpeq_epi8(p, _mm256_set1_epi8((char)paid_wanted)));
+    }
+    return (uint32_t)_mm256_movemask_epi8(m);
+}
+
+// ======================== DISPATCH ========================
+
+static const scan_impl impls[] = {
+    [SUB_SCAN_SCALAR] = {find_scalar, match32_scalar},
+    [SUB_SCAN_SSE4] = {find_sse4, match32_sse4},
+    [SUB_SCAN_AVX2] = {find_avx2, match32_avx2},
+};
+
+static const scan_impl *impl = &impls[SUB_SCAN_SCALAR];
+
+__attribute__((constructor)) static void sub_scan_init(void) {
+    impl = &impls[sub_scan_best_level()];
+}
+
+sub_scan_level sub_scan_best_level(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SUB_SCAN_AVX2;
+    } else if (__builtin_cpu_supports("sse4.2")) {
+        return SUB_SCAN_SSE4;
+    }
+    return SUB_SCAN_SCALAR;
+}
+
+int sub_scan_use(sub_scan_level level) {
+    if (level > sub_scan_best_level()) {
+        return -1;
+    }
+    impl = &impls[level];
+    return 0;
+}
+
+const char *sub_scan_level_name(sub_scan_level level) {
+    static const char *names[] = {"scalar", "sse4", "avx2"};
+    return names[level];
+}
+
+int sub_scan_find(const unsigned long *sub_nums, int len, unsigned long sub_num) {
+    return impl->find(sub_nums, len, sub_num);
+}
+
+long sub_scan_count(const sub_db *db, const sub_filter *filter) {
+    if (filter->technology == INVALID_TECHNOLOGY) {
+        return 0;  // only deleted rows carry it, and they never match
+    }
+    long count = 0;
+    int i = 0;
+    for (; i + 32 <= db->len; i += 32) {
+        count += __builtin_popcount(impl->match32(db->sub_techs + i, db->sub_paid_arr + i, filter->technology, filter->paid));
+    }
+    for (; i < db->len; i++) {
+        count += row_matches(db->sub_techs[i], db->sub_paid_arr[i], filter->technology, filter->paid);
+    }
+    return count;
+}
+
+int sub_scan_select(const sub_db *db, const sub_filter *filter, int from, int *rows, int max_rows, int *next) {
+    if (filter->technology == INVALID_TECHNOLOGY) {
+        *next = db->len;
+        return 0;
+    }
+    int n = 0;
+    int i = from;
+    // Whole blocks of 32 are taken only while they are sure to fit, so no match is ever dropped.
+    for (; i + 32 <= db->len && n + 32 <= max_rows; i += 32) {
+        uint32_t mask = impl->match32(db->sub_techs + i, db->sub_paid_arr + i, filter->technology, filter->paid);
+        while (mask) {
+            rows[n++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+    for (; i < db->len && n < max_rows; i++) {
+        if (row_matches(db->sub_techs[i], db->sub_paid_arr[i], filter->technology, filter->paid)) {
+            rows[n++] = i;
+        }
+    }
+    *next = i;
+    return n;
+}
@@ -0,0 +1,56 @@
+#ifndef SUB_SCAN_H
+#define SUB_SCAN_H
+
+#include "sub_db.h"
+
+// Full scans over the subscriber columns, for lookups without the hash index (find()) and for ad-hoc
+// queries such as "all unpaid 4G subscribers". Each kernel exists as scalar C, SSE4 (2 subscriber numbers
+// or 16 rows per compare) and AVX2 (4 subscriber numbers or 32 rows per compare); the best one the CPU
+// supports is picked once at startup.
+typedef enum sub_scan_level {
+    SUB_SCAN_SCALAR,
+    SUB_SCAN_SSE4,
+    SUB_SCAN_AVX2,
+} sub_scan_level;
+
+// Matches any technology or payment status in a sub_filter.
+#define SUB_SCAN_ANY (-1)
+
+// Rows selected by a scan: technology and paid either equal the wanted value or are SUB_SCAN_ANY.
+// Rows deleted by a delta update (technology INVALID_TECHNOLOGY) never match.
+typedef struct sub_filter {
+    int technology;
+    int paid;
+} sub_filter;
+
+/**
+ * Return the index of the first sub_nums[i] == sub_num; -1 if not found.
+*/
+int sub_scan_find(const unsigned long *sub_nums, int len, unsigned long sub_num);
+
+/**
+ * Return the number of rows of db that match filter.
+*/
+long sub_scan_count(const sub_db *db, const sub_filter *filter);
+
+/**
+ * Write the indexes of the rows of db that match filter, starting at row from, into rows[0..max_rows).
+ * *next is set to the row to resume from, db->len once the scan is complete.
+ * Return the number of rows written.
+*/
+int sub_scan_select(const sub_db *db, const sub_filter *filter, int from, int *rows, int max_rows, int *next);
+
+/**
+ * Best kernel level this CPU supports.
+*/
+sub_scan_level sub_scan_best_level(void);
+
+/**
+ * Use the kernels of level from now on (for benchmarks and comparisons). Not thread-safe against running scans.
+ * Return 0 on success; -1 if the CPU does not support level.
+*/
+int sub_scan_use(sub_scan_level level);
+
+const char *sub_scan_level_name(sub_scan_level level);
+
+#endif
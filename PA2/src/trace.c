@@ -0,0 +1,93 @@
+#define _GNU_SOURCE
+#include "trace.h"
+
+#if SERVER_TRACE
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+
+_Thread_local trace_buffer trace_local;
+
+static const char *const stage_names[TRACE_NUM_STAGES] = {
+    "wait", "recv", "batch", "datagram", "addr", "decode", "lookup", "check", "encode", "log", "send", "expire",
+};
+
+static pthread_once_t calibrate_once = PTHREAD_ONCE_INIT;
+static double ticks_per_us;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Measure the rate of trace_ticks() against the monotonic clock over 20 ms, once per process.
+*/
+static void calibrate(void) {
+    uint64_t ns0 = monotonic_ns();
+    uint64_t t0 = trace_ticks();
+    struct timespec pause = {0, 20000000L};
+    nanosleep(&pause, NULL);
+    uint64_t ns1 = monotonic_ns();
+    uint64_t t1 = trace_ticks();
+    ticks_per_us = (double)(t1 - t0) * 1e3 / (double)(ns1 - ns0);
+}
+
+void trace_thread_start(const char *name) {
+    pthread_once(&calibrate_once, calibrate);
+    char path[64];
+    pid_t pid = getpid();
+    pid_t tid = gettid();
+    snprintf(path, sizeof(path), "trace.%d.%d.bin", (int)pid, (int)tid);
+    size_t len = sizeof(trace_header) + sizeof(trace_event) * (size_t)TRACE_BUFFER_EVENTS;
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0 || ftruncate(fd, (off_t)len) < 0) {
+        log_warn("Trace: could not create %s, thread %s is not traced.", path, name);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    void *mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        log_warn("Trace: could not map %s, thread %s is not traced.", path, name);
+        return;
+    }
+    // Touch every page now, so the first spans do not pay for page faults.
+    memset(mem, 0, len);
+
+    trace_header *hdr = mem;
+    memcpy(hdr->magic, TRACE_MAGIC, sizeof(hdr->magic));
+    hdr->version = TRACE_VERSION;
+    hdr->capacity = TRACE_BUFFER_EVENTS;
+    hdr->pid = (uint32_t)pid;
+    hdr->tid = (uint32_t)tid;
+    hdr->ticks_per_us = ticks_per_us;
+    hdr->base_ticks = trace_ticks();
+    strncpy(hdr->thread_name, name, TRACE_NAME_LEN - 1);
+    for (int i = 0; i < TRACE_NUM_STAGES; i++) {
+        strncpy(hdr->stage_names[i], stage_names[i], TRACE_NAME_LEN - 1);
+    }
+    trace_local.events = (trace_event *)(hdr + 1);
+    trace_local.mask = TRACE_BUFFER_EVENTS - 1;
+    trace_local.hdr = hdr;
+    log_info("Trace: thread %s writes its spans to %s (last %d kept, %.0f ticks per us)", name, path, TRACE_BUFFER_EVENTS, ticks_per_us);
+}
+
+void trace_thread_stop(void) {
+    if (trace_local.hdr) {
+        munmap(trace_local.hdr, sizeof(trace_header) + sizeof(trace_event) * (size_t)TRACE_BUFFER_EVENTS);
+        trace_local.hdr = NULL;
+    }
+}
+
+#endif
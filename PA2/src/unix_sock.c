@@ -0,0 +1,35 @@
+#define _GNU_SOURCE
+#include "unix_sock.h"
+
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "log.h"
+
+int unix_listen(const char *path, const char *what) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        log_error("%s Error: socket path %s is too long.", what, path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        log_error("%s Error: Could not create the socket.", what);
+        return -1;
+    }
+
+    unlink(path);  // left over from a previous run
+    // Linux creates the socket file with the socket inode's mode (minus the umask), so this restricts it.
+    if (fchmod(fd, S_IRUSR | S_IWUSR) < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+        log_error("%s Error: Could not listen on %s.", what, path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
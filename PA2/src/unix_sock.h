@@ -0,0 +1,12 @@
+#ifndef UNIX_SOCK_H
+#define UNIX_SOCK_H
+
+/**
+ * Listen on the Unix domain stream socket path, replacing a stale socket left there by a previous run.
+ * The socket gets owner-only permissions before bind() creates the file, without touching the process
+ * umask, which other threads may be relying on. Errors are logged as "<what> Error: ...".
+ * Return the listening fd; -1 on error.
+*/
+int unix_listen(const char *path, const char *what);
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef URING_H
+#define URING_H
+
+// Needs _GNU_SOURCE (struct mmsghdr in dgram_ring.h), defined before the first #include.
+#include <linux/io_uring.h>
+#include <stdint.h>
+
+#include "dgram_ring.h"
+
+// Minimal io_uring driver for one UDP socket, on the raw system calls (no liburing).
+// The socket is a registered (fixed) file, and so is the ring fd when the kernel allows it. Receives use
+// one multishot recvmsg that picks its buffers from a provided buffer ring made of the request buffers of
+// a dgram_ring, so one SQE keeps delivering datagrams until the buffers run out. Sends are ordinary
+// sendmsg SQEs. A single io_uring_enter() submits every queued send and waits for the next completions,
+// so with load a whole batch of datagrams costs one system call.
+// Needs Linux 6.0 (multishot recvmsg); uring_init() fails on older kernels, or where io_uring is disabled.
+
+// Buffer group id of the provided buffer ring.
+#define URING_BUF_GROUP 0
+
+typedef struct uring {
+    int ring_fd;
+    int enter_fd;              // ring_fd, or its registered index
+    unsigned enter_flags;      // IORING_ENTER_REGISTERED_RING when enter_fd is an index
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_pending;       // SQEs prepared since the last io_uring_enter()
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_map;              // SQ and CQ rings, one mapping (IORING_FEAT_SINGLE_MMAP)
+    size_t sq_map_len;
+    size_t sqes_len;
+    struct io_uring_buf_ring *buf_ring;  // provided buffers, one per dgram_ring slot
+    size_t buf_ring_len;
+    unsigned buf_mask;
+    unsigned short buf_tail;
+    unsigned long num_enters;  // io_uring_enter() calls, for the syscall count in the reports
+} uring;
+
+/**
+ * Set up a ring with room for entries SQEs and register sock_fd as fixed file 0.
+ * Return 0 on success; -1 if io_uring is not available (errno is kept).
+*/
+int uring_init(uring *u, unsigned entries, int sock_fd);
+
+/**
+ * Register the request buffers of ring as the provided buffer ring URING_BUF_GROUP; buffer id i is slot i.
+ * ring->num_slots must be a power of two.
+ * Return 0 on success; -1 on error.
+*/
+int uring_provide_buffers(uring *u, const dgram_ring *ring);
+
+/**
+ * Give the request buffer of slot back to the kernel once its datagram has been answered.
+*/
+void uring_recycle_buffer(uring *u, const dgram_ring *ring, int slot);
+
+/**
+ * Queue a multishot recvmsg on fixed file 0 that fills provided buffers laid out for msg (msg_namelen and
+ * msg_controllen set, no iovec). Its completions carry user_data.
+ * Return 0 on success; -1 if the SQ is full even after submitting.
+*/
+int uring_queue_recvmsg(uring *u, struct msghdr *msg, uint64_t user_data);
+
+/**
+ * Queue a sendmsg of msg on fixed file 0. msg must stay valid until its completion arrives.
+ * Return 0 on success; -1 if the SQ is full even after submitting.
+*/
+int uring_queue_sendmsg(uring *u, const struct msghdr *msg, uint64_t user_data);
+
+/**
+ * Submit every queued SQE and wait until at least wait_nr completions are ready, or timeout_ms passes
+ * (timeout_ms < 0 waits without a timeout).
+ * Return 0 on success, including a timeout or a signal; -1 on error.
+*/
+int uring_enter(uring *u, unsigned wait_nr, int timeout_ms);
+
+/**
+ * Next completion, or NULL if none is ready. Call uring_cqe_seen() when done with it.
+*/
+static inline struct io_uring_cqe *uring_peek_cqe(uring *u) {
+    unsigned head = *u->cq_head;
+    if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &u->cqes[head & u->cq_mask];
+}
+
+static inline void uring_cqe_seen(uring *u) {
+    __atomic_store_n(u->cq_head, *u->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Locate the datagram of a multishot recvmsg completion inside its provided buffer (slot of ring).
+ * Return the payload length, with *payload and *addr pointing into the buffer; -1 if the datagram or its
+ * address did not fit.
+*/
+int uring_recvmsg_datagram(const struct io_uring_cqe *cqe, const struct msghdr *msg, const dgram_ring *ring, int slot,
+                           unsigned char **payload, struct sockaddr_in **addr);
+
+void uring_free(uring *u);
+
+#endif
@@ -0,0 +1,106 @@
+#include "verify.h"
+
+#include "log.h"
+#include "metrics.h"
+#include "trace.h"
+#include "wire.h"
+
+const char *const verify_outcome_names[VERIFY_NUM_OUTCOMES] = {"ACC_OK", "NOT_PAID", "NOT_EXIST", "WRONG_TECH", "MALFORMED"};
+
+/**
+ * Classify one (sub_num, technology) query. *row is set to the subscriber's row, or -1 if it does not exist.
+ * Return a VERIFY_* code.
+*/
+static inline int verify_lookup(const sub_db *db, const sub_index *idx, unsigned long sub_num, char technology, int *row) {
+    TRACE_START(lookup_start);
+    *row = sub_index_find(idx, db->sub_nums, sub_num);
+    TRACE_END(TRACE_LOOKUP, lookup_start);
+    // The row's bytes may be updated in place by a delta record while we read them (see live_db.h).
+    char sub_tech = (char)INVALID_TECHNOLOGY;
+    char sub_paid = 0;
+    if (*row >= 0) {
+        sub_db_read_row(db, *row, &sub_tech, &sub_paid);
+    }
+    int code = VERIFY_OK;
+    if (sub_tech == (char)INVALID_TECHNOLOGY) {
+        code = VERIFY_NOT_EXIST;  // unknown, or deleted
+    } else if (technology != sub_tech) {
+        code = VERIFY_WRONG_TECH;
+    } else if (sub_paid == 0) {
+        code = VERIFY_NOT_PAID;
+    }
+    metrics_count(code);
+    return code;
+}
+
+/**
+ * Log the outcome of a single request; index is the subscriber's row (unused unless VERIFY_WRONG_TECH).
+*/
+static void log_outcome(const sub_db *db, unsigned long sub_num, char technology, int code, int index) {
+    switch (code) {
+        case VERIFY_NOT_EXIST:  // The subscriber number couldn't be found on the database.
+            log_warn("Access Denied: Subscriber %lu Does Not Exist in the Verification Database.", sub_num);
+            break;
+        case VERIFY_WRONG_TECH:  // The subscriber number asked for the wrong Technology
+            log_warn("Access Denied: Subscriber %lu Requested Access to Incorrect Technology. Requested %dG, but is authorized for %dG.", sub_num, (int)technology, (int)db->sub_techs[index]);
+            break;
+        case VERIFY_NOT_PAID:  // The subscriber number has not paid.
+            log_warn("Access Denied: Subscriber %lu have not paid.", sub_num);
+            break;
+        default:  // No issues found in database or client-packet. Give Access Permission to Client.
+            log_info("Access Granted: Subscriber %lu request has been verified against the Database.", sub_num);
+    }
+}
+
+/**
+ * Response type of a single request with outcome code.
+*/
+static inline short response_type(int code) {
+    switch (code) {
+        case VERIFY_OK:
+            return ACC_OK;
+        case VERIFY_NOT_PAID:
+            return NOT_PAID;
+        default:  // unknown subscriber or wrong technology
+            return NOT_EXIST;
+    }
+}
+
+int verify_datagram(const sub_db *db, const sub_index *idx, unsigned char *req, size_t len, unsigned char *rsp, unsigned char **out, unsigned long *copied) {
+    unsigned long sub_num;
+    char technology;
+    int index;
+    if (wire_peek_type(req, len) == ACC_PER_BATCH) {
+        TRACE_START(decode_start);
+        int count = wire_view_batch_request(req, len);
+        TRACE_END(TRACE_DECODE, decode_start);
+        if (count < 0) {
+            metrics_count(VERIFY_OUTCOME_MALFORMED);
+            return -1;
+        }
+        unsigned char *results = wire_answer_batch(req, count, rsp);
+        *copied += 2;  // client_id and seg_num echoed into rsp
+        int num_ok = 0;
+        for (int i = 0; i < count; i++) {
+            wire_batch_tuple(req, i, &sub_num, &technology);
+            int code = verify_lookup(db, idx, sub_num, technology, &index);
+            wire_set_result(results, i, code);
+            num_ok += code == VERIFY_OK;
+            log_debug("Batch %d, tuple %d: Subscriber %lu, %dG, result %d.", req[6], i, sub_num, (int)technology, code);
+        }
+        log_info("Verified batch %d of %d subscribers: %d granted, %d denied.", req[6], count, num_ok, count - num_ok);
+        *out = rsp;
+        return WIRE_BATCH_RESPONSE_LEN(count);
+    }
+    TRACE_START(decode_start);
+    int view = wire_view_message(req, len, &sub_num, &technology);
+    TRACE_END(TRACE_DECODE, decode_start);
+    if (view < 0) {
+        metrics_count(VERIFY_OUTCOME_MALFORMED);
+        return -1;
+    }
+    int code = verify_lookup(db, idx, sub_num, technology, &index);
+    log_outcome(db, sub_num, technology, code, index);
+    *out = req;  // answered in place, nothing is copied
+    return wire_answer_message(req, response_type(code), code == VERIFY_WRONG_TECH ? (char)INVALID_TECHNOLOGY : technology);
+}
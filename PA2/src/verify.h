@@ -0,0 +1,28 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stddef.h>
+
+#include "const.h"
+#include "sub_db.h"
+#include "sub_index.h"
+
+// Outcomes counted on the calling thread's metrics shard (metrics.h): one per (sub_num, technology) query,
+// single or batched, by VERIFY_* code, plus one per datagram dropped as malformed.
+#define VERIFY_OUTCOME_MALFORMED 4
+#define VERIFY_NUM_OUTCOMES 5
+
+extern const char *const verify_outcome_names[VERIFY_NUM_OUTCOMES];
+
+/**
+ * Verify the request datagram req[0..len), single or batched, where it was received:
+ * NOT_EXIST if the subscriber is unknown or asked for the wrong technology, NOT_PAID if it has not paid,
+ * ACC_OK otherwise. A single request is answered in place in req, and its outcome is logged; a batched
+ * one gets one VERIFY_* code per tuple in rsp (type ACC_RESULTS), which holds WIRE_BATCH_RESPONSE_MAX_LEN
+ * bytes, and individual outcomes are only logged at debug level. *copied grows by the request bytes
+ * that had to be copied into the response.
+ * Return the response length, with *out set to the buffer that holds it; -1 if the datagram is malformed.
+*/
+int verify_datagram(const sub_db *db, const sub_index *idx, unsigned char *req, size_t len, unsigned char *rsp, unsigned char **out, unsigned long *copied);
+
+#endif
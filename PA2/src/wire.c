@@ -0,0 +1,201 @@
+#include "wire.h"
+
+#include <stdint.h>
+#include <string.h>
+
+static inline unsigned char *put_u16(unsigned char *p, uint16_t v) {
+    p[0] = (unsigned char)(v >> 8);
+    p[1] = (unsigned char)v;
+    return p + 2;
+}
+
+static inline unsigned char *put_u64(unsigned char *p, uint64_t v) {
+    for (int i = 7; i >= 0; i--) {
+        p[i] = (unsigned char)v;
+        v >>= 8;
+    }
+    return p + 8;
+}
+
+static inline uint16_t get_u16(const unsigned char *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint64_t get_u64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+int wire_encode_message(const message_packet *pkt, unsigned char *buf, size_t buf_len) {
+    if (buf_len < WIRE_MESSAGE_LEN) {
+        return -1;
+    }
+    unsigned char *p = buf;
+    *p++ = WIRE_VERSION;
+    p = put_u16(p, (uint16_t)pkt->start_id);
+    *p++ = (unsigned char)pkt->client_id;
+    p = put_u16(p, (uint16_t)pkt->type);
+    *p++ = (unsigned char)pkt->seg_num;
+    *p++ = (unsigned char)pkt->length;
+    *p++ = (unsigned char)pkt->technology;
+    p = put_u64(p, (uint64_t)pkt->sub_num);
+    p = put_u16(p, (uint16_t)pkt->end_id);
+    return (int)(p - buf);
+}
+
+int wire_decode_message(message_packet *pkt, const unsigned char *buf, size_t len) {
+    if (len < WIRE_MESSAGE_LEN || buf[0] != WIRE_VERSION) {
+        return -1;
+    }
+    pkt->start_id = (short)get_u16(buf + 1);
+    pkt->client_id = (char)buf[3];
+    pkt->type = (short)get_u16(buf + 4);
+    pkt->seg_num = (char)buf[6];
+    pkt->length = (char)buf[7];
+    pkt->technology = (char)buf[8];
+    pkt->sub_num = (unsigned long)get_u64(buf + 9);
+    pkt->end_id = (short)get_u16(buf + 17);
+    return 0;
+}
+
+int wire_peek_type(const unsigned char *buf, size_t len) {
+    if (len < 6 || buf[0] != WIRE_VERSION) {
+        return -1;
+    }
+    return get_u16(buf + 4);
+}
+
+/**
+ * Write the fields shared by batched requests and responses. Return a pointer past them.
+*/
+static unsigned char *put_batch_header(unsigned char *p, const batch_packet *pkt) {
+    *p++ = WIRE_VERSION;
+    p = put_u16(p, (uint16_t)pkt->start_id);
+    *p++ = (unsigned char)pkt->client_id;
+    p = put_u16(p, (uint16_t)pkt->type);
+    *p++ = (unsigned char)pkt->seg_num;
+    *p++ = (unsigned char)pkt->count;
+    return p;
+}
+
+/**
+ * Read the fields shared by batched requests and responses.
+ * Return 0 on success; -1 if the version or count is invalid.
+*/
+static int get_batch_header(batch_packet *pkt, const unsigned char *buf, size_t len) {
+    if (len < WIRE_BATCH_HEADER_LEN || buf[0] != WIRE_VERSION) {
+        return -1;
+    }
+    pkt->start_id = (short)get_u16(buf + 1);
+    pkt->client_id = (char)buf[3];
+    pkt->type = (short)get_u16(buf + 4);
+    pkt->seg_num = (char)buf[6];
+    pkt->count = buf[7];
+    return pkt->count >= 1 && pkt->count <= MAX_VERIFY_BATCH ? 0 : -1;
+}
+
+int wire_encode_batch_request(const batch_packet *pkt, unsigned char *buf, size_t buf_len) {
+    if (pkt->count < 1 || pkt->count > MAX_VERIFY_BATCH || buf_len < (size_t)WIRE_BATCH_REQUEST_LEN(pkt->count)) {
+        return -1;
+    }
+    unsigned char *p = put_batch_header(buf, pkt);
+    for (int i = 0; i < pkt->count; i++) {
+        *p++ = (unsigned char)pkt->technology[i];
+        p = put_u64(p, (uint64_t)pkt->sub_num[i]);
+    }
+    p = put_u16(p, (uint16_t)pkt->end_id);
+    return (int)(p - buf);
+}
+
+int wire_decode_batch_request(batch_packet *pkt, const unsigned char *buf, size_t len) {
+    if (get_batch_header(pkt, buf, len) < 0 || len < (size_t)WIRE_BATCH_REQUEST_LEN(pkt->count)) {
+        return -1;
+    }
+    const unsigned char *p = buf + WIRE_BATCH_HEADER_LEN;
+    for (int i = 0; i < pkt->count; i++) {
+        pkt->technology[i] = (char)p[0];
+        pkt->sub_num[i] = (unsigned long)get_u64(p + 1);
+        p += 9;
+    }
+    pkt->end_id = (short)get_u16(p);
+    return 0;
+}
+
+int wire_encode_batch_response(const batch_packet *pkt, unsigned char *buf, size_t buf_len) {
+    if (pkt->count < 1 || pkt->count > MAX_VERIFY_BATCH || buf_len < (size_t)WIRE_BATCH_RESPONSE_LEN(pkt->count)) {
+        return -1;
+    }
+    unsigned char *p = put_batch_header(buf, pkt);
+    int num_bytes = (pkt->count + 3) / 4;
+    memset(p, 0, num_bytes);
+    for (int i = 0; i < pkt->count; i++) {
+        p[i / 4] |= (unsigned char)((pkt->result[i] & 3) << (2 * (i % 4)));
+    }
+    p += num_bytes;
+    p = put_u16(p, (uint16_t)pkt->end_id);
+    return (int)(p - buf);
+}
+
+int wire_decode_batch_response(batch_packet *pkt, const unsigned char *buf, size_t len) {
+    if (get_batch_header(pkt, buf, len) < 0 || len < (size_t)WIRE_BATCH_RESPONSE_LEN(pkt->count)) {
+        return -1;
+    }
+    const unsigned char *p = buf + WIRE_BATCH_HEADER_LEN;
+    for (int i = 0; i < pkt->count; i++) {
+        pkt->result[i] = (p[i / 4] >> (2 * (i % 4))) & 3;
+    }
+    pkt->end_id = (short)get_u16(p + (pkt->count + 3) / 4);
+    return 0;
+}
+
+int wire_view_message(const unsigned char *buf, size_t len, unsigned long *sub_num, char *technology) {
+    if (len < WIRE_MESSAGE_LEN || buf[0] != WIRE_VERSION) {
+        return -1;
+    }
+    *technology = (char)buf[8];
+    *sub_num = (unsigned long)get_u64(buf + 9);
+    return 0;
+}
+
+int wire_answer_message(unsigned char *buf, short type, char technology) {
+    put_u16(buf + 1, START_ID);
+    put_u16(buf + 4, (uint16_t)type);
+    buf[7] = WIRE_MESSAGE_PAYLOAD_LEN;
+    buf[8] = (unsigned char)technology;
+    put_u16(buf + 17, END_ID);
+    return WIRE_MESSAGE_LEN;
+}
+
+int wire_view_batch_request(const unsigned char *buf, size_t len) {
+    if (len < WIRE_BATCH_HEADER_LEN || buf[0] != WIRE_VERSION) {
+        return -1;
+    }
+    int count = buf[7];
+    if (count < 1 || count > MAX_VERIFY_BATCH || len < (size_t)WIRE_BATCH_REQUEST_LEN(count)) {
+        return -1;
+    }
+    return count;
+}
+
+void wire_batch_tuple(const unsigned char *buf, int i, unsigned long *sub_num, char *technology) {
+    const unsigned char *p = buf + WIRE_BATCH_HEADER_LEN + 9 * i;
+    *technology = (char)p[0];
+    *sub_num = (unsigned long)get_u64(p + 1);
+}
+
+unsigned char *wire_answer_batch(const unsigned char *req, int count, unsigned char *rsp) {
+    unsigned char *p = rsp;
+    *p++ = WIRE_VERSION;
+    p = put_u16(p, START_ID);
+    *p++ = req[3];  // client_id
+    p = put_u16(p, ACC_RESULTS);
+    *p++ = req[6];  // seg_num
+    *p++ = (unsigned char)count;
+    int num_bytes = (count + 3) / 4;
+    memset(p, 0, num_bytes);
+    put_u16(p + num_bytes, END_ID);
+    return p;
+}
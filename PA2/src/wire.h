@@ -0,0 +1,114 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stddef.h>
+
+#include "const.h"
+
+// On-the-wire encoding of message_packet.
+// Fields are packed back to back with no padding, multi-byte fields in network byte order,
+// and every datagram starts with a version byte, so peers built for any ABI or byte order agree:
+//   version(1) start_id(2) client_id(1) type(2) seg_num(1) length(1) technology(1) sub_num(8) end_id(2)
+// sub_num always travels as 64 bits, whatever the width of unsigned long on either peer.
+// Batched verification (batch_packet) shares the first six bytes, so the type tells the two apart:
+//   request   version(1) start_id(2) client_id(1) type(2) seg_num(1) count(1) count x [technology(1) sub_num(8)] end_id(2)
+//   response  version(1) start_id(2) client_id(1) type(2) seg_num(1) count(1) results(ceil(count / 4)) end_id(2)
+// The response packs the VERIFY_* code of tuple i into bits 2 * (i % 4) of results byte i / 4.
+// Bump WIRE_VERSION whenever the layout changes.
+#define WIRE_VERSION 1
+
+#define WIRE_MESSAGE_LEN 19
+
+// Value of the length field: the technology and sub_num bytes that follow it.
+#define WIRE_MESSAGE_PAYLOAD_LEN 9
+
+#define WIRE_BATCH_HEADER_LEN 8
+#define WIRE_BATCH_REQUEST_LEN(count) (WIRE_BATCH_HEADER_LEN + 9 * (count) + 2)
+#define WIRE_BATCH_RESPONSE_LEN(count) (WIRE_BATCH_HEADER_LEN + ((count) + 3) / 4 + 2)
+#define WIRE_BATCH_REQUEST_MAX_LEN WIRE_BATCH_REQUEST_LEN(MAX_VERIFY_BATCH)
+#define WIRE_BATCH_RESPONSE_MAX_LEN WIRE_BATCH_RESPONSE_LEN(MAX_VERIFY_BATCH)
+
+/**
+ * Read the type field of the datagram buf[0..len) without decoding it.
+ * Return the type as an unsigned 16-bit value; -1 if the datagram is too short or has another wire version.
+*/
+int wire_peek_type(const unsigned char *buf, size_t len);
+
+/**
+ * Encode pkt into buf, which holds buf_len bytes.
+ * Return the number of bytes written; -1 if buf is too small.
+*/
+int wire_encode_message(const message_packet *pkt, unsigned char *buf, size_t buf_len);
+
+/**
+ * Decode the datagram buf[0..len) into pkt.
+ * Return 0 on success; -1 if the datagram is truncated or has another wire version.
+*/
+int wire_decode_message(message_packet *pkt, const unsigned char *buf, size_t len);
+
+/**
+ * Encode the pkt->count (technology, sub_num) tuples of a batched request into buf, which holds buf_len bytes.
+ * Return the number of bytes written; -1 if count is out of range or buf is too small.
+*/
+int wire_encode_batch_request(const batch_packet *pkt, unsigned char *buf, size_t buf_len);
+
+/**
+ * Decode the batched request buf[0..len) into pkt.
+ * Return 0 on success; -1 if the datagram is truncated, its count is out of range, or it has another wire version.
+*/
+int wire_decode_batch_request(batch_packet *pkt, const unsigned char *buf, size_t len);
+
+/**
+ * Encode the pkt->count result codes of a batched response into buf, which holds buf_len bytes.
+ * Return the number of bytes written; -1 if count is out of range or buf is too small.
+*/
+int wire_encode_batch_response(const batch_packet *pkt, unsigned char *buf, size_t buf_len);
+
+/**
+ * Decode the batched response buf[0..len) into pkt.
+ * Return 0 on success; -1 if the datagram is truncated, its count is out of range, or it has another wire version.
+*/
+int wire_decode_batch_response(batch_packet *pkt, const unsigned char *buf, size_t len);
+
+// In-place access for the server's receive path (see dgram_ring.h): requests are read where recvmmsg()
+// left them and answered without going through message_packet or batch_packet.
+
+/**
+ * Check the single request buf[0..len) and read the two fields a lookup needs.
+ * Return 0 on success; -1 if the datagram is truncated or has another wire version.
+*/
+int wire_view_message(const unsigned char *buf, size_t len, unsigned long *sub_num, char *technology);
+
+/**
+ * Turn the checked single request in buf into its response in place. Client id, seg_num and sub_num stay
+ * where they are; ids, type, length and technology are rewritten.
+ * Return the number of bytes of the response (WIRE_MESSAGE_LEN).
+*/
+int wire_answer_message(unsigned char *buf, short type, char technology);
+
+/**
+ * Check the batched request buf[0..len).
+ * Return its tuple count; -1 if the datagram is truncated, its count is out of range, or it has another wire version.
+*/
+int wire_view_batch_request(const unsigned char *buf, size_t len);
+
+/**
+ * Read tuple i of a checked batched request.
+*/
+void wire_batch_tuple(const unsigned char *buf, int i, unsigned long *sub_num, char *technology);
+
+/**
+ * Write the response to the checked batched request req into rsp, which holds WIRE_BATCH_RESPONSE_LEN(count)
+ * bytes, with every result code VERIFY_OK (0); set the codes with wire_set_result().
+ * Return a pointer to the result bytes.
+*/
+unsigned char *wire_answer_batch(const unsigned char *req, int count, unsigned char *rsp);
+
+/**
+ * Set the 2-bit code of tuple i in the result bytes returned by wire_answer_batch().
+*/
+static inline void wire_set_result(unsigned char *results, int i, int code) {
+    results[i / 4] |= (unsigned char)((code & 3) << (2 * (i % 4)));
+}
+
+#endif
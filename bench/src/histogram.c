@@ -0,0 +1,80 @@
+#include "histogram.h"
+
+#include <string.h>
+
+static inline int bucket_index(uint64_t value) {
+    if (value < HIST_SUB_COUNT) {
+        return (int)value;
+    }
+    int exp = 63 - __builtin_clzll(value);  // >= HIST_SUB_BITS
+    int shift = exp - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_COUNT + (int)((value >> shift) - HIST_SUB_COUNT);
+}
+
+/**
+ * Largest value that maps to bucket index.
+*/
+static inline uint64_t bucket_high(int index) {
+    if (index < HIST_SUB_COUNT) {
+        return (uint64_t)index;
+    }
+    int shift = index / HIST_SUB_COUNT - 1;
+    uint64_t low = (uint64_t)(index % HIST_SUB_COUNT + HIST_SUB_COUNT) << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+void hist_init(histogram *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void hist_record(histogram *h, uint64_t value) {
+    h->counts[bucket_index(value)]++;
+    h->total++;
+    h->sum += (double)value;
+    if (value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+void hist_merge(histogram *dst, const histogram *src) {
+    for (int i = 0; i < HIST_NUM_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+uint64_t hist_percentile(const histogram *h, double p) {
+    if (h->total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(p / 100.0 * (double)h->total + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    } else if (rank > h->total) {
+        rank = h->total;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_NUM_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t high = bucket_high(i);
+            return high < h->max ? high : h->max;
+        }
+    }
+    return h->max;
+}
+
+double hist_mean(const histogram *h) {
+    return h->total > 0 ? h->sum / (double)h->total : 0.0;
+}
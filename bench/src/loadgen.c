@@ -0,0 +1,470 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../PA2/src/log.h"
+#include "histogram.h"
+#include "proto.h"
+
+// UDP load generator for the PA1 and PA2 servers.
+// Every worker thread owns a socket and up to MAX_SLOTS request slots. A slot is one logical client:
+// its client_id is the slot number and it has at most one request outstanding, whose seg_num is
+// the slot's sequence number (advanced only once the request is answered, so a request that timed
+// out is sent again with the same seg_num, like a retransmission).
+//   closed loop (--concurrency C): C slots in total are kept busy, each sends its next request as soon
+//                                  as the previous one is answered or times out.
+//   open loop (--rate R):          requests leave at R per second in total, whatever the server does.
+//                                  Latency is measured from the time a request was due, not the time
+//                                  it was sent, so a stalled generator does not hide server stalls.
+#define MAX_SLOTS 256
+
+#define DEFAULT_DURATION_S 5
+#define DEFAULT_TIMEOUT_MS 1000
+#define DEFAULT_PA1_PAYLOAD_LEN 32
+#define DEFAULT_PORT 8080  // DEFAULT_SERVER_PORT of both servers
+
+// Percentiles reported on stdout and in the machine-readable output.
+static const double percentiles[] = {50.0, 90.0, 99.0, 99.9};
+#define NUM_PERCENTILES (sizeof(percentiles) / sizeof(percentiles[0]))
+
+typedef struct loadgen_cfg {
+    const proto *proto;
+    struct sockaddr_in server_addr;
+    int threads;
+    double rate;      // requests per second over all threads, 0 = closed loop
+    int concurrency;  // outstanding requests over all threads in closed loop
+    double duration_s;
+    long timeout_ns;
+    const char *output_path;
+    const char *label;
+} loadgen_cfg;
+
+typedef struct slot {
+    int busy;           // a request is outstanding
+    unsigned char seq;  // seg_num of the outstanding (or next) request
+    uint64_t sent_ns;   // when the outstanding request was due
+} slot;
+
+typedef struct worker {
+    pthread_t thread;
+    int id;
+    const loadgen_cfg *cfg;
+    int fd;
+    int num_slots;
+    slot slots[MAX_SLOTS];
+    int next_slot;            // open loop: where the search for an idle slot starts
+    unsigned long rng;
+    histogram hist;           // latency of every answered request, ns
+    unsigned long sent;       // requests sent, retransmissions included
+    unsigned long received;   // responses matched to an outstanding request
+    unsigned long accepted;   // responses that accepted the request
+    unsigned long lost;       // requests not answered within the timeout
+    unsigned long stale;      // responses for no outstanding request (late, duplicate, or malformed)
+    unsigned long overruns;   // open loop: requests skipped because every slot was busy
+    unsigned long send_errors;
+} worker;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned long next_rand(unsigned long *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+/**
+ * Send the request of slot k, due at due_ns, and mark the slot busy.
+*/
+static void send_slot(worker *w, int k, uint64_t due_ns) {
+    unsigned char buf[PROTO_MAX_DATAGRAM];
+    slot *s = &w->slots[k];
+    int len = w->cfg->proto->encode((unsigned char)k, s->seq, next_rand(&w->rng), buf, sizeof(buf));
+    s->busy = 1;
+    s->sent_ns = due_ns;
+    if (len < 0 || send(w->fd, buf, (size_t)len, 0) < 0) {
+        w->send_errors++;  // left busy, so it times out and is sent again
+        return;
+    }
+    w->sent++;
+}
+
+/**
+ * Read every response waiting on the socket and retire the requests they answer.
+ * In closed loop the slot sends its next request right away.
+*/
+static void drain_responses(worker *w, int sending) {
+    unsigned char buf[PROTO_MAX_DATAGRAM];
+    for (;;) {
+        ssize_t len = recv(w->fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;  // EAGAIN, or a pending ICMP error for an unreachable port
+        }
+        uint64_t now = now_ns();
+        unsigned char tag, seq;
+        int accepted;
+        if (w->cfg->proto->decode(buf, (size_t)len, &tag, &seq, &accepted) < 0 ||
+            tag >= w->num_slots || !w->slots[tag].busy || w->slots[tag].seq != seq) {
+            w->stale++;
+            continue;
+        }
+        slot *s = &w->slots[tag];
+        hist_record(&w->hist, now > s->sent_ns ? now - s->sent_ns : 0);
+        s->busy = 0;
+        s->seq++;
+        w->received++;
+        w->accepted += accepted;
+        if (sending && w->cfg->rate == 0) {
+            send_slot(w, tag, now);
+        }
+    }
+}
+
+/**
+ * Give up on every request outstanding for longer than the timeout.
+ * In closed loop the slot sends it again.
+*/
+static void expire_requests(worker *w, uint64_t now, int sending) {
+    for (int k = 0; k < w->num_slots; k++) {
+        slot *s = &w->slots[k];
+        if (s->busy && now - s->sent_ns >= (uint64_t)w->cfg->timeout_ns) {
+            s->busy = 0;
+            w->lost++;
+            if (sending && w->cfg->rate == 0) {
+                send_slot(w, k, now);
+            }
+        }
+    }
+}
+
+/**
+ * Open loop: index of an idle slot; -1 if all are busy.
+*/
+static int find_idle_slot(worker *w) {
+    for (int i = 0; i < w->num_slots; i++) {
+        int k = (w->next_slot + i) % w->num_slots;
+        if (!w->slots[k].busy) {
+            w->next_slot = (k + 1) % w->num_slots;
+            return k;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Wait until the socket is readable or until deadline_ns, whichever comes first.
+*/
+static void wait_until(worker *w, uint64_t deadline_ns) {
+    uint64_t now = now_ns();
+    uint64_t wait = deadline_ns > now ? deadline_ns - now : 0;
+    struct timespec ts = {(time_t)(wait / 1000000000ULL), (long)(wait % 1000000000ULL)};
+    struct pollfd pfd = {w->fd, POLLIN, 0};
+    ppoll(&pfd, 1, &ts, NULL);
+}
+
+static void *worker_run(void *arg) {
+    worker *w = arg;
+    const loadgen_cfg *cfg = w->cfg;
+    uint64_t start = now_ns();
+    uint64_t end = start + (uint64_t)(cfg->duration_s * 1e9);
+    uint64_t interval = 0;
+    uint64_t next_send = start;
+    uint64_t check_interval = (uint64_t)cfg->timeout_ns / 4;  // timeouts are enforced to within 25%
+    uint64_t next_check = start + check_interval;
+
+    if (cfg->rate > 0) {
+        // Workers are staggered over one interval so the threads do not send in bursts.
+        interval = (uint64_t)(1e9 * cfg->threads / cfg->rate);
+        next_send = start + interval * (uint64_t)w->id / (uint64_t)cfg->threads;
+    } else {
+        for (int k = 0; k < w->num_slots; k++) {
+            send_slot(w, k, start);
+        }
+    }
+
+    uint64_t now = start;
+    while (now < end) {
+        if (cfg->rate > 0) {
+            // Catch up on every request that fell due, each keeps its own due time.
+            while (next_send <= now && next_send < end) {
+                int k = find_idle_slot(w);
+                if (k < 0) {
+                    w->overruns++;
+                } else {
+                    send_slot(w, k, next_send);
+                }
+                next_send += interval;
+            }
+        }
+        drain_responses(w, 1);
+        now = now_ns();
+        if (now >= next_check) {
+            expire_requests(w, now, 1);
+            next_check = now + check_interval;
+        }
+        uint64_t deadline = next_check < end ? next_check : end;
+        if (cfg->rate > 0 && next_send < deadline) {
+            deadline = next_send;
+        }
+        wait_until(w, deadline);
+        now = now_ns();
+    }
+
+    // Stop sending and give the requests still outstanding one timeout to come back.
+    uint64_t drain_end = now + (uint64_t)cfg->timeout_ns;
+    for (;;) {
+        drain_responses(w, 0);
+        int busy = 0;
+        for (int k = 0; k < w->num_slots; k++) {
+            busy += w->slots[k].busy;
+        }
+        now = now_ns();
+        if (busy == 0 || now >= drain_end) {
+            break;
+        }
+        wait_until(w, drain_end);
+    }
+    expire_requests(w, UINT64_MAX / 2, 0);
+    return NULL;
+}
+
+/**
+ * Append the results as one JSON object per line, so runs on successive commits can be diffed and plotted.
+ * Return 0 on success; -1 on error.
+*/
+static int write_output(const loadgen_cfg *cfg, const worker *total, double elapsed_s) {
+    FILE *fp = fopen(cfg->output_path, "a");
+    if (!fp) {
+        log_error("Could not open output file %s.", cfg->output_path);
+        return -1;
+    }
+    fprintf(fp, "{\"label\":\"%s\",\"time\":%ld,\"proto\":\"%s\",\"mode\":\"%s\",\"threads\":%d,",
+            cfg->label ? cfg->label : "", (long)time(NULL), cfg->proto->name, cfg->rate > 0 ? "open" : "closed", cfg->threads);
+    fprintf(fp, "\"offered_rate\":%.0f,\"concurrency\":%d,\"duration_s\":%.3f,", cfg->rate, cfg->rate > 0 ? 0 : cfg->concurrency, elapsed_s);
+    fprintf(fp, "\"sent\":%lu,\"received\":%lu,\"accepted\":%lu,\"lost\":%lu,\"stale\":%lu,\"overruns\":%lu,\"send_errors\":%lu,",
+            total->sent, total->received, total->accepted, total->lost, total->stale, total->overruns, total->send_errors);
+    fprintf(fp, "\"throughput\":%.1f,\"loss_pct\":%.4f,", total->received / elapsed_s,
+            total->sent > 0 ? 100.0 * total->lost / total->sent : 0.0);
+    fprintf(fp, "\"latency_us\":{\"min\":%.3f,\"mean\":%.3f,", total->hist.total ? total->hist.min / 1e3 : 0.0, hist_mean(&total->hist) / 1e3);
+    for (size_t i = 0; i < NUM_PERCENTILES; i++) {
+        fprintf(fp, "\"p%g\":%.3f,", percentiles[i], hist_percentile(&total->hist, percentiles[i]) / 1e3);
+    }
+    fprintf(fp, "\"max\":%.3f}}\n", total->hist.max / 1e3);
+    int err = ferror(fp);
+    if (fclose(fp) != 0 || err) {
+        log_error("Could not write output file %s.", cfg->output_path);
+        return -1;
+    }
+    return 0;
+}
+
+static void print_report(const loadgen_cfg *cfg, const worker *total, double elapsed_s) {
+    if (cfg->rate > 0) {
+        printf("%s open loop: %d threads, offered %.0f req/s, %.1f s\n", cfg->proto->name, cfg->threads, cfg->rate, elapsed_s);
+    } else {
+        printf("%s closed loop: %d threads, concurrency %d, %.1f s\n", cfg->proto->name, cfg->threads, cfg->concurrency, elapsed_s);
+    }
+    printf("  sent %lu  received %lu  lost %lu (%.3f%%)  stale %lu  overruns %lu  send errors %lu\n",
+           total->sent, total->received, total->lost, total->sent > 0 ? 100.0 * total->lost / total->sent : 0.0,
+           total->stale, total->overruns, total->send_errors);
+    printf("  throughput %.0f resp/s, %lu accepted, %lu denied\n", total->received / elapsed_s, total->accepted, total->received - total->accepted);
+    printf("  latency us: min %.1f  mean %.1f", total->hist.total ? total->hist.min / 1e3 : 0.0, hist_mean(&total->hist) / 1e3);
+    for (size_t i = 0; i < NUM_PERCENTILES; i++) {
+        printf("  p%g %.1f", percentiles[i], hist_percentile(&total->hist, percentiles[i]) / 1e3);
+    }
+    printf("  max %.1f\n", total->hist.max / 1e3);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s --proto pa1|pa2 [options] [port]\n", prog);
+    fprintf(stderr, "  -P, --proto P        server to drive: pa1 (DATA/ACK) or pa2 (ACC_PER/ACC_OK)\n");
+    fprintf(stderr, "  -H, --host ADDR      server IPv4 address (default 127.0.0.1)\n");
+    fprintf(stderr, "  -t, --threads N      sender threads, one socket each (default 1)\n");
+    fprintf(stderr, "  -r, --rate R         open loop: offer R requests/s in total\n");
+    fprintf(stderr, "  -c, --concurrency C  closed loop: keep C requests outstanding in total, up to %d per thread (default 1 per thread)\n", MAX_SLOTS);
+    fprintf(stderr, "  -d, --duration S     seconds to send for (default %d)\n", DEFAULT_DURATION_S);
+    fprintf(stderr, "  -T, --timeout MS     count a request lost after MS ms (default %d)\n", DEFAULT_TIMEOUT_MS);
+    fprintf(stderr, "  -s, --size S         pa1: payload bytes per request (default %d)\n", DEFAULT_PA1_PAYLOAD_LEN);
+    fprintf(stderr, "  -D, --db FILE        pa2: query the subscribers of this database (default: random numbers)\n");
+    fprintf(stderr, "  -o, --output FILE    append the results to FILE as one JSON object per line\n");
+    fprintf(stderr, "  -l, --label TEXT     label stored with the results, e.g. a commit id\n");
+}
+
+int main(int argc, char **argv) {
+    // ======================== CLI ARGS PARSING ========================
+    loadgen_cfg cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.threads = 1;
+    cfg.duration_s = DEFAULT_DURATION_S;
+    cfg.timeout_ns = DEFAULT_TIMEOUT_MS * 1000000L;
+    const char *host = "127.0.0.1";
+    proto_opts popts = {DEFAULT_PA1_PAYLOAD_LEN, NULL};
+    int port = DEFAULT_PORT;
+
+    static const struct option long_opts[] = {
+        {"proto", required_argument, NULL, 'P'},
+        {"host", required_argument, NULL, 'H'},
+        {"threads", required_argument, NULL, 't'},
+        {"rate", required_argument, NULL, 'r'},
+        {"concurrency", required_argument, NULL, 'c'},
+        {"duration", required_argument, NULL, 'd'},
+        {"timeout", required_argument, NULL, 'T'},
+        {"size", required_argument, NULL, 's'},
+        {"db", required_argument, NULL, 'D'},
+        {"output", required_argument, NULL, 'o'},
+        {"label", required_argument, NULL, 'l'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "P:H:t:r:c:d:T:s:D:o:l:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'P':
+                if (strcmp(optarg, "pa1") == 0) {
+                    cfg.proto = &proto_pa1;
+                } else if (strcmp(optarg, "pa2") == 0) {
+                    cfg.proto = &proto_pa2;
+                } else {
+                    log_fatal("Unknown protocol %s, must be pa1 or pa2.", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'H':
+                host = optarg;
+                break;
+            case 't':
+                cfg.threads = atoi(optarg);
+                break;
+            case 'r':
+                cfg.rate = atof(optarg);
+                break;
+            case 'c':
+                cfg.concurrency = atoi(optarg);
+                break;
+            case 'd':
+                cfg.duration_s = atof(optarg);
+                break;
+            case 'T':
+                cfg.timeout_ns = atol(optarg) * 1000000L;
+                break;
+            case 's':
+                popts.payload_len = atoi(optarg);
+                break;
+            case 'D':
+                popts.db_path = optarg;
+                break;
+            case 'o':
+                cfg.output_path = optarg;
+                break;
+            case 'l':
+                cfg.label = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    if (optind < argc) {
+        port = atoi(argv[optind]);
+    }
+    if (cfg.concurrency == 0) {
+        cfg.concurrency = cfg.threads;
+    }
+    if (!cfg.proto) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.threads < 1 || cfg.rate < 0 || cfg.duration_s <= 0 || cfg.timeout_ns <= 0 ||
+        (cfg.rate == 0 && (cfg.concurrency < cfg.threads || cfg.concurrency > cfg.threads * MAX_SLOTS))) {
+        log_fatal("Invalid load: need threads >= 1, duration > 0, timeout > 0 and, in closed loop, threads <= concurrency <= %d x threads.", MAX_SLOTS);
+        exit(EXIT_FAILURE);
+    }
+    cfg.server_addr.sin_family = AF_INET;
+    cfg.server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &cfg.server_addr.sin_addr) != 1) {
+        log_fatal("Invalid server address %s.", host);
+        exit(EXIT_FAILURE);
+    }
+    if (cfg.proto->init(&popts) < 0) {
+        log_fatal("Could not set up the %s requests.", cfg.proto->name);
+        exit(EXIT_FAILURE);
+    }
+
+    // ======================== RUN WORKERS ========================
+    worker *workers = calloc((size_t)cfg.threads, sizeof(worker));
+    if (!workers) {
+        log_fatal("Could not allocate %d workers.", cfg.threads);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < cfg.threads; i++) {
+        worker *w = &workers[i];
+        w->id = i;
+        w->cfg = &cfg;
+        w->rng = 0x9E3779B97F4A7C15ULL * (unsigned long)(i + 1);
+        // Closed loop splits the concurrency over the threads; open loop may use every slot.
+        w->num_slots = cfg.rate > 0 ? MAX_SLOTS : cfg.concurrency / cfg.threads + (i < cfg.concurrency % cfg.threads);
+        hist_init(&w->hist);
+        w->fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (w->fd < 0 || connect(w->fd, (struct sockaddr *)&cfg.server_addr, sizeof(cfg.server_addr)) < 0) {
+            log_fatal("Could not open a socket to %s:%d.", host, port);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < cfg.threads; i++) {
+        if (pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]) != 0) {
+            log_fatal("Could not start worker %d.", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    worker total;
+    memset(&total, 0, sizeof(total));
+    hist_init(&total.hist);
+    for (int i = 0; i < cfg.threads; i++) {
+        worker *w = &workers[i];
+        pthread_join(w->thread, NULL);
+        close(w->fd);
+        hist_merge(&total.hist, &w->hist);
+        total.sent += w->sent;
+        total.received += w->received;
+        total.accepted += w->accepted;
+        total.lost += w->lost;
+        total.stale += w->stale;
+        total.overruns += w->overruns;
+        total.send_errors += w->send_errors;
+    }
+    // Throughput is over the sending period; the final drain only collects late responses.
+    double elapsed_s = (now_ns() - start) / 1e9;
+    if (elapsed_s > cfg.duration_s) {
+        elapsed_s = cfg.duration_s;
+    }
+    free(workers);
+
+    print_report(&cfg, &total, elapsed_s);
+    if (cfg.proto == &proto_pa1 && total.received > total.accepted) {
+        printf("  (a pa1 server without --window rejects seg_num past 127 on each client_id, run it with --window 2 or more)\n");
+    }
+    if (cfg.output_path && write_output(&cfg, &total, elapsed_s) < 0) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef PROTO_H
+#define PROTO_H
+
+#include <stddef.h>
+
+// Largest request or response datagram of any protocol below.
+#define PROTO_MAX_DATAGRAM 2048
+
+// Protocol settings from the load generator's command line.
+typedef struct proto_opts {
+    int payload_len;      // PA1: payload bytes per request
+    const char *db_path;  // PA2: database whose subscribers are queried, NULL for random numbers
+} proto_opts;
+
+// How the load generator talks to one of the servers.
+// Every request is tagged with (tag, seq): tag is the client_id, seq the 8-bit seg_num, and both
+// servers echo them back, which is how a response is matched to the request it answers.
+typedef struct proto {
+    const char *name;
+
+    /**
+     * Prepare the request templates. Called once before any worker starts.
+     * Return 0 on success; -1 on error.
+    */
+    int (*init)(const proto_opts *opts);
+
+    /**
+     * Encode the request (tag, seq) into buf. query is a random number that picks what is asked for.
+     * Return the number of bytes written; -1 on error.
+    */
+    int (*encode)(unsigned char tag, unsigned char seq, unsigned long query, unsigned char *buf, size_t buf_len);
+
+    /**
+     * Decode a response, setting its tag and seq, and whether the server accepted the request
+     * (PA1: ACK rather than REJECT; PA2: ACC_OK rather than NOT_PAID/NOT_EXIST).
+     * Return 0 on success; -1 if the datagram is not a valid response.
+    */
+    int (*decode)(const unsigned char *buf, size_t len, unsigned char *tag, unsigned char *seq, int *accepted);
+} proto;
+
+extern const proto proto_pa1;
+extern const proto proto_pa2;
+
+#endif
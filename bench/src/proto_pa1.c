@@ -0,0 +1,42 @@
+#include <string.h>
+
+#include "../../PA1/src/const.h"
+#include "../../PA1/src/wire.h"
+#include "proto.h"
+
+static request_packet template;
+static int payload_len;
+
+static int pa1_init(const proto_opts *opts) {
+    if (opts->payload_len < 0 || opts->payload_len > LENGTH_MAX) {
+        return -1;
+    }
+    payload_len = opts->payload_len;
+    template.start_id = START_ID;
+    template.data = DATA;
+    template.length = (char)payload_len;
+    memset(template.payload, 'x', sizeof(template.payload));
+    template.end_id = END_ID;
+    return 0;
+}
+
+static int pa1_encode(unsigned char tag, unsigned char seq, unsigned long query, unsigned char *buf, size_t buf_len) {
+    (void)query;
+    request_packet pkt = template;
+    pkt.client_id = (char)tag;
+    pkt.seg_num = (char)seq;
+    return wire_encode_request(&pkt, payload_len, buf, buf_len);
+}
+
+static int pa1_decode(const unsigned char *buf, size_t len, unsigned char *tag, unsigned char *seq, int *accepted) {
+    response_packet pkt;
+    if (wire_decode_response(&pkt, buf, len) < 0) {
+        return -1;
+    }
+    *tag = (unsigned char)pkt.client_id;
+    *seq = (unsigned char)pkt.seg_num;
+    *accepted = pkt.type == (short)ACK;
+    return 0;
+}
+
+const proto proto_pa1 = {"pa1", pa1_init, pa1_encode, pa1_decode};
@@ -0,0 +1,47 @@
+#include "../../PA2/src/const.h"
+#include "../../PA2/src/log.h"
+#include "../../PA2/src/sub_db.h"
+#include "../../PA2/src/wire.h"
+#include "proto.h"
+
+static sub_db db;  // empty when no database was given
+
+static int pa2_init(const proto_opts *opts) {
+    if (!opts->db_path) {
+        log_info("No database given, querying random subscriber numbers.");
+        return 0;
+    }
+    return sub_db_load_text(&db, opts->db_path);
+}
+
+static int pa2_encode(unsigned char tag, unsigned char seq, unsigned long query, unsigned char *buf, size_t buf_len) {
+    message_packet pkt;
+    pkt.start_id = START_ID;
+    pkt.client_id = (char)tag;
+    pkt.type = ACC_PER;
+    pkt.seg_num = (char)seq;
+    pkt.length = WIRE_MESSAGE_PAYLOAD_LEN;
+    if (db.len > 0) {
+        int row = (int)(query % (unsigned long)db.len);
+        pkt.sub_num = db.sub_nums[row];
+        pkt.technology = db.sub_techs[row];
+    } else {
+        pkt.sub_num = 4080000000UL + query % 1000000000UL;
+        pkt.technology = (char)(2 + query % 4);
+    }
+    pkt.end_id = END_ID;
+    return wire_encode_message(&pkt, buf, buf_len);
+}
+
+static int pa2_decode(const unsigned char *buf, size_t len, unsigned char *tag, unsigned char *seq, int *accepted) {
+    message_packet pkt;
+    if (wire_decode_message(&pkt, buf, len) < 0) {
+        return -1;
+    }
+    *tag = (unsigned char)pkt.client_id;
+    *seq = (unsigned char)pkt.seg_num;
+    *accepted = pkt.type == (short)ACC_OK;
+    return 0;
+}
+
+const proto proto_pa2 = {"pa2", pa2_init, pa2_encode, pa2_decode};
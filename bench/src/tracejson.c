@@ -0,0 +1,120 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../../PA2/src/trace.h"
+
+// Converts the trace files written by servers built with -DSERVER_TRACE=1 (see PA2/src/trace.h) into one
+// Chrome trace JSON document on stdout: one complete ("X") event per span, one row per traced thread, all
+// on a common time line. A per-stage summary goes to stderr. Files of a server that is still running can be
+// read too; spans written during the conversion may be cut off at the oldest end of the ring.
+
+typedef struct trace_file {
+    const char *path;
+    const trace_header *hdr;
+    const trace_event *events;
+    size_t len;  // bytes mapped
+} trace_file;
+
+/**
+ * Map path read-only and check its header.
+ * Return 0 on success; -1 on error.
+*/
+static int open_trace(const char *path, trace_file *f) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    f->path = path;
+    f->len = (size_t)st.st_size;
+    void *mem = f->len >= sizeof(trace_header) ? mmap(NULL, f->len, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "%s: not a trace file\n", path);
+        return -1;
+    }
+    f->hdr = mem;
+    f->events = (const trace_event *)(f->hdr + 1);
+    if (memcmp(f->hdr->magic, TRACE_MAGIC, sizeof(f->hdr->magic)) != 0 || f->hdr->version != TRACE_VERSION ||
+        f->hdr->capacity == 0 || f->len < sizeof(trace_header) + sizeof(trace_event) * (size_t)f->hdr->capacity ||
+        f->hdr->ticks_per_us <= 0) {
+        fprintf(stderr, "%s: not a trace file of version %d\n", path, TRACE_VERSION);
+        munmap(mem, f->len);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s TRACE_FILE... > trace.json\n", argv[0]);
+        fprintf(stderr, "  TRACE_FILE  trace.<pid>.<tid>.bin written by a server built with -DSERVER_TRACE=1\n");
+        return EXIT_FAILURE;
+    }
+    trace_file *files = calloc((size_t)argc, sizeof(trace_file));
+    int num_files = 0;
+    for (int i = 1; i < argc; i++) {
+        if (open_trace(argv[i], &files[num_files]) == 0) {
+            num_files++;
+        }
+    }
+    if (num_files == 0) {
+        return EXIT_FAILURE;
+    }
+    // Timestamps count from the first thread that started tracing.
+    uint64_t base = files[0].hdr->base_ticks;
+    for (int i = 1; i < num_files; i++) {
+        base = files[i].hdr->base_ticks < base ? files[i].hdr->base_ticks : base;
+    }
+
+    unsigned long count[TRACE_NUM_STAGES] = {0};
+    double total_us[TRACE_NUM_STAGES] = {0};
+    double max_us[TRACE_NUM_STAGES] = {0};
+    printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    int first = 1;
+    for (int i = 0; i < num_files; i++) {
+        const trace_header *hdr = files[i].hdr;
+        printf("%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%.*s %u\"}}",
+               first ? "" : ",\n", hdr->pid, hdr->tid, TRACE_NAME_LEN, hdr->thread_name, hdr->tid);
+        first = 0;
+        unsigned long head = atomic_load_explicit((atomic_ulong *)&hdr->head, memory_order_acquire);
+        unsigned long from = head > hdr->capacity ? head - hdr->capacity : 0;
+        for (unsigned long n = from; n < head; n++) {
+            const trace_event *e = &files[i].events[n % hdr->capacity];
+            if (e->stage >= TRACE_NUM_STAGES || e->start < base) {
+                continue;
+            }
+            double ts = (double)(e->start - base) / hdr->ticks_per_us;
+            double dur = (double)e->duration / hdr->ticks_per_us;
+            printf(",\n{\"ph\":\"X\",\"name\":\"%.*s\",\"cat\":\"server\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"n\":%u}}",
+                   TRACE_NAME_LEN, hdr->stage_names[e->stage], hdr->pid, hdr->tid, ts, dur, e->arg);
+            count[e->stage]++;
+            total_us[e->stage] += dur;
+            max_us[e->stage] = dur > max_us[e->stage] ? dur : max_us[e->stage];
+        }
+    }
+    printf("\n]}\n");
+
+    fprintf(stderr, "%-10s %10s %12s %10s %10s\n", "stage", "spans", "total ms", "mean us", "max us");
+    for (int s = 0; s < TRACE_NUM_STAGES; s++) {
+        if (count[s] > 0) {
+            fprintf(stderr, "%-10.*s %10lu %12.3f %10.3f %10.3f\n", TRACE_NAME_LEN, files[0].hdr->stage_names[s], count[s],
+                    total_us[s] / 1e3, total_us[s] / count[s], max_us[s]);
+        }
+    }
+    for (int i = 0; i < num_files; i++) {
+        munmap((void *)files[i].hdr, files[i].len);
+    }
+    free(files);
+    return 0;
+}
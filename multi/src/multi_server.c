@@ -0,0 +1,393 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../PA2/src/dgram_ring.h"
+#include "../../PA2/src/log.h"
+#include "service.h"
+
+// Most ports one server hosts.
+#ifndef MAX_LISTENERS
+#define MAX_LISTENERS 32
+#endif
+
+// Default number of datagrams pulled per recvmmsg() and flushed per sendmmsg(), as in the PA servers.
+#ifndef DEFAULT_BATCH_SIZE
+#define DEFAULT_BATCH_SIZE 64
+#endif
+
+#ifndef MAX_BATCH_SIZE
+#define MAX_BATCH_SIZE 1024
+#endif
+
+// Seconds between two reports of the per-port counters.
+#ifndef BATCH_REPORT_INTERVAL
+#define BATCH_REPORT_INTERVAL 10
+#endif
+
+// One port and the service that answers it.
+typedef struct listener {
+    const service *svc;
+    void *state;                  // the service's state for this port
+    int fd;                       // non-blocking UDP socket, registered edge-triggered
+    char addr[INET_ADDRSTRLEN];   // address the socket is bound to
+    int port;
+    int readable;                 // datagrams may be queued: the socket has not returned EAGAIN since the last edge
+    unsigned long num_batches;    // recvmmsg() calls that returned data since the last report
+    unsigned long num_datagrams;  // datagrams received over those calls
+    unsigned long bytes_copied;   // request bytes copied out of the ring over those datagrams
+} listener;
+
+static const service *const services[] = {&service_pa1, &service_pa2};
+#define NUM_SERVICES (int)(sizeof(services) / sizeof(services[0]))
+
+static long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+/**
+ * Parse a listener spec, `service:port` or `service:address:port`, into l (service, address and port).
+ * Return 0 on success; -1 if the spec is invalid.
+*/
+static int parse_listener(const char *spec, listener *l) {
+    const char *colon = strchr(spec, ':');
+    if (!colon) {
+        return -1;
+    }
+    l->svc = NULL;
+    for (int i = 0; i < NUM_SERVICES; i++) {
+        if (strlen(services[i]->name) == (size_t)(colon - spec) && strncmp(spec, services[i]->name, colon - spec) == 0) {
+            l->svc = services[i];
+        }
+    }
+    const char *port = strrchr(spec, ':') + 1;
+    if (!l->svc || *port == '\0') {
+        return -1;
+    }
+    if (port - 1 == colon) {
+        strcpy(l->addr, "0.0.0.0");
+    } else if ((size_t)(port - 1 - (colon + 1)) < sizeof(l->addr)) {
+        memcpy(l->addr, colon + 1, port - 1 - (colon + 1));
+        l->addr[port - 1 - (colon + 1)] = '\0';
+    } else {
+        return -1;
+    }
+    char *end;
+    long p = strtol(port, &end, 10);
+    if (*end != '\0' || p < 1 || p > 65535) {
+        return -1;
+    }
+    l->port = (int)p;
+    return 0;
+}
+
+/**
+ * Create l's non-blocking UDP socket, bind it to l's address and port, and register it with epfd for
+ * edge-triggered input.
+ * Return 0 on success; -1 on error.
+*/
+static int open_listener(int epfd, listener *l) {
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(l->port);
+    if (inet_pton(AF_INET, l->addr, &server_addr.sin_addr) != 1) {
+        log_error("Invalid address %s.", l->addr);
+        return -1;
+    }
+    if ((l->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+        log_error("Socket creation failed.");
+        return -1;
+    }
+    if (bind(l->fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        log_error("Binding %s:%d failed: %s", l->addr, l->port, strerror(errno));
+        close(l->fd);
+        return -1;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = l;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, l->fd, &ev) < 0) {
+        log_error("Could not register %s:%d with epoll: %s", l->addr, l->port, strerror(errno));
+        close(l->fd);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Send all responses in out[0..count) on l's socket. sendmmsg() may stop early, so keep going from where it stopped.
+ * A socket buffer that is full drops the rest of the batch: the clients retransmit, as for any lost datagram.
+*/
+static void flush_responses(listener *l, struct mmsghdr *out, int count) {
+    int sent = 0;
+    while (sent < count) {
+        int ret = sendmmsg(l->fd, out + sent, count - sent, 0);
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            log_warn("Port %d: send buffer full, dropped %d responses.", l->port, count - sent);
+            return;
+        } else if (ret < 0) {
+            char client_ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &((struct sockaddr_in *)out[sent].msg_hdr.msg_name)->sin_addr, client_ip, sizeof(client_ip));
+            log_error("Server Error: Failed to Send Packet to Client ip = %s.", client_ip);
+            // skip this response, in case issue was on Client's end
+            sent++;
+        } else {
+            sent += ret;
+        }
+    }
+}
+
+/**
+ * Take one batch of at most batch datagrams from l's socket into ring, answer them with l's service and
+ * send the responses. Clears l->readable once the socket is drained.
+ * Return 0 on success; -1 on a fatal receive error.
+*/
+static int serve_batch(listener *l, dgram_ring *ring, int batch) {
+    dgram_ring_rearm(ring, batch);
+    int num_msgs = recvmmsg(l->fd, ring->in_msgs, batch, MSG_DONTWAIT, NULL);
+    if (num_msgs < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            l->readable = 0;
+            return 0;
+        } else if (errno == EINTR) {  // queued datagrams raise no new edge: stay readable and retry
+            return 0;
+        }
+        l->readable = 0;
+        log_error("Error at recvmmsg() on port %d: %s", l->port, strerror(errno));
+        return -1;
+    }
+    // A short batch emptied the queue; a datagram that arrives after it raises a new edge.
+    if (num_msgs < batch) {
+        l->readable = 0;
+    }
+    l->num_batches++;
+    l->num_datagrams += num_msgs;
+    long recv_ms = now_ms();
+
+    l->svc->begin_batch(l->state);
+    int num_out = 0;
+    for (int i = 0; i < num_msgs; i++) {
+        unsigned char *out;  // request slot (answered in place) or response slot
+        int out_len = l->svc->handle(l->state, dgram_ring_req(ring, i), ring->in_msgs[i].msg_len, dgram_ring_addr(ring, i),
+                                     recv_ms, dgram_ring_rsp(ring, i), &out, &l->bytes_copied);
+        if (out_len >= 0) {
+            dgram_ring_respond(ring, num_out, i, out, out_len);
+            num_out++;
+        }
+    }
+    l->svc->end_batch(l->state);
+    flush_responses(l, ring->out_msgs, num_out);
+    return 0;
+}
+
+/**
+ * Log the average batch fill and bytes copied per datagram of every port that received something since the
+ * last report, then reset the counters.
+*/
+static void report(listener *listeners, int num_listeners, int batch) {
+    for (int i = 0; i < num_listeners; i++) {
+        listener *l = &listeners[i];
+        if (l->num_batches > 0 && l->num_datagrams > 0) {
+            log_info("Port %d (%s): %lu datagrams in %lu batches, average batch fill %.2f / %d, %.2f bytes copied per datagram",
+                     l->port, l->svc->name, l->num_datagrams, l->num_batches, (double)l->num_datagrams / l->num_batches, batch,
+                     (double)l->bytes_copied / l->num_datagrams);
+        }
+        l->num_batches = 0;
+        l->num_datagrams = 0;
+        l->bytes_copied = 0;
+    }
+}
+
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void log_lock(bool lock, void *udata) {
+    if (lock) {
+        pthread_mutex_lock(udata);
+    } else {
+        pthread_mutex_unlock(udata);
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--batch N] [--window N] [--control PATH] [--async-log] SERVICE:[ADDRESS:]PORT...\n", prog);
+    fprintf(stderr, "  SERVICE  pa1 (segment ingest, as PA1/build/server) or pa2 (subscriber verification, as PA2/build/server)\n");
+    fprintf(stderr, "  -b, --batch N  datagrams per recvmmsg()/sendmmsg(), 1..%d (default %d)\n", MAX_BATCH_SIZE, DEFAULT_BATCH_SIZE);
+    fprintf(stderr, "  -w, --window N  pa1: selective-repeat window (default 1, strict order)\n");
+    fprintf(stderr, "  -c, --control PATH  pa2: Unix socket that takes delta records\n");
+    fprintf(stderr, "  -a, --async-log  format and write log lines on a background thread, dropping them when it falls behind\n");
+}
+
+int main(int argc, char **argv) {
+    // ======================== CLI ARGS PARSING ========================
+    int batch_size = DEFAULT_BATCH_SIZE;
+    service_opts opts = {.window = 1, .control_path = NULL};
+    static const struct option long_opts[] = {
+        {"batch", required_argument, NULL, 'b'},
+        {"window", required_argument, NULL, 'w'},
+        {"control", required_argument, NULL, 'c'},
+        {"async-log", no_argument, NULL, 'a'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "b:w:c:ah", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'b':
+                batch_size = atoi(optarg);
+                if (batch_size < 1 || batch_size > MAX_BATCH_SIZE) {
+                    log_fatal("Invalid batch size %s, must be 1..%d.", optarg, MAX_BATCH_SIZE);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'w':
+                opts.window = atoi(optarg);
+                if (opts.window < 1) {
+                    log_fatal("Invalid window size %s.", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'c':
+                opts.control_path = optarg;
+                break;
+            case 'a':
+                if (log_async_start(LOG_ASYNC_DEFAULT_CAPACITY) < 0) {
+                    log_fatal("Could not start the asynchronous logger.");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                usage(argv[0]);
+                exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    int num_listeners = argc - optind;
+    if (num_listeners < 1 || num_listeners > MAX_LISTENERS) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    listener listeners[MAX_LISTENERS];
+    memset(listeners, 0, sizeof(listeners));
+    for (int i = 0; i < num_listeners; i++) {
+        if (parse_listener(argv[optind + i], &listeners[i]) < 0) {
+            log_fatal("Invalid listener %s, must be SERVICE:[ADDRESS:]PORT.", argv[optind + i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // ======================== SERVICES AND SOCKETS ========================
+    // Each service used by some port is set up once; each port gets its own socket and service state.
+    // The pa2 service starts a watcher and a control thread that log next to the server loop.
+    log_set_lock(log_lock, &log_mutex);
+    int used[NUM_SERVICES] = {0};
+    for (int s = 0; s < NUM_SERVICES; s++) {
+        for (int i = 0; i < num_listeners; i++) {
+            used[s] |= listeners[i].svc == services[s];
+        }
+        if (used[s] && services[s]->init(&opts) < 0) {
+            log_fatal("Could not start service %s.", services[s]->name);
+            exit(EXIT_FAILURE);
+        }
+    }
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        log_fatal("epoll_create1() failed.");
+        exit(EXIT_FAILURE);
+    }
+    // One ring serves every port in turn, so its slots must fit the largest datagrams of any service.
+    size_t req_len = 0;
+    size_t rsp_len = 0;
+    for (int i = 0; i < num_listeners; i++) {
+        listener *l = &listeners[i];
+        if (open_listener(epfd, l) < 0) {
+            exit(EXIT_FAILURE);
+        }
+        if (!(l->state = l->svc->open(&opts, now_ms()))) {
+            log_fatal("Could not set up port %d.", l->port);
+            exit(EXIT_FAILURE);
+        }
+        // Datagrams may have arrived between bind() and epoll_ctl(), before any edge could be seen.
+        l->readable = 1;
+        req_len = l->svc->req_len > req_len ? l->svc->req_len : req_len;
+        rsp_len = l->svc->rsp_len > rsp_len ? l->svc->rsp_len : rsp_len;
+        log_info("Multi Server: %s on %s:%d", l->svc->name, l->addr, l->port);
+    }
+    dgram_ring ring;
+    if (dgram_ring_init(&ring, batch_size, req_len, rsp_len) < 0) {
+        log_fatal("Could not allocate the datagram ring.");
+        exit(EXIT_FAILURE);
+    }
+    log_info("Multi Server: %d port(s), batch size %d, epoll", num_listeners, batch_size);
+
+    // ======================== SERVER LOOP ========================
+    // One thread, one epoll set. Edge-triggered sockets only report new arrivals, so a readable socket is
+    // served until it returns EAGAIN (or a short batch). Ready ports take turns one batch at a time, so a
+    // busy port cannot starve the others; epoll_wait() sleeps until the next datagram or session timeout.
+    struct epoll_event events[MAX_LISTENERS];
+    time_t last_report = time(NULL);
+    int ret = 0;
+    while (ret == 0) {
+        int more = 1;
+        while (more && ret == 0) {
+            more = 0;
+            for (int i = 0; i < num_listeners && ret == 0; i++) {
+                if (listeners[i].readable) {
+                    ret = serve_batch(&listeners[i], &ring, batch_size);
+                    more |= listeners[i].readable;
+                }
+            }
+        }
+
+        long now = now_ms();
+        int timeout = -1;
+        for (int i = 0; i < num_listeners; i++) {
+            listeners[i].svc->expire(listeners[i].state, now);
+            int t = listeners[i].svc->next_timeout(listeners[i].state, now);
+            if (t >= 0 && (timeout < 0 || t < timeout)) {
+                timeout = t;
+            }
+        }
+        if (time(NULL) - last_report >= BATCH_REPORT_INTERVAL) {
+            report(listeners, num_listeners, batch_size);
+            last_report = time(NULL);
+        }
+        if (ret != 0) {
+            break;
+        }
+
+        int num_events = epoll_wait(epfd, events, MAX_LISTENERS, timeout);
+        if (num_events < 0 && errno != EINTR) {
+            log_error("Error at epoll_wait(). Stop.");
+            ret = -1;
+        }
+        for (int i = 0; i < num_events; i++) {
+            ((listener *)events[i].data.ptr)->readable = 1;
+        }
+    }
+
+    report(listeners, num_listeners, batch_size);
+    dgram_ring_free(&ring);
+    for (int i = 0; i < num_listeners; i++) {
+        listeners[i].svc->close(listeners[i].state);
+        close(listeners[i].fd);
+    }
+    for (int s = 0; s < NUM_SERVICES; s++) {
+        if (used[s]) {
+            services[s]->shutdown();
+        }
+    }
+    close(epfd);
+    return ret;
+}
@@ -0,0 +1,69 @@
+#ifndef SERVICE_H
+#define SERVICE_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+
+// Settings from the multi-protocol server's command line that services may use.
+typedef struct service_opts {
+    int window;                // PA1: selective-repeat window, 1 = every segment must arrive in order
+    const char *control_path;  // PA2: Unix socket for delta records, see PA2/src/control.h
+} service_opts;
+
+// One protocol the multi-protocol server can host on a port.
+// Every port is served by one listener of a service, each with its own state; the server loop calls a
+// listener's hooks only from its own thread, so none of them needs to lock.
+typedef struct service {
+    const char *name;
+    size_t req_len;  // largest request datagram
+    size_t rsp_len;  // largest response datagram
+
+    /**
+     * Set up what the listeners of this service share (e.g. the subscriber database). Called once,
+     * before the first open(), and only if a port uses the service.
+     * Return 0 on success; -1 on error.
+    */
+    int (*init)(const service_opts *opts);
+
+    /**
+     * Create the state of a new listener.
+     * Return the state; NULL on error.
+    */
+    void *(*open)(const service_opts *opts, long now_ms);
+
+    /**
+     * A batch of datagrams is about to be handled, or has been. Shared state may only change between
+     * end_batch() and the next begin_batch().
+    */
+    void (*begin_batch)(void *state);
+    void (*end_batch)(void *state);
+
+    /**
+     * Handle the request datagram req[0..len) from addr, received at now_ms. The response goes into rsp
+     * (rsp_len bytes), or is written in place over req; *out is set to whichever holds it. *copied grows by
+     * the request bytes copied out of req.
+     * Return the response length; -1 if the datagram was dropped.
+    */
+    int (*handle)(void *state, unsigned char *req, int len, const struct sockaddr_in *addr, long now_ms,
+                  unsigned char *rsp, unsigned char **out, unsigned long *copied);
+
+    /**
+     * Milliseconds until expire() has work to do, for use as an epoll_wait() timeout.
+     * Return -1 (wait forever) when there is none.
+    */
+    int (*next_timeout)(void *state, long now_ms);
+
+    void (*expire)(void *state, long now_ms);
+
+    void (*close)(void *state);
+
+    /**
+     * Release what init() set up, after every listener was closed.
+    */
+    void (*shutdown)(void);
+} service;
+
+extern const service service_pa1;
+extern const service service_pa2;
+
+#endif
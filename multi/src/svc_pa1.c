@@ -0,0 +1,85 @@
+#include <stdlib.h>
+
+#include "../../PA1/src/const.h"
+#include "../../PA1/src/log.h"
+#include "../../PA1/src/segment.h"
+#include "../../PA1/src/session.h"
+#include "../../PA1/src/wire.h"
+#include "service.h"
+
+// PA1 listener: its own sessions, so two PA1 ports never share a client's seg_num.
+typedef struct pa1_listener {
+    session_table sessions;
+    int window;
+} pa1_listener;
+
+static int pa1_init(const service_opts *opts) {
+    if (opts->window > MAX_WINDOW_SIZE) {
+        log_error("Invalid window size %d, must be 1..%d.", opts->window, MAX_WINDOW_SIZE);
+        return -1;
+    }
+    return 0;
+}
+
+static void *pa1_open(const service_opts *opts, long now_ms) {
+    pa1_listener *l = malloc(sizeof(pa1_listener));
+    if (!l) {
+        return NULL;
+    }
+    // Same timeout as the PA1 server: a client silent for SERVER_WAIT_TIMEOUT ms starts over at seg_num 0.
+    if (session_table_init(&l->sessions, SERVER_WAIT_TIMEOUT, now_ms) < 0) {
+        free(l);
+        return NULL;
+    }
+    l->window = opts->window;
+    return l;
+}
+
+static void pa1_batch(void *state) {
+    (void)state;
+}
+
+static int pa1_handle(void *state, unsigned char *req, int len, const struct sockaddr_in *addr, long now_ms,
+                      unsigned char *rsp, unsigned char **out, unsigned long *copied) {
+    pa1_listener *l = state;
+    int rsp_len = segment_handle(&l->sessions, l->window, req, len, addr, now_ms, rsp);
+    if (rsp_len >= 0) {
+        *out = rsp;
+        *copied += WIRE_REQUEST_FIELDS_LEN;
+    }
+    return rsp_len;
+}
+
+static int pa1_next_timeout(void *state, long now_ms) {
+    pa1_listener *l = state;
+    return session_table_next_timeout(&l->sessions, now_ms);
+}
+
+static void pa1_expire(void *state, long now_ms) {
+    pa1_listener *l = state;
+    session_table_expire(&l->sessions, now_ms);
+}
+
+static void pa1_close(void *state) {
+    pa1_listener *l = state;
+    session_table_free(&l->sessions);
+    free(l);
+}
+
+static void pa1_shutdown(void) {
+}
+
+const service service_pa1 = {
+    .name = "pa1",
+    .req_len = WIRE_REQUEST_MAX_LEN,
+    .rsp_len = WIRE_RESPONSE_LEN,
+    .init = pa1_init,
+    .open = pa1_open,
+    .begin_batch = pa1_batch,
+    .end_batch = pa1_batch,
+    .handle = pa1_handle,
+    .next_timeout = pa1_next_timeout,
+    .expire = pa1_expire,
+    .close = pa1_close,
+    .shutdown = pa1_shutdown,
+};
@@ -0,0 +1,114 @@
+#include <arpa/inet.h>
+#include <stdlib.h>
+
+#include "../../PA2/src/const.h"
+#include "../../PA2/src/control.h"
+#include "../../PA2/src/live_db.h"
+#include "../../PA2/src/log.h"
+#include "../../PA2/src/verify.h"
+#include "../../PA2/src/wire.h"
+#include "service.h"
+
+// The subscriber database is loaded once and shared by every PA2 listener. The server loop is a single
+// thread, so it is one reader of the live_db, online only while it handles a PA2 batch: reloads and delta
+// updates proceed while the loop waits in epoll_wait().
+#define PA2_READER 0
+
+static live_db ldb;
+static control_server control;
+static int control_running;
+
+// PA2 listener: the database version held for the current batch.
+typedef struct pa2_listener {
+    const db_version *v;
+} pa2_listener;
+
+static int pa2_init(const service_opts *opts) {
+    // Same database files and live reload as the PA2 server, see live_db.h.
+    if (live_db_init(&ldb, DB_SNAPSHOT_NAME, DB_FILE_NAME, DB_DELTA_LOG_NAME, 1) < 0) {
+        log_error("DB Error: Could not load %s.", DB_FILE_NAME);
+        return -1;
+    }
+    log_info("Indexed %d subscribers", atomic_load(&ldb.current)->db.len);
+    if (live_db_watch(&ldb) < 0) {
+        log_warn("Changes to %s will need a server restart.", DB_FILE_NAME);
+    }
+    control_running = control_start(&control, &ldb, opts->control_path ? opts->control_path : CONTROL_SOCKET_NAME) == 0;
+    if (!control_running) {
+        log_warn("Delta updates are disabled.");
+    }
+    return 0;
+}
+
+static void *pa2_open(const service_opts *opts, long now_ms) {
+    (void)opts;
+    (void)now_ms;
+    return calloc(1, sizeof(pa2_listener));
+}
+
+static void pa2_begin_batch(void *state) {
+    pa2_listener *l = state;
+    l->v = live_db_enter(&ldb, PA2_READER);
+}
+
+static void pa2_end_batch(void *state) {
+    pa2_listener *l = state;
+    l->v = NULL;
+    live_db_exit(&ldb, PA2_READER);
+}
+
+static int pa2_handle(void *state, unsigned char *req, int len, const struct sockaddr_in *addr, long now_ms,
+                      unsigned char *rsp, unsigned char **out, unsigned long *copied) {
+    pa2_listener *l = state;
+    char client_ip[INET_ADDRSTRLEN];
+    (void)now_ms;
+    inet_ntop(AF_INET, &addr->sin_addr, client_ip, sizeof(client_ip));
+    // Sanity check: packet has content
+    if (len == 0) {
+        log_warn("Received zero bytes at recvmmsg(), client ip = %s", client_ip);  // datagram sockets might permit zero length packets
+    } else {
+        log_info("Message received from client ip = %s", client_ip);
+    }
+    int out_len = verify_datagram(&l->v->db, &l->v->idx, req, len, rsp, out, copied);
+    if (out_len < 0) {
+        log_warn("Dropped malformed datagram of %d bytes from client ip = %s (wire version %d).", len, client_ip, WIRE_VERSION);
+    }
+    return out_len;
+}
+
+static int pa2_next_timeout(void *state, long now_ms) {
+    (void)state;
+    (void)now_ms;
+    return -1;
+}
+
+static void pa2_expire(void *state, long now_ms) {
+    (void)state;
+    (void)now_ms;
+}
+
+static void pa2_close(void *state) {
+    free(state);
+}
+
+static void pa2_shutdown(void) {
+    if (control_running) {
+        control_stop(&control);
+    }
+    live_db_free(&ldb);
+}
+
+const service service_pa2 = {
+    .name = "pa2",
+    .req_len = WIRE_BATCH_REQUEST_MAX_LEN,
+    .rsp_len = WIRE_BATCH_RESPONSE_MAX_LEN,
+    .init = pa2_init,
+    .open = pa2_open,
+    .begin_batch = pa2_begin_batch,
+    .end_batch = pa2_end_batch,
+    .handle = pa2_handle,
+    .next_timeout = pa2_next_timeout,
+    .expire = pa2_expire,
+    .close = pa2_close,
+    .shutdown = pa2_shutdown,
+};